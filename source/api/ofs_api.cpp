@@ -14,7 +14,6 @@ int fs_format(const char* omni_path, const char* config_path) {
     if (!omni_path || !config_path) 
     return (int)OFSErrorCodes::ERROR_INVALID_CONFIG;
     FSConfig cfg;
-    std::memset(&cfg, 0, sizeof(cfg));
     bool ok = parse_uconf(config_path, cfg);
     if (!ok) return (int)OFSErrorCodes::ERROR_INVALID_CONFIG;
     FileSystem fs;
@@ -24,13 +23,19 @@ int fs_format(const char* omni_path, const char* config_path) {
 }
 
 int fs_init(void** instance, const char* omni_path, const char* config_path) {
+    return fs_init_snapshot(instance, omni_path, config_path, nullptr);
+}
+
+// a null or empty snapshot name mounts the container's own tree
+int fs_init_snapshot(void** instance, const char* omni_path, const char* config_path,
+                     const char* snapshot) {
     if (!instance || !omni_path || !config_path) return (int)OFSErrorCodes::ERROR_INVALID_CONFIG;
     FSConfig cfg;
-    std::memset(&cfg, 0, sizeof(cfg));
     bool ok = parse_uconf(config_path, cfg);
     if (!ok) return (int)OFSErrorCodes::ERROR_INVALID_CONFIG;
     FileSystem* fs = new FileSystem();
-    bool r = fs->load_existing(cfg, omni_path);
+    bool r = snapshot && snapshot[0] ? fs->load_snapshot(cfg, omni_path, snapshot)
+                                     : fs->load_existing(cfg, omni_path);
     if (!r) {
         delete fs;
         return (int)OFSErrorCodes::ERROR_IO_ERROR;
@@ -86,47 +91,47 @@ int get_session_info(void* session, SessionInfo* info) {
     return to_int(c);
 }
 
-int file_create(void* session, const char* path, const char* data, size_t size) {
+int file_create(void* /*session*/, const char* /*path*/, const char* /*data*/, size_t /*size*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int file_read(void* session, const char* path, char** buffer, size_t* size) {
+int file_read(void* /*session*/, const char* /*path*/, char** /*buffer*/, size_t* /*size*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int file_edit(void* session, const char* path, const char* data, size_t size, unsigned int index) {
+int file_edit(void* /*session*/, const char* /*path*/, const char* /*data*/, size_t /*size*/, unsigned int /*index*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int file_delete(void* session, const char* path) {
+int file_delete(void* /*session*/, const char* /*path*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int file_truncate(void* session, const char* path) {
+int file_truncate(void* /*session*/, const char* /*path*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int dir_create(void* session, const char* path) {
+int dir_create(void* /*session*/, const char* /*path*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int dir_list(void* session, const char* path, FileEntry** entries, int* count) {
+int dir_list(void* /*session*/, const char* /*path*/, FileEntry** /*entries*/, int* /*count*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int dir_delete(void* session, const char* path) {
+int dir_delete(void* /*session*/, const char* /*path*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int get_metadata(void* session, const char* path, FileMetadata* meta) {
+int get_metadata(void* /*session*/, const char* /*path*/, FileMetadata* /*meta*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int set_permissions(void* session, const char* path, uint32_t permissions) {
+int set_permissions(void* /*session*/, const char* /*path*/, uint32_t /*permissions*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
-int get_stats(void* session, FSStats* stats) {
+int get_stats(void* /*session*/, FSStats* /*stats*/) {
     return (int)OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
 }
 
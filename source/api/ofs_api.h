@@ -7,6 +7,8 @@ extern "C" {
 
 int fs_format(const char* omni_path, const char* config_path);
 int fs_init(void** instance, const char* omni_path, const char* config_path);
+int fs_init_snapshot(void** instance, const char* omni_path, const char* config_path,
+                     const char* snapshot);
 void fs_shutdown(void* instance);
 
 int user_login(void** session, const char* username, const char* password);
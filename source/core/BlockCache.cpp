@@ -0,0 +1,450 @@
+#include "BlockCache.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+void BlockCache::init(FileIo* file, uint64_t data_off, uint32_t blk_size, uint32_t blk_count,
+                      uint64_t budget_bytes)
+{
+    io = file;
+    data_offset = data_off;
+    block_size = blk_size;
+    block_count = blk_count;
+    hit_count = 0;
+    miss_count = 0;
+    io_errors = 0;
+    ahead_count = 0;
+
+    uint64_t total = budget_bytes ? budget_bytes / blk_size : blk_count;
+    total = std::max<uint64_t>(total, MIN_SHARD_FRAMES);
+    total = std::min<uint64_t>(total, std::max<uint32_t>(blk_count, 1));
+    uint32_t n = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(total / MIN_SHARD_FRAMES, 1),
+                                              MAX_SHARDS);
+
+    // frames are dealt out like blocks (block b lives in shard b % n), so
+    // with a whole-region budget no shard ever evicts
+    shards.clear();
+    shards.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        Shard& s = shards[i];
+        s.cap = (uint32_t)(total / n + (i < total % n ? 1 : 0));
+        s.p = 0;
+        s.nodes.resize(2 * (size_t)s.cap + 1);
+        s.free_nodes.clear();
+        for (uint32_t k = (uint32_t)s.nodes.size(); k-- > 0;) s.free_nodes.push_back(k);
+        for (List& l : s.lists) l = { NONE, NONE, 0 };
+        s.map.clear();
+        s.mem = aligned_buf((size_t)s.cap * block_size);
+        s.frames.assign(s.cap, Frame{ 0, false, FRAME_IDLE });
+        s.free_frames.clear();
+        for (uint32_t k = s.cap; k-- > 0;) s.free_frames.push_back(k);
+    }
+
+    std::vector<std::pair<void*, size_t>> bufs;
+    for (Shard& s : shards) bufs.push_back({ s.mem.get(), (size_t)s.cap * block_size });
+    io->register_buffers(bufs);
+}
+
+BlockCache::AlignedBuf BlockCache::aligned_buf(size_t n) {
+    n = (n + DATA_ALIGN - 1) / DATA_ALIGN * DATA_ALIGN;
+    return AlignedBuf((uint8_t*)aligned_alloc(DATA_ALIGN, n ? n : DATA_ALIGN));
+}
+
+uint8_t* BlockCache::run_space(size_t n) {
+    if (n > run_cap) {
+        run_buf = aligned_buf(n);
+        run_cap = n;
+    }
+    return run_buf.get();
+}
+
+uint32_t BlockCache::capacity() const {
+    uint32_t c = 0;
+    for (const Shard& s : shards) c += s.cap;
+    return c;
+}
+
+void BlockCache::unlink(Shard& s, uint32_t n) {
+    Node& nd = s.nodes[n];
+    List& l = s.lists[nd.list];
+    if (nd.prev != NONE) s.nodes[nd.prev].next = nd.next;
+    else l.mru = nd.next;
+    if (nd.next != NONE) s.nodes[nd.next].prev = nd.prev;
+    else l.lru = nd.prev;
+    l.size--;
+}
+
+void BlockCache::push_mru(Shard& s, uint32_t n, uint8_t list) {
+    Node& nd = s.nodes[n];
+    List& l = s.lists[list];
+    nd.list = list;
+    nd.prev = NONE;
+    nd.next = l.mru;
+    if (l.mru != NONE) s.nodes[l.mru].prev = n;
+    else l.lru = n;
+    l.mru = n;
+    l.size++;
+}
+
+void BlockCache::drop_node(Shard& s, uint32_t n) {
+    if (n == NONE) return;
+    unlink(s, n);
+    s.map.erase(s.nodes[n].blk);
+    s.free_nodes.push_back(n);
+}
+
+void BlockCache::write_back(Shard& s, uint32_t n) {
+    Node& nd = s.nodes[n];
+    Frame& fr = s.frames[nd.frame];
+    if (!fr.dirty) return;
+    const uint8_t* data = frame_ptr(s, nd.frame);
+    if (before_write) before_write(nd.blk, data);
+    if (io->write(data_offset + (uint64_t)nd.blk * block_size, data, block_size)) fr.dirty = false;
+    else io_errors++;
+}
+
+// moves the least recently used unpinned frame of a resident list to the
+// matching ghost list; false if every frame in the list is pinned
+bool BlockCache::evict_from(Shard& s, uint8_t list) {
+    uint32_t n = s.lists[list].lru;
+    while (n != NONE && s.frames[s.nodes[n].frame].pins) n = s.nodes[n].prev;
+    if (n == NONE) return false;
+
+    write_back(s, n);
+    if (on_evict) on_evict(s.nodes[n].blk);
+    s.free_frames.push_back(s.nodes[n].frame);
+    s.nodes[n].frame = NONE;
+    unlink(s, n);
+    push_mru(s, n, list == T1 ? B1 : B2);
+    return true;
+}
+
+// ARC's REPLACE: evict from T1 while it is over its target p
+bool BlockCache::replace(Shard& s, bool ghost_in_b2) {
+    uint32_t t1 = s.lists[T1].size;
+    if (t1 > 0 && (t1 > s.p || (ghost_in_b2 && t1 == s.p)) && evict_from(s, T1)) return true;
+    return evict_from(s, T2) || evict_from(s, T1);
+}
+
+uint32_t BlockCache::take_frame(Shard& s) {
+    uint32_t f = s.free_frames.back();
+    s.free_frames.pop_back();
+    s.frames[f] = Frame{ 0, false, FRAME_IDLE };
+    return f;
+}
+
+void BlockCache::fill(uint32_t blk, uint8_t* ptr) {
+    if (!io->read(data_offset + (uint64_t)blk * block_size, ptr, block_size)) {
+        memset(ptr, 0, block_size);
+        io_errors++;
+    }
+}
+
+// tags carry the shard and frame, which stay put while the frame is pinned
+void BlockCache::start(Shard& s, uint32_t f, uint32_t blk, bool write) {
+    Frame& fr = s.frames[f];
+    fr.pins++;
+    fr.state = write ? FRAME_WRITING : FRAME_READING;
+    uint64_t tag = ((uint64_t)(&s - shards.data()) << 32) | f;
+    uint64_t off = data_offset + (uint64_t)blk * block_size;
+    if (write) io->queue_write(off, frame_ptr(s, f), block_size, tag);
+    else io->queue_read(off, frame_ptr(s, f), block_size, tag);
+}
+
+void BlockCache::complete(const IoDone& d) {
+    Shard& s = shards[d.tag >> 32];
+    uint32_t f = (uint32_t)d.tag;
+    Frame& fr = s.frames[f];
+    if (fr.state == FRAME_IDLE) return;
+    bool ok = d.result == (int32_t)block_size;
+    if (fr.state == FRAME_READING && !ok) memset(frame_ptr(s, f), 0, block_size);
+    if (fr.state == FRAME_WRITING && !ok) fr.dirty = true;     // try again at the next flush
+    if (!ok) io_errors++;
+    fr.state = FRAME_IDLE;
+    fr.pins--;
+}
+
+void BlockCache::poll() {
+    if (!io || !io->async()) return;
+    completions.clear();
+    io->reap(completions, 0);
+    for (const IoDone& d : completions) complete(d);
+}
+
+void BlockCache::wait_frame(Shard& s, uint32_t f) {
+    while (s.frames[f].state != FRAME_IDLE) {
+        io->submit();
+        completions.clear();
+        if (io->reap(completions, 1) == 0) {
+            // nothing left to wait for: the request was lost
+            complete(IoDone{ ((uint64_t)(&s - shards.data()) << 32) | f, -EIO });
+            return;
+        }
+        for (const IoDone& d : completions) complete(d);
+    }
+}
+
+void BlockCache::wait_all() {
+    io->submit();
+    while (io->outstanding()) {
+        completions.clear();
+        if (io->reap(completions, 1) == 0) break;
+        for (const IoDone& d : completions) complete(d);
+    }
+}
+
+// Pinned frames can bend the bookkeeping; make room regardless, once
+// frames held by requests in flight come back if need be.
+void BlockCache::make_room(Shard& s, bool ghost_in_b2) {
+    while (s.free_frames.empty() && !replace(s, ghost_in_b2) && io->outstanding()) {
+        completions.clear();
+        io->submit();
+        io->reap(completions, 1);
+        for (const IoDone& d : completions) complete(d);
+    }
+}
+
+uint32_t BlockCache::load(Shard& s, uint32_t blk) {
+    uint32_t f = take_frame(s);
+    fill(blk, frame_ptr(s, f));
+    return f;
+}
+
+// ARC's handling of a block in no list: makes room and returns a node at
+// the MRU end of T1 with a frame the caller fills
+uint32_t BlockCache::admit(Shard& s, uint32_t blk) {
+    uint32_t l1 = s.lists[T1].size + s.lists[B1].size;
+    uint32_t all = l1 + s.lists[T2].size + s.lists[B2].size;
+    if (l1 >= s.cap) {
+        if (s.lists[T1].size < s.cap) {
+            drop_node(s, s.lists[B1].lru);
+            if (s.free_frames.empty()) replace(s, false);
+        } else if (evict_from(s, T1)) {
+            drop_node(s, s.lists[B1].mru);      // B1 is empty here: T1 fills the cache
+        }
+    } else if (all >= s.cap) {
+        if (all >= 2 * s.cap) drop_node(s, s.lists[B2].lru);
+        if (s.free_frames.empty()) replace(s, false);
+    }
+    make_room(s, false);
+    while (s.free_nodes.empty())
+        drop_node(s, s.lists[B1].size ? s.lists[B1].lru : s.lists[B2].lru);
+
+    uint32_t n = s.free_nodes.back();
+    s.free_nodes.pop_back();
+    s.nodes[n].blk = blk;
+    s.nodes[n].frame = take_frame(s);
+    s.nodes[n].ahead = false;
+    push_mru(s, n, T1);
+    s.map.put(blk, n);
+    return n;
+}
+
+uint8_t* BlockCache::get(uint32_t blk) {
+    Shard& s = shard_of(blk);
+    uint32_t* found = s.map.find(blk);
+
+    if (found) {
+        uint32_t n = *found;
+        uint8_t list = s.nodes[n].list;
+        if (list == T1 || list == T2) {
+            // a block read ahead, or touched again before anything else in
+            // its shard, has not been used twice yet
+            bool again = list == T2 || (!s.nodes[n].ahead && s.lists[T1].mru != n);
+            hit_count++;
+            unlink(s, n);
+            push_mru(s, n, again ? T2 : T1);
+            s.nodes[n].ahead = false;
+            // the caller may write to the frame, so a write of it still in
+            // flight must finish first or the block on disk could be torn
+            if (s.frames[s.nodes[n].frame].state != FRAME_IDLE) wait_frame(s, s.nodes[n].frame);
+            return frame_ptr(s, s.nodes[n].frame);
+        }
+
+        // ghost hit: lean p towards the list that would have kept it
+        miss_count++;
+        uint32_t b1 = s.lists[B1].size, b2 = s.lists[B2].size;
+        if (list == B1) {
+            s.p = std::min(s.cap, s.p + std::max(b2 / b1, 1u));
+        } else {
+            uint32_t d = std::max(b1 / b2, 1u);
+            s.p = s.p > d ? s.p - d : 0;
+        }
+        unlink(s, n);
+        s.nodes[n].ahead = false;
+        make_room(s, list == B2);
+        s.nodes[n].frame = load(s, blk);
+        push_mru(s, n, T2);
+        return frame_ptr(s, s.nodes[n].frame);
+    }
+
+    miss_count++;
+    uint32_t n = admit(s, blk);
+    uint8_t* ptr = frame_ptr(s, s.nodes[n].frame);
+    fill(blk, ptr);
+    return ptr;
+}
+
+bool BlockCache::resident(uint32_t blk) {
+    Shard& s = shard_of(blk);
+    uint32_t* n = s.map.find(blk);
+    return n && s.nodes[*n].frame != NONE;
+}
+
+const uint8_t* BlockCache::peek(uint32_t blk) {
+    Shard& s = shard_of(blk);
+    uint32_t* n = s.map.find(blk);
+    if (!n || s.nodes[*n].frame == NONE) return nullptr;
+    if (s.frames[s.nodes[*n].frame].state == FRAME_READING) return nullptr;
+    return frame_ptr(s, s.nodes[*n].frame);
+}
+
+void BlockCache::prefetch(uint32_t first, uint32_t count) {
+    if (first >= block_count || count == 0) return;
+    count = std::min(count, block_count - first);
+
+    // asynchronous: one read per frame, submitted together and left in flight
+    if (io->async()) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t blk = first + i;
+            Shard& s = shard_of(blk);
+            uint32_t* found = s.map.find(blk);
+            if (found) {
+                if (s.nodes[*found].frame != NONE) continue;
+                drop_node(s, *found);
+            }
+            uint32_t n = admit(s, blk);
+            s.nodes[n].ahead = true;
+            start(s, s.nodes[n].frame, blk, false);
+            ahead_count++;
+        }
+        io->submit();
+        return;
+    }
+
+    // otherwise the whole run in one read, then copied into frames
+    uint8_t* run = run_space((size_t)count * block_size);
+    if (!io->read(data_offset + (uint64_t)first * block_size, run, (size_t)count * block_size))
+        return;     // get() retries the blocks one at a time
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t blk = first + i;
+        Shard& s = shard_of(blk);
+        uint32_t* found = s.map.find(blk);
+        if (found) {
+            if (s.nodes[*found].frame != NONE) continue;    // resident, maybe newer
+            drop_node(s, *found);
+        }
+        uint32_t n = admit(s, blk);
+        s.nodes[n].ahead = true;
+        memcpy(frame_ptr(s, s.nodes[n].frame), run + (size_t)i * block_size, block_size);
+        ahead_count++;
+    }
+}
+
+void BlockCache::read_uncached(uint32_t blk, uint8_t* out) {
+    Shard& s = shard_of(blk);
+    uint32_t* n = s.map.find(blk);
+    if (n && s.nodes[*n].frame != NONE) {
+        wait_frame(s, s.nodes[*n].frame);
+        memcpy(out, frame_ptr(s, s.nodes[*n].frame), block_size);
+        return;
+    }
+    if (io->direct() && (uintptr_t)out % io->direct_align()) {
+        uint8_t* b = run_space(block_size);
+        fill(blk, b);
+        memcpy(out, b, block_size);
+        return;
+    }
+    fill(blk, out);
+}
+
+void BlockCache::pin(uint32_t blk) {
+    Shard& s = shard_of(blk);
+    uint32_t* n = s.map.find(blk);
+    if (n && s.nodes[*n].frame != NONE) s.frames[s.nodes[*n].frame].pins++;
+}
+
+void BlockCache::unpin(uint32_t blk) {
+    Shard& s = shard_of(blk);
+    uint32_t* n = s.map.find(blk);
+    if (n && s.nodes[*n].frame != NONE && s.frames[s.nodes[*n].frame].pins)
+        s.frames[s.nodes[*n].frame].pins--;
+}
+
+void BlockCache::set_dirty(uint32_t blk) {
+    Shard& s = shard_of(blk);
+    uint32_t* n = s.map.find(blk);
+    if (n && s.nodes[*n].frame != NONE) s.frames[s.nodes[*n].frame].dirty = true;
+}
+
+void BlockCache::flush() {
+    // a block may still be on its way out from write_behind; its newer
+    // contents must not overtake it
+    wait_all();
+
+    std::vector<uint32_t> dirty;
+    for (Shard& s : shards)
+        for (List l : { s.lists[T1], s.lists[T2] })
+            for (uint32_t n = l.mru; n != NONE; n = s.nodes[n].next)
+                if (s.frames[s.nodes[n].frame].dirty) dirty.push_back(s.nodes[n].blk);
+    write_out(dirty);
+}
+
+void BlockCache::flush(const std::vector<uint32_t>& blocks) {
+    std::vector<uint32_t> dirty;
+    for (uint32_t b : blocks) {
+        Shard& s = shard_of(b);
+        uint32_t* n = s.map.find(b);
+        if (!n || s.nodes[*n].frame == NONE) continue;
+        uint32_t f = s.nodes[*n].frame;
+        if (s.frames[f].state != FRAME_IDLE) wait_frame(s, f);
+        if (s.frames[f].dirty) dirty.push_back(b);
+    }
+    write_out(dirty);
+}
+
+// Writes resident dirty blocks in disk order and waits for them.
+void BlockCache::write_out(std::vector<uint32_t>& dirty) {
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    if (!io->async()) {
+        for (uint32_t b : dirty) {
+            Shard& s = shard_of(b);
+            write_back(s, *s.map.find(b));
+        }
+        return;
+    }
+    for (uint32_t b : dirty) {
+        Shard& s = shard_of(b);
+        Node& nd = s.nodes[*s.map.find(b)];
+        if (before_write) before_write(b, frame_ptr(s, nd.frame));
+        s.frames[nd.frame].dirty = false;
+        start(s, nd.frame, b, true);
+    }
+    wait_all();
+}
+
+uint32_t BlockCache::write_behind(uint32_t max) {
+    if (!io->async()) return 0;
+    poll();
+    uint32_t started = 0;
+    // oldest first, as those are the next to be evicted; only the old end
+    // of each list is looked at, so a mostly clean cache costs little
+    for (Shard& s : shards) {
+        for (uint8_t list : { T1, T2 }) {
+            uint32_t looked = 0;
+            for (uint32_t n = s.lists[list].lru; n != NONE && started < max && looked++ < max;
+                 n = s.nodes[n].prev) {
+                Frame& fr = s.frames[s.nodes[n].frame];
+                if (!fr.dirty || fr.state != FRAME_IDLE) continue;
+                if (before_write) before_write(s.nodes[n].blk, frame_ptr(s, s.nodes[n].frame));
+                fr.dirty = false;
+                start(s, s.nodes[n].frame, s.nodes[n].blk, true);
+                started++;
+            }
+        }
+    }
+    io->submit();
+    return started;
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <functional>
+
+#include "FileIo.h"
+#include "../data_structures/HashTable.h"
+
+// Data-region blocks of the container, kept in a bounded set of frames and
+// read from / written back to the .omni file on demand. Blocks are spread
+// over shards by block number; each shard runs ARC (adaptive replacement:
+// recency list T1, frequency list T2 and their ghost lists B1, B2, with the
+// T1 target p moved by ghost hits).
+//
+// A pointer from get() stays valid until the next get() that misses, which
+// may evict it; pin() holds a frame across such calls (and across
+// prefetch()). Dirty frames are written when evicted or flushed, after the
+// before_write hook has seen them.
+//
+// With an asynchronous FileIo, read-ahead and write-behind are left in
+// flight: their frames stay pinned until poll() (or a get() that needs
+// one) sees the completion. get() of a frame in flight waits for it.
+class BlockCache {
+public:
+    std::function<void(uint32_t blk, const uint8_t* data)> before_write;
+    std::function<void(uint32_t blk)> on_evict;
+
+private:
+    enum : uint8_t { T1 = 0, T2 = 1, B1 = 2, B2 = 3 };
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Node {
+        uint32_t blk;
+        uint32_t prev, next;    // prev is towards the MRU end
+        uint32_t frame;         // NONE for ghosts
+        uint8_t list;
+        bool ahead;             // read ahead and not yet asked for
+    };
+    struct List {
+        uint32_t mru, lru, size;
+    };
+    enum : uint8_t { FRAME_IDLE = 0, FRAME_READING = 1, FRAME_WRITING = 2 };
+    struct Frame {
+        uint16_t pins;
+        bool dirty;
+        uint8_t state;          // a request for the frame is in flight
+    };
+    // frame memory is aligned for O_DIRECT (see FileIo)
+    struct AlignedFree {
+        void operator()(uint8_t* p) const { free(p); }
+    };
+    typedef std::unique_ptr<uint8_t, AlignedFree> AlignedBuf;
+    static AlignedBuf aligned_buf(size_t n);
+
+    struct Shard {
+        uint32_t cap;
+        uint32_t p;
+        std::vector<Node> nodes;
+        std::vector<uint32_t> free_nodes;
+        List lists[4];
+        HashTable<uint32_t, uint32_t> map;      // block -> node
+        AlignedBuf mem;
+        std::vector<Frame> frames;
+        std::vector<uint32_t> free_frames;
+    };
+
+    FileIo* io;
+    uint64_t data_offset;
+    uint32_t block_size;
+    uint32_t block_count;
+    std::vector<Shard> shards;
+    uint64_t hit_count;
+    uint64_t miss_count;
+    uint64_t io_errors;
+    uint64_t ahead_count;
+    AlignedBuf run_buf;                 // read-ahead runs and unaligned reads
+    size_t run_cap;
+    std::vector<IoDone> completions;
+
+    Shard& shard_of(uint32_t blk) { return shards[blk % shards.size()]; }
+    uint8_t* frame_ptr(Shard& s, uint32_t f) { return s.mem.get() + (uint64_t)f * block_size; }
+
+    void unlink(Shard& s, uint32_t n);
+    void push_mru(Shard& s, uint32_t n, uint8_t list);
+    void drop_node(Shard& s, uint32_t n);
+    bool evict_from(Shard& s, uint8_t list);
+    bool replace(Shard& s, bool ghost_in_b2);
+    void make_room(Shard& s, bool ghost_in_b2);
+    uint32_t admit(Shard& s, uint32_t blk);
+    uint32_t take_frame(Shard& s);
+    void fill(uint32_t blk, uint8_t* ptr);
+    void start(Shard& s, uint32_t f, uint32_t blk, bool write);
+    void complete(const IoDone& d);
+    void wait_frame(Shard& s, uint32_t f);
+    void wait_all();
+    uint32_t load(Shard& s, uint32_t blk);
+    uint8_t* run_space(size_t n);
+    void write_back(Shard& s, uint32_t n);
+    void write_out(std::vector<uint32_t>& dirty);
+
+public:
+    // fewest frames a shard gets; multi-block operations pin at most two
+    static const uint32_t MIN_SHARD_FRAMES = 8;
+    static const uint32_t MAX_SHARDS = 16;
+
+    BlockCache() {
+        io = nullptr;
+        data_offset = 0;
+        block_size = 0;
+        block_count = 0;
+        hit_count = 0;
+        miss_count = 0;
+        io_errors = 0;
+        ahead_count = 0;
+        run_cap = 0;
+    }
+
+    // budget_bytes of 0 caches the whole data region
+    void init(FileIo* file, uint64_t data_off, uint32_t blk_size, uint32_t blk_count,
+              uint64_t budget_bytes);
+
+    // the block's frame, loaded on a miss; a failed read leaves it zeroed
+    uint8_t* get(uint32_t blk);
+    bool resident(uint32_t blk);
+    // the resident frame, or null; unlike get() it does not count as a use
+    const uint8_t* peek(uint32_t blk);
+    // Reads blocks [first, first+count) with one request and caches those
+    // not already resident. They enter as a single recent use, and the
+    // first get() of each is not counted as a repeat, so a read-ahead scan
+    // cannot push the frequently used set out.
+    void prefetch(uint32_t first, uint32_t count);
+    // most blocks worth reading ahead at once: more would start evicting
+    // the read-ahead itself before it is used
+    uint32_t prefetch_limit() const { return capacity() / 4; }
+    // copies the block without caching it (scrubbing must not evict the
+    // working set)
+    void read_uncached(uint32_t blk, uint8_t* out);
+
+    void pin(uint32_t blk);
+    void unpin(uint32_t blk);
+    void set_dirty(uint32_t blk);
+
+    // writes every dirty frame, in block order, and waits for the writes
+    void flush();
+    // the same for just these blocks; others stay dirty
+    void flush(const std::vector<uint32_t>& blocks);
+    // starts writing up to max dirty frames without waiting (asynchronous
+    // I/O only); returns how many
+    uint32_t write_behind(uint32_t max);
+    // takes whatever completions have arrived, without waiting
+    void poll();
+    bool idle() const { return !io || io->outstanding() == 0; }
+
+    uint32_t capacity() const;
+    uint64_t hits() const { return hit_count; }
+    uint64_t misses() const { return miss_count; }
+    uint64_t failed_io() const { return io_errors; }    // reads and writes
+    uint64_t read_ahead() const { return ahead_count; }
+};
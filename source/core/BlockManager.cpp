@@ -1,67 +1,165 @@
 #include "BlockManager.h"
 #include <iostream>
+#include <algorithm>
 
-bool BlockManager::init(void* file, uint64_t data_off,
+bool BlockManager::init(BlockCache* block_cache, uint64_t data_off,
                         uint32_t blk_size, uint32_t blk_count,
                         FreeSpaceManager* free_mgr)
 {
-    base = file;
+    cache = block_cache;
     data_offset = data_off;
     block_size = blk_size;
     block_count = blk_count;
     fsm = free_mgr;
+
+    dirty.assign((blk_count + 7) / 8, 0);
+    dirty_list.clear();
+    checked.assign((blk_count + 7) / 8, 0);
+    sums = nullptr;
+    verify_mode = VERIFY_OFF;
+    scrub_cursor = 0;
+    verify_failures = 0;
+
+    // sums follow the bytes that reach the disk; a block read back in is
+    // checked again
+    cache->before_write = [this](uint32_t blk, const uint8_t* data) {
+        if (sums) set_sum(blk, crc32c(data, block_size));
+    };
+    cache->on_evict = [this](uint32_t blk) {
+        checked[blk >> 3] &= (uint8_t)~(1u << (blk & 7));
+    };
     return true;
 }
 
-inline uint8_t* block_ptr(void* base, uint64_t data_off,
-                          uint32_t block_size, uint32_t blk)
-{
-    return ((uint8_t*)base) + data_off + blk * block_size;
+void BlockManager::set_checksums(uint8_t* sum_array, uint32_t mode, uint32_t sample) {
+    sums = sum_array;
+    verify_mode = sums ? mode : VERIFY_OFF;
+    verify_sample = sample ? sample : 1;
+    sample_tick = 0;
+}
+
+// caller buffer <-> block payload
+static inline void copy_in(const SecurityManager* codec, uint8_t* dst, const uint8_t* src, uint64_t n) {
+    if (codec) codec->encode_copy(dst, src, n);
+    else memcpy(dst, src, n);
+}
+
+static inline void copy_out(const SecurityManager* codec, uint8_t* dst, const uint8_t* src, uint64_t n) {
+    if (codec) codec->decode_copy(dst, src, n);
+    else memcpy(dst, src, n);
+}
+
+void BlockManager::mark_dirty(uint32_t blk) {
+    if (dedup) dedup->unindex(blk);
+    cache->set_dirty(blk);
+    uint8_t bit = (uint8_t)(1u << (blk & 7));
+    if (dirty[blk >> 3] & bit) return;
+    dirty[blk >> 3] |= bit;
+    dirty_list.push_back(blk);
+    // memory is now the reference copy; the sum follows at write-back
+    checked[blk >> 3] |= bit;
+}
+
+bool BlockManager::verify_block(uint32_t blk) {
+    if (!sums || is_checked(blk)) return true;
+    if (crc32c(cache->get(blk), block_size) != block_sum(blk)) {
+        verify_failures++;
+        return false;
+    }
+    set_checked(blk);
+    return true;
+}
+
+bool BlockManager::check_read(uint32_t blk) {
+    switch (verify_mode) {
+    case VERIFY_ALWAYS:
+        return verify_block(blk);
+    case VERIFY_SAMPLED:
+        if (is_checked(blk) || ++sample_tick % verify_sample != 0) return true;
+        return verify_block(blk);
+    default:
+        return true;
+    }
+}
+
+uint32_t BlockManager::scrub(uint32_t max_blocks) {
+    if (!sums || block_count == 0) return 0;
+    uint32_t bad = 0;
+    std::vector<uint8_t> buf(block_size);
+    for (uint32_t n = 0; n < max_blocks && n < block_count; n++) {
+        uint32_t blk = scrub_cursor;
+        scrub_cursor = (scrub_cursor + 1) % block_count;
+        if (!fsm->is_used(blk)) continue;
+        if (cache->resident(blk)) {
+            if (!verify_block(blk)) bad++;
+            continue;
+        }
+        // read past the cache so the scan does not displace the working set
+        cache->read_uncached(blk, buf.data());
+        if (crc32c(buf.data(), block_size) != block_sum(blk)) {
+            verify_failures++;
+            bad++;
+        }
+    }
+    return bad;
+}
+
+void BlockManager::take_dirty(std::vector<uint32_t>& out) {
+    out.clear();
+    out.swap(dirty_list);
+    for (uint32_t b : out) dirty[b >> 3] &= (uint8_t)~(1u << (b & 7));
 }
 
 int BlockManager::allocate_block() {
     int blk = fsm->allocate_block();
     if (blk < 0) return -1;
 
-    uint8_t* ptr = block_ptr(base, data_offset, block_size, blk);
-    memset(ptr, 0, block_size);
+    // payload holds encoded zeros, so unwritten gaps read back as zeros
+    uint8_t* ptr = cache->get(blk);
+    memset(ptr + 4, codec ? codec->table()[0] : 0, block_size - 4);
 
     // mark chain end
     *(uint32_t*)ptr = 0xFFFFFFFF;
+    mark_dirty(blk);
     return blk;
 }
 
 void BlockManager::free_block_chain(uint32_t start) {
+    std::vector<uint32_t> gone;
+    unlink_chain(start, gone);
+    for (uint32_t b : gone) fsm->free_block(b);
+}
+
+// a shared block keeps everything after it alive, so the walk stops there
+void BlockManager::unlink_chain(uint32_t start, std::vector<uint32_t>& out) {
     uint32_t blk = start;
-    while (blk != 0xFFFFFFFF) {
-        uint32_t next = get_next(blk);
-        fsm->free_block(blk);
-        blk = next;
+    while (blk != 0xFFFFFFFF && blk < block_count) {
+        if (dedup && !dedup->drop(blk)) return;
+        out.push_back(blk);
+        blk = get_next(blk);
     }
 }
 
 bool BlockManager::read_block(uint32_t blk, void* out) {
     if (blk >= block_count) return false;
-    uint8_t* ptr = block_ptr(base, data_offset, block_size, blk);
-    memcpy(out, ptr, block_size);
+    memcpy(out, cache->get(blk), block_size);
     return true;
 }
 
 bool BlockManager::write_block(uint32_t blk, const void* in) {
     if (blk >= block_count) return false;
-    uint8_t* ptr = block_ptr(base, data_offset, block_size, blk);
-    memcpy(ptr, in, block_size);
+    memcpy(cache->get(blk), in, block_size);
+    mark_dirty(blk);
     return true;
 }
 
 uint32_t BlockManager::get_next(uint32_t blk) {
-    uint8_t* ptr = block_ptr(base, data_offset, block_size, blk);
-    return *(uint32_t*)ptr;
+    return *(uint32_t*)cache->get(blk);
 }
 
 void BlockManager::set_next(uint32_t blk, uint32_t next) {
-    uint8_t* ptr = block_ptr(base, data_offset, block_size, blk);
-    *(uint32_t*)ptr = next;
+    *(uint32_t*)cache->get(blk) = next;
+    mark_dirty(blk);
 }
 
 int BlockManager::write_file(uint32_t start, uint64_t off,
@@ -74,8 +172,10 @@ int BlockManager::write_file(uint32_t start, uint64_t off,
     uint32_t header = 4;
     uint32_t usable = block_size - header;
 
-    // skip blocks until the correct block
+    // skip blocks until the correct block; a block is checked before its
+    // next pointer is trusted or its old bytes are kept
     while (pos >= usable) {
+        if (blk >= block_count || !check_read(blk)) return -1;
         pos -= usable;
         uint32_t next = get_next(blk);
         if (next == 0xFFFFFFFF) {
@@ -90,10 +190,12 @@ int BlockManager::write_file(uint32_t start, uint64_t off,
     }
 
     while (remaining > 0) {
-        uint8_t* ptr = block_ptr(base, data_offset, block_size, blk);
+        if (blk >= block_count || !check_read(blk)) return -1;
+        uint8_t* ptr = cache->get(blk);
 
         uint64_t write_here = std::min<uint64_t>(usable - pos, remaining);
-        memcpy(ptr + 4 + pos, data, write_here);
+        copy_in(codec, ptr + 4 + pos, data, write_here);
+        mark_dirty(blk);
 
         data += write_here;
         remaining -= write_here;
@@ -117,7 +219,7 @@ int BlockManager::write_file(uint32_t start, uint64_t off,
 }
 
 int BlockManager::read_file(uint32_t start, uint64_t off,
-                            uint8_t* out, uint64_t len)
+                            uint8_t* out, uint64_t len, ReadAhead* ra)
 {
     uint64_t pos = off;
     uint64_t remaining = len;
@@ -126,18 +228,48 @@ int BlockManager::read_file(uint32_t start, uint64_t off,
     uint32_t header = 4;
     uint32_t usable = block_size - header;
 
+    uint32_t window = 0;
+    if (ra) {
+        if (off == ra->next_off)
+            window = !ra->window ? MIN_READAHEAD :
+                     ra->window * 2 < MAX_READAHEAD ? ra->window * 2 : MAX_READAHEAD;
+        else
+            ra->ahead_off = 0;
+        ra->window = window;
+        // resume the walk where the last read ended
+        if (ra->blk != 0xFFFFFFFF && off >= ra->blk_off) {
+            blk = ra->blk;
+            pos = off - ra->blk_off;
+        }
+    }
+    uint64_t base = off - pos;      // file offset of blk's payload
+
+    // blocks from blk to the end of the read, plus the window
+    auto fetch = [&]() {
+        if (cache->resident(blk)) return;
+        uint64_t span = (pos + remaining + usable - 1) / usable;
+        uint32_t walked = prefetch_chain(blk, (uint32_t)std::min<uint64_t>(span + window, 0xFFFFFFFF));
+        if (ra) ra->ahead_off = std::max(ra->ahead_off, base + (uint64_t)walked * usable);
+    };
+
     // skip blocks
     while (pos >= usable) {
+        fetch();
+        if (!check_read(blk)) return -1;
         pos -= usable;
+        base += usable;
         blk = get_next(blk);
-        if (blk == 0xFFFFFFFF) return -1;
+        if (blk >= block_count) return -1;
     }
 
     while (remaining > 0) {
-        uint8_t* ptr = block_ptr(base, data_offset, block_size, blk);
+        if (blk >= block_count) return -1;
+        fetch();
+        if (!check_read(blk)) return -1;
+        uint8_t* ptr = cache->get(blk);
 
         uint64_t read_here = std::min<uint64_t>(usable - pos, remaining);
-        memcpy(out, ptr + 4 + pos, read_here);
+        copy_out(codec, out, ptr + 4 + pos, read_here);
 
         out += read_here;
         remaining -= read_here;
@@ -146,9 +278,190 @@ int BlockManager::read_file(uint32_t start, uint64_t off,
 
         if (remaining > 0) {
             blk = get_next(blk);
-            if (blk == 0xFFFFFFFF) return -1;
+            base += usable;
+            if (blk >= block_count) return -1;
+        }
+    }
+
+    if (ra) {
+        ra->next_off = off + len;
+        ra->blk = blk;
+        ra->blk_off = base;
+        // top up once the reader is half way through what was read ahead
+        if (window && ra->ahead_off < off + len + (uint64_t)window * usable / 2)
+            ra->ahead_off = base + (uint64_t)prefetch_chain(blk, window + 1) * usable;
+    }
+    return 1;
+}
+
+uint32_t BlockManager::prefetch_chain(uint32_t blk, uint32_t count) {
+    count = std::min(count, cache->prefetch_limit());
+    uint32_t done = 0;
+    while (done < count && blk < block_count) {
+        const uint8_t* p = cache->peek(blk);
+        if (!p) {
+            uint32_t run = 1;
+            if (!cache->resident(blk)) {
+                while (run < count - done && blk + run < block_count && fsm->is_used(blk + run) &&
+                       !cache->resident(blk + run))
+                    run++;
+                cache->prefetch(blk, run);
+                p = cache->peek(blk);
+            }
+            // still in flight: assume the chain runs on through the batch
+            // rather than wait here; a wrong guess is a later miss
+            if (!p) return done + run;
+        }
+        done++;
+        blk = *(const uint32_t*)p;
+    }
+    return done;
+}
+
+int BlockManager::read_at(uint32_t blk, uint32_t off, uint8_t* out, uint32_t len) {
+    if (blk >= block_count || off + len > block_size - 4 || !check_read(blk)) return -1;
+    copy_out(codec, out, cache->get(blk) + 4 + off, len);
+    return 1;
+}
+
+int BlockManager::copy_payload(uint32_t dst, uint32_t dst_off,
+                               uint32_t src, uint32_t src_off, uint32_t len)
+{
+    uint32_t usable = block_size - 4;
+    if (dst >= block_count || src >= block_count) return -1;
+    if (dst_off + len > usable || src_off + len > usable) return -1;
+    if (!check_read(src)) return -1;
+    uint8_t* from = cache->get(src);
+    cache->pin(src);
+    memmove(cache->get(dst) + 4 + dst_off, from + 4 + src_off, len);
+    cache->unpin(src);
+    mark_dirty(dst);
+    return 1;
+}
+
+int BlockManager::write_dedup(const uint8_t* data, uint64_t len, uint32_t& start) {
+    uint32_t usable = block_size - 4;
+    uint64_t count = len ? (len + usable - 1) / usable : 1;
+    std::vector<uint8_t> img(block_size);
+
+    // `next` is the chain built so far; a new block holds a reference to
+    // it, an existing one already does
+    uint32_t next = 0xFFFFFFFF;
+    bool next_new = false;
+    for (uint64_t k = count; k-- > 0;) {
+        uint64_t beg = k * usable;
+        uint64_t n = std::min<uint64_t>(usable, len - beg);
+        memcpy(img.data(), &next, 4);
+        copy_in(codec, img.data() + 4, data + beg, n);
+        memset(img.data() + 4 + n, codec ? codec->table()[0] : 0, usable - n);
+        Fingerprint fp = DedupIndex::fingerprint(img.data(), block_size);
+
+        int blk = dedup->find(fp);
+        if (blk >= 0 && fsm->is_used(blk) && check_read(blk) &&
+            memcmp(cache->get(blk), img.data(), block_size) == 0) {
+            dedup->note_hit();
+            next = blk;
+            next_new = false;
+            continue;
+        }
+
+        blk = allocate_block();
+        if (blk < 0) {
+            if (next_new) free_block_chain(next);
+            return -1;
+        }
+        memcpy(cache->get(blk), img.data(), block_size);
+        mark_dirty(blk);
+        dedup->set_owned(blk);
+        dedup->insert(blk, fp);
+        if (next != 0xFFFFFFFF && !next_new) dedup->share(next);
+        next = blk;
+        next_new = true;
+    }
+
+    if (!next_new) dedup->share(next);
+    start = next;
+    return 1;
+}
+
+bool BlockManager::chain_shared(uint32_t start, uint64_t off, uint64_t len) {
+    if (!dedup) return false;
+    uint32_t usable = block_size - 4;
+    uint64_t last = (len > 0) ? (off + len - 1) / usable : off / usable;
+    uint32_t blk = start;
+    for (uint64_t i = 0; i <= last && blk != 0xFFFFFFFF && blk < block_count; i++) {
+        if (dedup->refs_of(blk) > 1) return true;
+        blk = get_next(blk);
+    }
+    return false;
+}
+
+void BlockManager::count_refs(uint32_t start) {
+    uint32_t blk = start;
+    while (blk != 0xFFFFFFFF && blk < block_count && dedup->count_ref(blk)) {
+        if (!cache->resident(blk)) prefetch_chain(blk, cache->prefetch_limit());
+        blk = get_next(blk);
+    }
+}
+
+int BlockManager::cow_write_file(uint32_t start, uint64_t off,
+                                 const uint8_t* data, uint64_t len,
+                                 uint32_t& new_start,
+                                 std::vector<uint32_t>& replaced)
+{
+    uint32_t usable = block_size - 4;
+
+    // last logical block whose payload or next pointer changes
+    uint64_t last = (len > 0) ? (off + len - 1) / usable : off / usable;
+
+    std::vector<uint32_t> fresh;
+    uint32_t old_blk = start;
+    uint32_t prev = 0xFFFFFFFF;
+    uint64_t pos = 0;           // logical byte offset of block i
+
+    for (uint64_t i = 0; i <= last; i++) {
+        int nb = allocate_block();
+        if (nb < 0) {
+            for (uint32_t b : fresh) fsm->free_block(b);
+            return -1;
+        }
+        fresh.push_back(nb);
+
+        if (old_blk != 0xFFFFFFFF && (old_blk >= block_count || !check_read(old_blk))) {
+            for (uint32_t b : fresh) fsm->free_block(b);
+            return -1;
+        }
+        uint8_t* dst;
+        if (old_blk != 0xFFFFFFFF) {
+            uint8_t* src = cache->get(old_blk);
+            cache->pin(old_blk);
+            dst = cache->get(nb);
+            memcpy(dst + 4, src + 4, usable);
+            cache->unpin(old_blk);
+        } else {
+            dst = cache->get(nb);
+        }
+
+        // overlay the part of [off, off+len) that lands in this block
+        uint64_t lo = std::max<uint64_t>(off, pos);
+        uint64_t hi = std::min<uint64_t>(off + len, pos + usable);
+        if (lo < hi)
+            copy_in(codec, dst + 4 + (lo - pos), data + (lo - off), hi - lo);
+        mark_dirty(nb);
+
+        if (prev == 0xFFFFFFFF) new_start = nb;
+        else set_next(prev, nb);
+        prev = nb;
+
+        if (old_blk != 0xFFFFFFFF) {
+            replaced.push_back(old_blk);
+            old_blk = get_next(old_blk);
         }
+        pos += usable;
     }
 
+    // share the untouched remainder of the old chain
+    set_next(prev, old_blk);
+    if (dedup && old_blk != 0xFFFFFFFF) dedup->share(old_blk);
     return 1;
 }
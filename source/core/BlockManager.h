@@ -4,31 +4,117 @@
 #include <cstring>
 
 #include "FreeSpaceManager.h"
+#include "SecurityManager.h"
+#include "DedupIndex.h"
+#include "BlockCache.h"
+#include "crc32c.h"
+
+// Sequential-read state of one open handle. A read that starts where the
+// previous one ended grows the window of blocks kept resident ahead of the
+// reader; any other read closes it. The walk resumes from the block the
+// last read ended in, which stays valid while the handle pins its chain.
+struct ReadAhead {
+    uint64_t next_off;      // where a sequential read would start
+    uint32_t blk;           // block the last read ended in, or 0xFFFFFFFF
+    uint64_t blk_off;       // file offset of that block's first payload byte
+    uint32_t window;        // blocks; 0 while access is not sequential
+    uint64_t ahead_off;     // file offset up to which blocks were read ahead
+
+    ReadAhead() {
+        next_off = 0;
+        blk = 0xFFFFFFFF;
+        blk_off = 0;
+        window = 0;
+        ahead_off = 0;
+    }
+};
 
 class BlockManager {
+public:
+    static const uint32_t MIN_READAHEAD = 8;
+    static const uint32_t MAX_READAHEAD = 256;
+
 private:
-    void* base;
+    BlockCache* cache;              // every access to block bytes goes through it
     uint64_t data_offset;
     uint32_t block_size;
     uint32_t block_count;
 
     FreeSpaceManager* fsm;
+    const SecurityManager* codec;   // content encoding, applied on copy
+    DedupIndex* dedup;              // reference counts; null on older containers
+
+    // blocks changed since the last sync (their sums and fingerprints are
+    // written then; the cache writes the blocks themselves)
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> dirty_list;
+
+    // CRC32C of each whole block, kept in a parallel array so payloads stay
+    // aligned. Sums are brought up to date as the cache writes dirty blocks
+    // back. `checked` marks blocks whose cached copy is known good: verified
+    // since it was loaded, or written by us. The array follows the free map
+    // on disk, so entries are copied in and out rather than dereferenced.
+    uint8_t* sums;
+    std::vector<uint8_t> checked;
+    uint32_t verify_mode;
+    uint32_t verify_sample;
+    uint32_t sample_tick;
+    uint32_t scrub_cursor;
+    uint64_t verify_failures;
+
+    void mark_dirty(uint32_t blk);
+    bool is_checked(uint32_t blk) const { return checked[blk >> 3] & (1u << (blk & 7)); }
+    void set_checked(uint32_t blk) { checked[blk >> 3] |= (uint8_t)(1u << (blk & 7)); }
+    void set_sum(uint32_t blk, uint32_t sum) { memcpy(sums + (size_t)blk * 4, &sum, 4); }
 
 public:
     BlockManager() {
-        base = nullptr;
+        cache = nullptr;
         data_offset = 0;
         block_size = 0;
         block_count = 0;
         fsm = nullptr;
+        codec = nullptr;
+        dedup = nullptr;
+        sums = nullptr;
+        verify_mode = VERIFY_OFF;
+        verify_sample = 1;
+        sample_tick = 0;
+        scrub_cursor = 0;
+        verify_failures = 0;
     }
 
-    bool init(void* file, uint64_t data_off, uint32_t blk_size, uint32_t blk_count,
+    bool init(BlockCache* block_cache, uint64_t data_off, uint32_t blk_size, uint32_t blk_count,
               FreeSpaceManager* free_mgr);
 
+    // Payload bytes copied between caller buffers and blocks go through the
+    // codec; block-to-block copies stay encoded. nullptr stores plaintext.
+    void set_codec(const SecurityManager* c) { codec = c; }
+
+    // With reference counts, chains may share blocks: frees go through the
+    // counts and a modified block leaves the fingerprint index.
+    void set_dedup(DedupIndex* d) { dedup = d; }
+    bool refcounted() const { return dedup != nullptr; }
+
+    // sum_array is null for containers without checksums
+    void set_checksums(uint8_t* sum_array, uint32_t mode, uint32_t sample);
+    bool has_checksums() const { return sums != nullptr; }
+
+    // compares the block with its stored sum (once; later calls hit `checked`)
+    bool verify_block(uint32_t blk);
+    // the per-read check, as configured by verify_mode
+    bool check_read(uint32_t blk);
+    // verifies up to max_blocks allocated blocks, resuming where the last
+    // call stopped; returns the number that failed
+    uint32_t scrub(uint32_t max_blocks);
+    uint64_t failures() const { return verify_failures; }
+
     // block operations
     int allocate_block();
+    // drops the chain's reference, freeing blocks nothing else references
     void free_block_chain(uint32_t start);
+    // the same, collecting the unreferenced blocks instead of freeing them
+    void unlink_chain(uint32_t start, std::vector<uint32_t>& out);
 
     // read/write block
     bool read_block(uint32_t blk, void* out);
@@ -40,5 +126,48 @@ public:
 
     // read/write file content
     int write_file(uint32_t start, uint64_t offset, const uint8_t* data, uint64_t len);
-    int read_file(uint32_t start, uint64_t offset, uint8_t* out, uint64_t len);
+    // every non-resident block the read needs is fetched together with the
+    // rest of the range (and with ra, the window beyond it)
+    int read_file(uint32_t start, uint64_t offset, uint8_t* out, uint64_t len,
+                  ReadAhead* ra = nullptr);
+
+    // Makes up to count chain blocks from blk on resident and returns how
+    // many it walked (counting a batch still being read as walked). Chains are mostly allocated in block order, so each
+    // miss is read together with the allocated blocks that follow it, and
+    // the walk then follows the pointers to find where the chain really goes.
+    uint32_t prefetch_chain(uint32_t blk, uint32_t count);
+
+    // copy-on-write variant of write_file: every block from the head of the
+    // chain up to the last one touched is copied into a fresh block, the
+    // untouched tail is shared. The old chain stays intact for readers.
+    int cow_write_file(uint32_t start, uint64_t offset, const uint8_t* data, uint64_t len,
+                       uint32_t& new_start, std::vector<uint32_t>& replaced);
+
+    // byte ranges inside one block's payload, for packed tails: read_at
+    // decodes, copy_payload moves already-encoded bytes between blocks
+    int read_at(uint32_t blk, uint32_t off, uint8_t* out, uint32_t len);
+    int copy_payload(uint32_t dst, uint32_t dst_off, uint32_t src, uint32_t src_off, uint32_t len);
+
+    // Content-addressed chain, built back to front so each block's next
+    // pointer is known before it is fingerprinted; indexed blocks with the
+    // same bytes are shared instead of written.
+    int write_dedup(const uint8_t* data, uint64_t len, uint32_t& start);
+    // true if a block a write of [off, off+len) would modify, or one before
+    // it, is referenced more than once; such writes must copy
+    bool chain_shared(uint32_t start, uint64_t off, uint64_t len);
+    // mount: adds the chain's references to the counts
+    void count_refs(uint32_t start);
+    // one more reference to the whole chain: a write to any of it then copies
+    void share_chain(uint32_t start) { if (dedup) dedup->share(start); }
+    bool indexed(uint32_t blk) const { return dedup && dedup->indexed(blk); }
+
+    // write-back support
+    void take_dirty(std::vector<uint32_t>& out);
+    uint64_t block_offset(uint32_t blk) const { return data_offset + (uint64_t)blk * block_size; }
+    uint32_t block_sum(uint32_t blk) const {
+        uint32_t sum;
+        memcpy(&sum, sums + (size_t)blk * 4, 4);
+        return sum;
+    }
+    uint32_t payload_size() const { return block_size - 4; }
 };
@@ -0,0 +1,63 @@
+#include "DedupIndex.h"
+
+void DedupIndex::init(uint8_t* fp_array, uint32_t blocks) {
+    fps = fp_array;
+    block_count = blocks;
+    refs.assign(blocks, 0);
+    index.clear();
+    hits = 0;
+}
+
+Fingerprint DedupIndex::fingerprint(const void* block, size_t n) {
+    uint64_t h[2];
+    hash128(block, n, 0, h);
+    Fingerprint fp;
+    fp.lo = h[0];
+    fp.hi = h[1] ? h[1] : 1;       // never the empty value
+    return fp;
+}
+
+bool DedupIndex::count_ref(uint32_t blk) {
+    return ++refs[blk] == 1;
+}
+
+void DedupIndex::rebuild_index() {
+    for (uint32_t b = 0; b < block_count; b++) {
+        Fingerprint fp = fp_at(b);
+        if (fp.empty()) continue;
+        // unreferenced: freed since its fingerprint was last written
+        if (refs[b] == 0) {
+            set_fp(b, Fingerprint());
+            continue;
+        }
+        index.put(fp, b);
+    }
+}
+
+bool DedupIndex::drop(uint32_t blk) {
+    if (refs[blk] > 1) {
+        refs[blk]--;
+        return false;
+    }
+    refs[blk] = 0;
+    unindex(blk);
+    return true;
+}
+
+int DedupIndex::find(const Fingerprint& fp) const {
+    const uint32_t* b = index.find(fp);
+    return b ? (int)*b : -1;
+}
+
+void DedupIndex::insert(uint32_t blk, const Fingerprint& fp) {
+    set_fp(blk, fp);
+    index.put(fp, blk);
+}
+
+void DedupIndex::unindex(uint32_t blk) {
+    Fingerprint fp = fp_at(blk);
+    if (fp.empty()) return;
+    const uint32_t* cur = index.find(fp);
+    if (cur && *cur == blk) index.erase(fp);
+    set_fp(blk, Fingerprint());
+}
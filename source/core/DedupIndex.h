@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <cstring>
+
+#include "hash128.h"
+#include "../data_structures/HashTable.h"
+
+// 128-bit hash of a whole stored block: next pointer and encoded payload
+struct Fingerprint {
+    uint64_t lo;
+    uint64_t hi;
+
+    bool empty() const { return lo == 0 && hi == 0; }
+    bool operator<(const Fingerprint& o) const { return lo != o.lo ? lo < o.lo : hi < o.hi; }
+};
+
+struct FingerprintHash {
+    unsigned long long operator()(const Fingerprint& f) const { return f.lo; }
+};
+
+// Reference counts and the fingerprint -> block index for shared blocks.
+// A fingerprint covers the next pointer, so only identical chain suffixes
+// are shared and a block can only be matched while everything after it
+// still is. Fingerprints persist in a per-block array (zero = not indexed);
+// counts and the in-memory index are rebuilt at mount. A count of 0 means
+// the block is untracked and has a single owner.
+class DedupIndex {
+private:
+    uint8_t* fps;           // follows the sums on disk, so not 8-byte aligned
+    std::vector<uint32_t> refs;
+    HashTable<Fingerprint, uint32_t, FingerprintHash> index;
+    uint32_t block_count;
+    uint64_t hits;
+
+    Fingerprint fp_at(uint32_t blk) const {
+        Fingerprint fp;
+        memcpy(&fp, fps + (size_t)blk * sizeof(Fingerprint), sizeof(fp));
+        return fp;
+    }
+    void set_fp(uint32_t blk, const Fingerprint& fp) {
+        memcpy(fps + (size_t)blk * sizeof(Fingerprint), &fp, sizeof(fp));
+    }
+
+public:
+    DedupIndex() {
+        fps = nullptr;
+        block_count = 0;
+        hits = 0;
+    }
+
+    void init(uint8_t* fp_array, uint32_t blocks);
+    static Fingerprint fingerprint(const void* block, size_t n);
+
+    // mount: counts one reference, true on the first so the walk continues
+    bool count_ref(uint32_t blk);
+    // mount: indexes the referenced blocks whose fingerprint is set
+    void rebuild_index();
+
+    uint32_t refs_of(uint32_t blk) const { return refs[blk]; }
+    void share(uint32_t blk) { refs[blk] = (refs[blk] ? refs[blk] : 1) + 1; }
+    // drops one reference; true when none are left and the block may go
+    bool drop(uint32_t blk);
+    void set_owned(uint32_t blk) { refs[blk] = 1; }
+
+    int find(const Fingerprint& fp) const;
+    void insert(uint32_t blk, const Fingerprint& fp);
+    void unindex(uint32_t blk);
+    bool indexed(uint32_t blk) const { return !fp_at(blk).empty(); }
+
+    void note_hit() { hits++; }
+    uint64_t hit_count() const { return hits; }
+};
@@ -0,0 +1,98 @@
+#include "DeltaVault.h"
+#include <cstring>
+
+void DeltaVault::stamp(VaultRecord& r) const {
+    r.crc = 0;
+    if (checksums) r.crc = crc32c(&r, sizeof(r));
+}
+
+uint32_t DeltaVault::init(VaultRecord* records, uint32_t count, bool checksums_on) {
+    table = records;
+    slots = count;
+    checksums = checksums_on;
+    next_seq = 1;
+    free_slots.clear();
+    by_seq.clear();
+    by_inode.clear();
+
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < slots; i++) {
+        VaultRecord& r = table[i];
+        if (r.inode != 0 && checksums) {
+            VaultRecord c = r;
+            c.crc = 0;
+            if (crc32c(&c, sizeof(c)) != r.crc) {
+                memset(&r, 0, sizeof(r));
+                bad++;
+            }
+        }
+        if (r.inode == 0) {
+            free_slots.push_back(i);
+            continue;
+        }
+        by_seq[r.seq] = i;
+        if (r.seq >= next_seq) next_seq = r.seq + 1;
+    }
+
+    // in seq order, so each inode's list comes out oldest first
+    for (auto& s : by_seq) by_inode[table[s.second].inode].push_back(s.second);
+
+    // low slots are handed out first
+    std::vector<uint32_t> rev(free_slots.rbegin(), free_slots.rend());
+    free_slots.swap(rev);
+    return bad;
+}
+
+const std::vector<uint32_t>* DeltaVault::versions(uint32_t inode) const {
+    auto it = by_inode.find(inode);
+    return it == by_inode.end() ? nullptr : &it->second;
+}
+
+bool DeltaVault::add(VaultRecord r) {
+    if (free_slots.empty()) return false;
+    uint32_t slot = free_slots.back();
+    free_slots.pop_back();
+
+    r.seq = next_seq++;
+    stamp(r);
+    table[slot] = r;
+    by_seq[r.seq] = slot;
+    by_inode[r.inode].push_back(slot);
+    return true;
+}
+
+void DeltaVault::unlink(uint32_t slot) {
+    VaultRecord& r = table[slot];
+    by_seq.erase(r.seq);
+    auto it = by_inode.find(r.inode);
+    if (it != by_inode.end()) {
+        std::vector<uint32_t>& v = it->second;
+        for (size_t i = 0; i < v.size(); i++) {
+            if (v[i] == slot) {
+                v.erase(v.begin() + i);
+                break;
+            }
+        }
+        if (v.empty()) by_inode.erase(it);
+    }
+    memset(&r, 0, sizeof(r));
+    free_slots.push_back(slot);
+}
+
+bool DeltaVault::pop_oldest(VaultRecord& out) {
+    if (by_seq.empty()) return false;
+    uint32_t slot = by_seq.begin()->second;
+    out = table[slot];
+    unlink(slot);
+    return true;
+}
+
+void DeltaVault::take_all(uint32_t inode, std::vector<VaultRecord>& out) {
+    auto it = by_inode.find(inode);
+    if (it == by_inode.end()) return;
+    std::vector<uint32_t> list = it->second;
+    for (uint32_t slot : list) {
+        out.push_back(table[slot]);
+        unlink(slot);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <unordered_map>
+
+#include "../include/ofs_internal.h"
+#include "crc32c.h"
+
+// The Delta Vault table: a fixed number of VaultRecord slots in the
+// container, resident like the metadata table. The block chains holding the
+// deltas belong to the caller; this only keeps the records and their order.
+// When every slot is taken the caller drops the oldest record to make room.
+class DeltaVault {
+private:
+    VaultRecord* table;
+    uint32_t slots;
+    bool checksums;
+    uint64_t next_seq;
+
+    std::vector<uint32_t> free_slots;
+    std::map<uint64_t, uint32_t> by_seq;                         // seq -> slot
+    std::unordered_map<uint32_t, std::vector<uint32_t>> by_inode; // slots, oldest first
+
+    void stamp(VaultRecord& r) const;
+    void unlink(uint32_t slot);
+
+public:
+    DeltaVault() {
+        table = nullptr;
+        slots = 0;
+        checksums = false;
+        next_seq = 1;
+    }
+
+    // mount; a record that fails its crc is cleared (its blocks stay
+    // allocated, nothing trustworthy says which they are). Returns how many.
+    uint32_t init(VaultRecord* records, uint32_t count, bool checksums_on);
+
+    bool enabled() const { return slots != 0; }
+    uint32_t capacity() const { return slots; }
+    uint32_t size() const { return (uint32_t)by_seq.size(); }
+
+    const VaultRecord& record(uint32_t slot) const { return table[slot]; }
+    // the inode's records, oldest first; null when it has none
+    const std::vector<uint32_t>* versions(uint32_t inode) const;
+
+    // stores r, assigning its seq; false when no slot is free
+    bool add(VaultRecord r);
+    // removes the record with the lowest seq; false when the vault is empty
+    bool pop_oldest(VaultRecord& out);
+    // removes every record of the inode
+    void take_all(uint32_t inode, std::vector<VaultRecord>& out);
+};
@@ -0,0 +1,361 @@
+#include "FileIo.h"
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+
+// no liburing: the three system calls are all the ring needs
+static int uring_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+static int uring_enter(int fd, unsigned submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, nullptr, 0);
+}
+static int uring_register(int fd, unsigned op, const void* arg, unsigned n) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+static const unsigned RING_ENTRIES = 256;
+
+FileIo::FileIo() {
+    fd = -1;
+    dfd = -1;
+    direct_from = 0;
+    dalign = 0;
+    uring = false;
+    ring_fd = -1;
+    event = -1;
+    sq_head = sq_tail = sq_mask = sq_array = nullptr;
+    cq_head = cq_tail = cq_mask = nullptr;
+    sqes = nullptr;
+    cqes = nullptr;
+    sq_entries = cq_entries = 0;
+    sq_map = cq_map = nullptr;
+    sq_map_len = cq_map_len = sqes_len = 0;
+    fixed_file = false;
+    queued = 0;
+    in_flight = 0;
+}
+
+bool FileIo::open(const char* path, uint32_t backend, bool truncate) {
+    close();
+    int flags = O_RDWR | O_CLOEXEC;
+    if (truncate) flags |= O_CREAT | O_TRUNC;
+    fd = ::open(path, flags, 0644);
+    if (fd < 0) return false;
+    if (backend != IO_PREAD) uring = ring_setup();
+    return true;
+}
+
+void FileIo::close() {
+    if (fd < 0) return;
+    // requests still out refer to caller memory; let them finish
+    submit();
+    while (uring && in_flight) {
+        unsigned before = in_flight;
+        collect(1);
+        if (in_flight == before) break;
+    }
+    done.clear();
+    if (uring) ring_teardown();
+    uring = false;
+    if (dfd >= 0) ::close(dfd);
+    dfd = -1;
+    dalign = 0;
+    ::close(fd);
+    fd = -1;
+}
+
+bool FileIo::ring_setup() {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring_fd = uring_setup(RING_ENTRIES, &p);
+    if (ring_fd < 0) return false;      // old kernel, or refused by seccomp
+
+    sq_entries = p.sq_entries;
+    cq_entries = p.cq_entries;
+    sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && cq_map_len > sq_map_len) sq_map_len = cq_map_len;
+
+    sq_map = mmap(nullptr, sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring_fd, IORING_OFF_SQ_RING);
+    if (sq_map == MAP_FAILED) {
+        sq_map = nullptr;
+        ring_teardown();
+        return false;
+    }
+    if (single) {
+        cq_map = sq_map;
+    } else {
+        cq_map = mmap(nullptr, cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd, IORING_OFF_CQ_RING);
+        if (cq_map == MAP_FAILED) {
+            cq_map = nullptr;
+            ring_teardown();
+            return false;
+        }
+    }
+    sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    void* s = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQES);
+    if (s == MAP_FAILED) {
+        ring_teardown();
+        return false;
+    }
+    sqes = (io_uring_sqe*)s;
+
+    uint8_t* sq = (uint8_t*)sq_map;
+    sq_head = (unsigned*)(sq + p.sq_off.head);
+    sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+    uint8_t* cq = (uint8_t*)cq_map;
+    cq_head = (unsigned*)(cq + p.cq_off.head);
+    cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    // both optional: without them requests name the fd and map buffers
+    // per request, and callers poll instead of waiting on the eventfd
+    register_files();
+    event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event >= 0 && uring_register(ring_fd, IORING_REGISTER_EVENTFD, &event, 1) != 0) {
+        ::close(event);
+        event = -1;
+    }
+    return true;
+}
+
+// slot 0 is the buffered descriptor, slot 1 the direct one when open
+void FileIo::register_files() {
+    if (fixed_file) uring_register(ring_fd, IORING_UNREGISTER_FILES, nullptr, 0);
+    int fds[2] = { fd, dfd };
+    fixed_file = uring_register(ring_fd, IORING_REGISTER_FILES, fds, dfd >= 0 ? 2 : 1) == 0;
+}
+
+void FileIo::ring_teardown() {
+    if (sqes) munmap(sqes, sqes_len);
+    if (cq_map && cq_map != sq_map) munmap(cq_map, cq_map_len);
+    if (sq_map) munmap(sq_map, sq_map_len);
+    if (ring_fd >= 0) ::close(ring_fd);
+    if (event >= 0) ::close(event);
+    ring_fd = -1;
+    event = -1;
+    sqes = nullptr;
+    sq_map = cq_map = nullptr;
+    fixed_file = false;
+    regions.clear();
+}
+
+bool FileIo::read(uint64_t off, void* buf, size_t n) {
+    uint8_t* p = (uint8_t*)buf;
+    while (n > 0) {
+        ssize_t r = pread(fd_for(off), p, n, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        off += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool FileIo::write(uint64_t off, const void* buf, size_t n) {
+    const uint8_t* p = (const uint8_t*)buf;
+    while (n > 0) {
+        ssize_t r = pwrite(fd_for(off), p, n, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        off += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool FileIo::resize(uint64_t size) {
+    return ftruncate(fd, (off_t)size) == 0;
+}
+
+uint32_t FileIo::direct_alignment(const char* path) const {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return 0;
+    if (S_ISBLK(st.st_mode)) {
+        int sector = 0;
+        return ioctl(fd, BLKSSZGET, &sector) == 0 && sector > 0 ? (uint32_t)sector : 0;
+    }
+#ifdef STATX_DIOALIGN
+    struct statx sx;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &sx) == 0 && (sx.stx_mask & STATX_DIOALIGN)) {
+        if (sx.stx_dio_offset_align == 0) return 0;
+        return std::max(sx.stx_dio_offset_align, sx.stx_dio_mem_align);
+    }
+#endif
+    // kernel too old to say: probe, and assume the largest common sector
+    int probe = ::open(path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+    if (probe < 0) return 0;
+    ::close(probe);
+    return 4096;
+}
+
+bool FileIo::enable_direct(const char* path, uint64_t from, uint32_t align) {
+    if (fd < 0 || dfd >= 0 || align == 0 || from % align) return false;
+    dfd = ::open(path, O_RDWR | O_DIRECT | O_CLOEXEC);
+    if (dfd < 0) return false;
+    direct_from = from;
+    dalign = align;
+    if (uring) {
+        // requests in flight name slot 0 only
+        submit();
+        while (in_flight) {
+            unsigned before = in_flight;
+            collect(1);
+            if (in_flight == before) break;
+        }
+        register_files();
+    }
+    return true;
+}
+
+void FileIo::register_buffers(const std::vector<std::pair<void*, size_t>>& bufs) {
+    if (!uring) return;
+    // the ring holds references to the old buffers until it is idle
+    submit();
+    while (in_flight) {
+        unsigned before = in_flight;
+        collect(1);
+        if (in_flight == before) return;
+    }
+    if (!regions.empty()) uring_register(ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    regions.clear();
+
+    std::vector<iovec> iov;
+    for (auto& b : bufs) iov.push_back({ b.first, b.second });
+    // pinned pages count against RLIMIT_MEMLOCK; when refused, requests
+    // simply map their buffers one at a time
+    if (!iov.empty() && uring_register(ring_fd, IORING_REGISTER_BUFFERS, iov.data(),
+                                       (unsigned)iov.size()) == 0) {
+        for (auto& b : bufs) regions.push_back({ (uint8_t*)b.first, b.second });
+    }
+}
+
+void FileIo::push(const Request& r) {
+    if (!uring) {
+        pending_sync.push_back(r);
+        return;
+    }
+    // keep every completion room in the CQ, and the SQ from overflowing
+    if (queued + in_flight >= cq_entries) {
+        submit();
+        collect(1);
+    }
+    if (queued == sq_entries) submit();
+
+    unsigned tail = *sq_tail;
+    unsigned idx = tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqe->opcode = r.write ? IORING_OP_WRITE : IORING_OP_READ;
+    for (size_t i = 0; i < regions.size(); i++) {
+        const Region& g = regions[i];
+        if ((uint8_t*)r.buf >= g.base && (uint8_t*)r.buf + r.len <= g.base + g.len) {
+            sqe->opcode = r.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = (uint16_t)i;
+            break;
+        }
+    }
+    if (fixed_file) {
+        sqe->fd = fd_for(r.off) == fd ? 0 : 1;
+        sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = fd_for(r.off);
+    }
+    sqe->off = r.off;
+    sqe->addr = (uint64_t)(uintptr_t)r.buf;
+    sqe->len = r.len;
+    sqe->user_data = r.tag;
+
+    sq_array[idx] = idx;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+}
+
+void FileIo::queue_read(uint64_t off, void* buf, uint32_t len, uint64_t tag) {
+    push({ off, buf, len, false, tag });
+}
+
+void FileIo::queue_write(uint64_t off, const void* buf, uint32_t len, uint64_t tag) {
+    push({ off, (void*)buf, len, true, tag });
+}
+
+void FileIo::submit() {
+    if (!uring) {
+        for (const Request& r : pending_sync) {
+            bool ok = r.write ? write(r.off, r.buf, r.len) : read(r.off, r.buf, r.len);
+            done.push_back({ r.tag, ok ? (int32_t)r.len : -EIO });
+        }
+        pending_sync.clear();
+        return;
+    }
+    while (queued > 0) {
+        int n = uring_enter(ring_fd, queued, 0, 0);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                collect(in_flight ? 1 : 0);
+                continue;
+            }
+            break;
+        }
+        queued -= n;
+        in_flight += n;
+    }
+}
+
+// moves ring completions into `done`, waiting for wait_for of them
+void FileIo::collect(unsigned wait_for) {
+    if (wait_for > in_flight) wait_for = in_flight;
+    while (true) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned got = 0;
+        for (; head != tail; head++, got++) {
+            const io_uring_cqe& c = cqes[head & *cq_mask];
+            done.push_back({ c.user_data, c.res });
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        in_flight -= got;
+        wait_for = got >= wait_for ? 0 : wait_for - got;
+        if (wait_for == 0) break;
+        if (uring_enter(ring_fd, 0, wait_for, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            break;
+    }
+    if (event >= 0) {
+        uint64_t v;
+        while (::read(event, &v, sizeof(v)) > 0) {}
+    }
+}
+
+size_t FileIo::reap(std::vector<IoDone>& out, unsigned min_wait) {
+    if (!uring) submit();
+    else if (in_flight || queued) {
+        if (queued && min_wait) submit();
+        unsigned have = (unsigned)done.size();
+        collect(min_wait > have ? min_wait - have : 0);
+    }
+    size_t n = done.size();
+    out.insert(out.end(), done.begin(), done.end());
+    done.clear();
+    return n;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+#include "../include/ofs_internal.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// A finished asynchronous request: the caller's tag and the byte count, or
+// -errno.
+struct IoDone {
+    uint64_t tag;
+    int32_t result;
+};
+
+// The .omni file. Single requests are positional pread/pwrite calls on
+// either backend; waiting on a ring for one request would only add work.
+// Batches are queued, handed over with submit() and collected with reap():
+// io_uring takes a whole batch in one system call and completes it in the
+// background, against the registered file and, where a buffer lies in a
+// registered region, without mapping it per request. The pread backend
+// performs the batch inside submit().
+//
+// In direct mode a second descriptor opened with O_DIRECT serves every
+// offset from the start of the data region on, so data blocks bypass the
+// kernel page cache; requests there must be aligned to direct_align() in
+// offset, length and memory.
+class FileIo {
+private:
+    struct Request {
+        uint64_t off;
+        void* buf;
+        uint32_t len;
+        bool write;
+        uint64_t tag;
+    };
+    struct Region {
+        uint8_t* base;
+        size_t len;
+    };
+
+    int fd;
+    int dfd;                            // O_DIRECT, or -1
+    uint64_t direct_from;
+    uint32_t dalign;
+    bool uring;
+
+    // ring state, valid when uring is set
+    int ring_fd;
+    int event;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe* sqes;
+    io_uring_cqe* cqes;
+    unsigned sq_entries, cq_entries;
+    void* sq_map;
+    size_t sq_map_len;
+    void* cq_map;
+    size_t cq_map_len;
+    size_t sqes_len;
+    bool fixed_file;
+    std::vector<Region> regions;        // registered buffers, by index
+
+    unsigned queued;                    // in the SQ, not yet submitted
+    unsigned in_flight;                 // submitted, completion not yet seen
+    std::vector<Request> pending_sync;  // pread backend: waiting for submit()
+    std::vector<IoDone> done;
+
+    int fd_for(uint64_t off) const { return dfd >= 0 && off >= direct_from ? dfd : fd; }
+    void register_files();
+    bool ring_setup();
+    void ring_teardown();
+    void push(const Request& r);
+    void collect(unsigned wait_for);
+
+public:
+    FileIo();
+    ~FileIo() { close(); }
+
+    // backend is an IoBackend; IO_AUTO and IO_URING fall back to pread when
+    // the kernel refuses a ring
+    bool open(const char* path, uint32_t backend, bool truncate);
+    void close();
+    bool is_open() const { return fd >= 0; }
+    bool async() const { return uring; }
+    const char* backend_name() const { return uring ? "io_uring" : "pread"; }
+
+    // whole transfers or false; a read is also false when it ends past EOF
+    bool read(uint64_t off, void* buf, size_t n);
+    bool write(uint64_t off, const void* buf, size_t n);
+    // sets the file length without writing the gap
+    bool resize(uint64_t size);
+
+    // The offset, length and memory alignment O_DIRECT needs for this file,
+    // or 0 if its file system does not support it.
+    uint32_t direct_alignment(const char* path) const;
+    // routes offsets from `from` on through an O_DIRECT descriptor
+    bool enable_direct(const char* path, uint64_t from, uint32_t align);
+    bool direct() const { return dfd >= 0; }
+    uint32_t direct_align() const { return dalign; }
+
+    // Buffers that queued requests will mostly use (the cache frames). They
+    // must stay allocated until close() or the next call.
+    void register_buffers(const std::vector<std::pair<void*, size_t>>& bufs);
+
+    void queue_read(uint64_t off, void* buf, uint32_t len, uint64_t tag);
+    void queue_write(uint64_t off, const void* buf, uint32_t len, uint64_t tag);
+    void submit();
+    // moves completions to out, waiting until at least min_wait are there
+    // (bounded by what is outstanding); returns how many
+    size_t reap(std::vector<IoDone>& out, unsigned min_wait);
+    // queued, in flight or completed but not reaped
+    size_t outstanding() const { return queued + in_flight + pending_sync.size() + done.size(); }
+
+    // readable when io_uring completions arrive, -1 without a ring
+    int event_fd() const { return uring ? event : -1; }
+};
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <algorithm>
 #include <ctime>
+#include <random>
 
 // ==========================================================
 // Utility: current timestamp
@@ -15,6 +16,13 @@ uint64_t FileSystem::now_timestamp() {
 // ==========================================================
 FileSystem::FileSystem() {
     is_open = false;
+    next_session_handle = 1;
+    meta_errors = 0;
+    tree_slot = -1;
+    read_only = false;
+    tree_meta_offset = 0;
+    tree_inline_offset = 0;
+    session_timers.init(now_timestamp());
 }
 
 FileSystem::~FileSystem() {
@@ -22,24 +30,17 @@ FileSystem::~FileSystem() {
 }
 
 // ==========================================================
-// Low-level stream opening
+// Low-level file opening
 // ==========================================================
-bool FileSystem::open_stream(bool write) {
+bool FileSystem::open_file(bool truncate) {
     if (is_open) return true;
-
-    std::ios::openmode mode = std::ios::binary;
-    if (write) mode |= std::ios::in | std::ios::out;
-    else mode |= std::ios::in;
-
-    stream.open(omni_path, mode);
-    if (!stream.is_open()) return false;
-
+    if (!io.open(omni_path.c_str(), config.io_backend, truncate)) return false;
     is_open = true;
     return true;
 }
 
-void FileSystem::close_stream() {
-    if (is_open) stream.close();
+void FileSystem::close_file() {
+    if (is_open) io.close();
     is_open = false;
 }
 
@@ -57,8 +58,24 @@ bool FileSystem::compute_layout() {
     layout.meta_offset = layout.user_table_offset + layout.user_table_size;
     layout.meta_size   = config.max_files * sizeof(MetadataEntry);
 
+    // ----- inline slots, one per metadata entry -----
+    layout.inline_offset = layout.meta_offset + layout.meta_size;
+    layout.inline_size   = (header.feature_flags & OMNI_FEATURE_INLINE)
+                           ? (uint64_t)config.max_files * INLINE_CAPACITY : 0;
+
+    // ----- Delta Vault records -----
+    layout.vault_offset = layout.inline_offset + layout.inline_size;
+    layout.vault_size   = (header.feature_flags & OMNI_FEATURE_VAULT)
+                          ? (uint64_t)header.vault_slots * sizeof(VaultRecord) : 0;
+
+    // ----- container snapshot slots -----
+    layout.snap_offset    = layout.vault_offset + layout.vault_size;
+    layout.snap_slot_size = (header.feature_flags & OMNI_FEATURE_SNAPSHOTS)
+                            ? sizeof(SnapshotRecord) + layout.meta_size + layout.inline_size : 0;
+    layout.snap_size      = (uint64_t)header.snapshot_slots * layout.snap_slot_size;
+
     // ----- free-map + data area -----
-    layout.free_map_offset = layout.meta_offset + layout.meta_size;
+    layout.free_map_offset = layout.snap_offset + layout.snap_size;
 
     uint64_t block_sz = config.block_size;
     if (block_sz == 0) return false;
@@ -71,10 +88,16 @@ bool FileSystem::compute_layout() {
     uint64_t max_blocks = remaining / block_sz;
     uint64_t blocks = max_blocks;
 
+    uint64_t sum_per_block = (header.feature_flags & OMNI_FEATURE_CHECKSUMS) ? 4 : 0;
+    uint64_t fp_per_block = (header.feature_flags & OMNI_FEATURE_DEDUP) ? sizeof(Fingerprint) : 0;
+    uint64_t align = (header.feature_flags & OMNI_FEATURE_ALIGNED) ? DATA_ALIGN : 1;
+
     while (blocks > 0) {
         uint64_t fm_size   = (blocks + 7) / 8;      // bitmap: 1 bit per block
         uint64_t data_size = blocks * block_sz;
-        if (fm_size + data_size <= remaining) {
+        uint64_t tables    = layout.free_map_offset + fm_size + blocks * (sum_per_block + fp_per_block);
+        uint64_t data_off  = (tables + align - 1) / align * align;
+        if (data_off - layout.free_map_offset + data_size <= remaining) {
             break;  // fits!
         }
         --blocks;
@@ -82,7 +105,11 @@ bool FileSystem::compute_layout() {
 
     layout.blocks_count  = static_cast<uint32_t>(blocks);
     layout.free_map_size = (layout.blocks_count + 7) / 8;
-    layout.data_offset   = layout.free_map_offset + layout.free_map_size;
+    layout.sum_offset    = layout.free_map_offset + layout.free_map_size;
+    layout.sum_size      = layout.blocks_count * sum_per_block;
+    layout.fp_offset     = layout.sum_offset + layout.sum_size;
+    layout.fp_size       = layout.blocks_count * fp_per_block;
+    layout.data_offset   = (layout.fp_offset + layout.fp_size + align - 1) / align * align;
     layout.data_size     = layout.blocks_count * block_sz;
 
     return true;
@@ -92,11 +119,8 @@ bool FileSystem::compute_layout() {
 // LOAD HEADER
 // ==========================================================
 bool FileSystem::load_header() {
-    open_stream(true);
-
-    stream.seekg(0);
-    stream.read(reinterpret_cast<char*>(&header), sizeof(OMNIHeader));
-    return true;
+    open_file(false);
+    return io.read(0, &header, sizeof(OMNIHeader));
 }
 
 // ==========================================================
@@ -104,36 +128,119 @@ bool FileSystem::load_header() {
 // ==========================================================
 bool FileSystem::load_users_from_disk() {
     users.resize(config.max_users);
-    stream.seekg(layout.user_table_offset);
-    stream.read(reinterpret_cast<char*>(users.data()), layout.user_table_size);
-    return true;
+    return io.read(layout.user_table_offset, users.data(), layout.user_table_size);
 }
 
 bool FileSystem::flush_users_to_disk() {
-    stream.seekp(layout.user_table_offset);
-    stream.write(reinterpret_cast<const char*>(users.data()), layout.user_table_size);
-    stream.flush();
-    return true;
+    return io.write(layout.user_table_offset, users.data(), layout.user_table_size);
+}
+
+// Rewrites the single UserInfo slot a user mutation touched.
+bool FileSystem::flush_user_slot(uint32_t idx) {
+    return io.write(layout.user_table_offset + (uint64_t)idx * sizeof(UserInfo),
+                    &users[idx], sizeof(UserInfo));
 }
 
 int FileSystem::find_user_index(const char* username) const {
-    for (size_t i = 0; i < users.size(); i++) {
-        if (users[i].is_active &&
-            std::strcmp(users[i].username, username) == 0)
-            return (int)i;
-    }
-    return -1;
+    return user_index.find(username);
 }
 
-bool FileSystem::session_is_admin(void* session) const {
+bool FileSystem::session_is_admin(void* session) {
     ActiveSession* s = find_session(session);
     if (!s) return false;
-    return s->info.user.role == UserRole::ADMIN;
+    return s->role == UserRole::ADMIN;
+}
+
+// Every operation comes through here, so this is also where activity is
+// recorded. A session past its deadline is expired on the spot rather than
+// waiting for the next timer tick.
+ActiveSession* FileSystem::find_session(void* session) {
+    ActiveSession** found = sessions.find((uint64_t)(uintptr_t)session);
+    if (!found) return nullptr;
+
+    ActiveSession* s = *found;
+    uint64_t now = now_timestamp();
+    uint64_t deadline = session_deadline(s);
+    if (deadline && now >= deadline) {
+        user_logout(session);
+        return nullptr;
+    }
+    s->info.last_activity = now;
+    s->info.operations_count++;
+    return s;
+}
+
+// When the session expires, 0 if never.
+uint64_t FileSystem::session_deadline(const ActiveSession* s) const {
+    uint64_t deadline = 0;
+    if (config.session_idle_timeout)
+        deadline = s->info.last_activity + config.session_idle_timeout;
+    if (config.session_max_lifetime) {
+        uint64_t hard = s->info.login_time + config.session_max_lifetime;
+        if (!deadline || hard < deadline) deadline = hard;
+    }
+    return deadline;
+}
+
+// The wheel holds one timer per session, armed at the deadline computed
+// when it was last (re)armed. Activity only moves the deadline later, so a
+// fired timer re-checks and re-arms instead of being rescheduled on every
+// request.
+uint32_t FileSystem::expire_sessions() {
+    std::vector<uint64_t> fired;
+    uint64_t now = now_timestamp();
+    session_timers.advance(now, fired);
+
+    uint32_t expired = 0;
+    for (uint64_t id : fired) {
+        ActiveSession** found = sessions.find(id);
+        if (!found) continue;
+        uint64_t deadline = session_deadline(*found);
+        if (deadline && now >= deadline) {
+            user_logout((void*)(uintptr_t)id);
+            expired++;
+        } else if (deadline) {
+            session_timers.schedule(&(*found)->timer, deadline);
+        }
+    }
+    return expired;
+}
+
+static bool random_token(SessionToken& t) {
+    static std::random_device rd;
+    for (int i = 0; i < 16; i += 4) {
+        uint32_t r = rd();
+        memcpy(t.bytes + i, &r, 4);
+    }
+    return true;
 }
 
-ActiveSession* FileSystem::find_session(void* session) const {
-    for (auto* s : sessions)
-        if (s == session) return s;
+static void token_to_hex(const SessionToken& t, char out[33]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 16; i++) {
+        out[i * 2] = digits[t.bytes[i] >> 4];
+        out[i * 2 + 1] = digits[t.bytes[i] & 15];
+    }
+    out[32] = '\0';
+}
+
+static bool hex_to_token(const char* s, SessionToken& t) {
+    for (int i = 0; i < 32; i++) {
+        char c = s[i];
+        int v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else return false;
+        if (i % 2 == 0) t.bytes[i / 2] = (uint8_t)(v << 4);
+        else t.bytes[i / 2] |= (uint8_t)v;
+    }
+    return s[32] == '\0';
+}
+
+ReadSnapshot* FileSystem::find_snapshot(void* snapshot) const {
+    for (auto* r : snapshots)
+        if (r == snapshot) return r;
     return nullptr;
 }
 
@@ -144,12 +251,9 @@ bool FileSystem::format_new(const FSConfig& cfg, const char* path) {
     config = cfg;
     omni_path = path;
 
-    // remove old
-    std::ofstream del(path, std::ios::binary | std::ios::trunc);
-    del.close();
-
-    // open
-    if (!open_stream(true))
+    // open, dropping any old contents
+    close_file();
+    if (!open_file(true))
         return false;
 
     // build header
@@ -160,29 +264,45 @@ bool FileSystem::format_new(const FSConfig& cfg, const char* path) {
     header.header_size = 512;
     header.block_size  = config.block_size;
     header.max_users   = config.max_users;
+    header.kdf_iterations = config.kdf_iterations ? config.kdf_iterations
+                                                  : PasswordHasher::DEFAULT_ITERATIONS;
+    SecurityManager::derive_table(config.private_key,
+                                  strnlen(config.private_key, sizeof(config.private_key)),
+                                  header.encoding_table);
+    header.feature_flags = OMNI_FEATURE_CHECKSUMS | OMNI_FEATURE_INLINE | OMNI_FEATURE_TAILS |
+                           OMNI_FEATURE_COMPRESS | OMNI_FEATURE_DEDUP | OMNI_FEATURE_ALIGNED;
+    if (config.vault_slots) {
+        header.feature_flags |= OMNI_FEATURE_VAULT;
+        header.vault_slots = config.vault_slots;
+    }
+    if (config.snapshot_slots) {
+        header.feature_flags |= OMNI_FEATURE_SNAPSHOTS;
+        header.snapshot_slots = std::min(config.snapshot_slots, MAX_SNAPSHOT_SLOTS);
+    }
 
     compute_layout();
+    header.file_state_storage_offset = (uint32_t)layout.vault_offset;
 
     // write header
-    stream.seekp(0);
-    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    bool ok = io.write(0, &header, sizeof(header));
 
     // init user table
     users.clear();
     users.resize(config.max_users);
 
-    // create admin
-    std::string admin_hash = "adminHASH";
-    users[0] = UserInfo("admin", admin_hash, UserRole::ADMIN, now_timestamp());
+    // create admin from the config credentials
+    const char* admin_name = config.admin_username[0] ? config.admin_username : "admin";
+    users[0] = UserInfo(admin_name, "", UserRole::ADMIN, now_timestamp());
     users[0].is_active = 1;
+    passwords.set_iterations(header.kdf_iterations);
+    passwords.make_record(config.admin_password, users[0]);
 
-    flush_users_to_disk();
+    ok = flush_users_to_disk() && ok;
 
     // init metadata table (zeroed)
-    stream.seekp(layout.meta_offset);
     {
         std::vector<uint8_t> zero(layout.meta_size);
-        stream.write((char*)zero.data(), zero.size());
+        ok = io.write(layout.meta_offset, zero.data(), zero.size()) && ok;
     }
     // ----- CREATE ROOT DIRECTORY (meta index 0) -----
 {
@@ -194,49 +314,139 @@ bool FileSystem::format_new(const FSConfig& cfg, const char* path) {
     root.short_name[1] = '\0';
     root.created_time = now_timestamp();
     root.modified_time = now_timestamp();
+    MetadataManager::stamp(root);
 
-    stream.seekp(layout.meta_offset);
-    stream.write((char*)&root, sizeof(MetadataEntry));
+    ok = io.write(layout.meta_offset, &root, sizeof(MetadataEntry)) && ok;
 }
 
+    // init inline slots
+    {
+        std::vector<uint8_t> zero(layout.inline_size);
+        ok = io.write(layout.inline_offset, zero.data(), zero.size()) && ok;
+    }
+
+    // no version kept yet
+    {
+        std::vector<uint8_t> zero(layout.vault_size);
+        ok = io.write(layout.vault_offset, zero.data(), zero.size()) && ok;
+    }
+
+    // every snapshot slot free
+    {
+        std::vector<uint8_t> zero(layout.snap_size);
+        ok = io.write(layout.snap_offset, zero.data(), zero.size()) && ok;
+    }
+
     // init bitmap
-    stream.seekp(layout.free_map_offset);
     {
         std::vector<uint8_t> zero(layout.free_map_size);
-        stream.write((char*)zero.data(), zero.size());
+        ok = io.write(layout.free_map_offset, zero.data(), zero.size()) && ok;
     }
 
-    // init data region
-    stream.seekp(layout.data_offset);
+    // block sums: every block starts out zeroed
     {
-        std::vector<uint8_t> zero(config.total_size - layout.data_offset);
-        stream.write((char*)zero.data(), zero.size());
+        std::vector<uint8_t> zero_block(config.block_size);
+        std::vector<uint32_t> sums(layout.blocks_count,
+                                   crc32c(zero_block.data(), zero_block.size()));
+        ok = io.write(layout.sum_offset, sums.data(), layout.sum_size) && ok;
     }
 
-    stream.flush();
-    return true;
+    // no block is indexed yet
+    {
+        std::vector<uint8_t> zero(layout.fp_size);
+        ok = io.write(layout.fp_offset, zero.data(), zero.size()) && ok;
+    }
+
+    // data region: extend the file to full size; the unwritten blocks read
+    // back as zeros without being held in memory
+    if (config.total_size > layout.data_offset)
+        ok = io.resize(config.total_size) && ok;
+
+    return ok;
 }
 
 // ==========================================================
 // LOAD EXISTING
 // ==========================================================
 bool FileSystem::load_existing(const FSConfig& cfg, const char* path) {
+    return mount(cfg, path, nullptr);
+}
+
+bool FileSystem::load_snapshot(const FSConfig& cfg, const char* path, const char* name) {
+    return name && name[0] && mount(cfg, path, name);
+}
+
+bool FileSystem::mount(const FSConfig& cfg, const char* path, const char* snapshot) {
     config = cfg;
     omni_path = path;
 
-    if (!open_stream(true)) return false;
+    if (!open_file(false)) return false;
 
     load_header();
     compute_layout();
     load_users_from_disk();
+    user_index.load(users);
+    passwords.set_iterations(header.kdf_iterations);
+    passwords.clear_cache();
+
+    // containers made before content encoding have a zeroed table and
+    // plaintext blocks
+    if (!codec.set_table(header.encoding_table))
+        codec.set_identity();
+
+    // init managers (the image must outlive them, so it is a member); the
+    // tables stay resident, data blocks are read through the cache
+    file_image.assign(layout.data_offset, 0);
+    if (!io.read(0, file_image.data(), file_image.size())) return false;
+
+    // snapshot slots; one whose record fails its crc is dropped, and the
+    // references it held with it
+    bool checksums = (header.feature_flags & OMNI_FEATURE_CHECKSUMS) != 0;
+    meta_errors = 0;
+    snap_dirty.assign(header.snapshot_slots, 0);
+    for (uint32_t i = 0; i < header.snapshot_slots && layout.snap_size; i++) {
+        SnapshotRecord& r = slot_record(i);
+        if (!r.name[0] || !checksums) continue;
+        SnapshotRecord c = r;
+        c.crc = 0;
+        if (crc32c(&c, sizeof(c)) != r.crc) {
+            memset(&r, 0, sizeof(r));
+            snap_dirty[i] = 1;
+            meta_errors++;
+        }
+    }
 
-    // init managers
-    stream.seekg(0);
-    std::vector<uint8_t> file_image(config.total_size);
-    stream.read((char*)file_image.data(), file_image.size());
+    // the tree to work on
+    tree_slot = -1;
+    read_only = false;
+    tree_meta_offset = layout.meta_offset;
+    tree_inline_offset = layout.inline_offset;
+    if (snapshot) {
+        tree_slot = find_slot(snapshot);
+        if (tree_slot < 0) {
+            file_image.clear();
+            close_file();
+            return false;
+        }
+        read_only = !slot_record(tree_slot).writable;
+        tree_meta_offset = slot_offset(tree_slot) + sizeof(SnapshotRecord);
+        tree_inline_offset = tree_meta_offset + layout.meta_size;
+    }
 
     // metadata manager
-    meta.init(file_image.data(), layout.meta_offset, config.max_files);
+    meta.init(file_image.data(), tree_meta_offset, config.max_files);
+    meta.set_checksums(checksums);
+    meta.set_inline((header.feature_flags & OMNI_FEATURE_INLINE) ? tree_inline_offset : 0);
+
+    // the table is small and walked by rebuild anyway, so it is always
+    // verified in full; a damaged entry stays listed but cannot be read
+    meta_bad.assign(config.max_files, 0);
+    for (uint32_t i = 0; i < config.max_files; i++) {
+        if (!meta.verify_entry(i)) {
+            meta_bad[i] = 1;
+            meta_errors++;
+        }
+    }
 
     // directory tree
     tree.init(&meta);
@@ -245,23 +455,162 @@ bool FileSystem::load_existing(const FSConfig& cfg, const char* path) {
     // FreeSpace manager
     fsm.init(file_image.data(), layout.free_map_offset, layout.blocks_count);
 
+    // Delta Vault; damaged records are counted with the metadata errors
+    if (header.feature_flags & OMNI_FEATURE_VAULT)
+        meta_errors += vault.init((VaultRecord*)(file_image.data() + layout.vault_offset),
+                                  header.vault_slots, checksums);
+    else
+        vault.init(nullptr, 0, false);
+
+    // Data blocks past the page cache, when asked for and the file system
+    // and layout allow it; otherwise buffered as before
+    if (config.direct_io) {
+        uint32_t align = io.direct_alignment(omni_path.c_str());
+        if (align && align <= DATA_ALIGN && config.block_size % align == 0)
+            io.enable_direct(omni_path.c_str(), layout.data_offset, align);
+    }
+
     // Block manager
-    blockman.init(file_image.data(),
+    cache.init(&io, layout.data_offset, config.block_size, layout.blocks_count,
+               config.cache_size);
+    blockman.init(&cache,
                   layout.data_offset,
                   config.block_size,
                  layout.blocks_count,
                   &fsm);
+    blockman.set_codec(&codec);
+    blockman.set_checksums(checksums ? file_image.data() + layout.sum_offset : nullptr,
+                           config.verify_mode, config.verify_sample);
+    tails.init(&blockman);
+
+    // shared blocks: counts come from walking every chain, the index from
+    // the persisted fingerprints of blocks still referenced
+    if (header.feature_flags & OMNI_FEATURE_DEDUP) {
+        dedup.init(file_image.data() + layout.fp_offset, layout.blocks_count);
+        blockman.set_dedup(&dedup);
+        for (uint32_t i = 0; i < config.max_files; i++) {
+            const MetadataEntry& e = meta.get_const(i);
+            if (e.valid_flag && e.type_flag == 0 && !meta_bad[i] &&
+                e.storage != STORAGE_INLINE && e.start_index != 0xFFFFFFFF)
+                blockman.count_refs(e.start_index);
+        }
+        for (uint32_t i = 0; i < vault.capacity(); i++) {
+            const VaultRecord& r = vault.record(i);
+            if (r.inode != 0 && r.delta_start != 0xFFFFFFFF) blockman.count_refs(r.delta_start);
+        }
+        // the trees not mounted hold references too
+        MetadataManager other;
+        if (tree_slot >= 0) {
+            tree_view(-1, other);
+            reference_tree(other, TREE_MOUNT);
+        }
+        for (uint32_t i = 0; i < header.snapshot_slots && layout.snap_size; i++) {
+            if ((int)i == tree_slot || !slot_record(i).name[0]) continue;
+            tree_view((int)i, other);
+            reference_tree(other, TREE_MOUNT);
+        }
+        dedup.rebuild_index();
+    } else {
+        blockman.set_dedup(nullptr);
+    }
+
+    // packed tails: fragment occupancy is rebuilt from the entries
+    tail_queue.clear();
+    tail_queued.assign(config.max_files, 0);
+    for (uint32_t i = 0; i < config.max_files; i++) {
+        const MetadataEntry& e = meta.get_const(i);
+        if (e.valid_flag && e.storage == STORAGE_TAIL && !meta_bad[i])
+            tails.note(e.tail_block, e.tail_offset, (uint32_t)(e.total_size % blockman.payload_size()));
+    }
+
+    // MVCC generations
+    gens.init(&fsm);
 
     return true;
 }
 
+// ==========================================================
+// SYNC (write-back)
+// ==========================================================
+bool FileSystem::sync() {
+    if (!is_open || file_image.empty()) return false;
+
+    pack_tails();
+
+    const uint8_t* img = file_image.data();
+
+    // metadata table, vault records and free map are small, write them
+    // whole; a snapshot's table never changes
+    bool ok = true;
+    if (!read_only)
+        ok = io.write(tree_meta_offset, img + tree_meta_offset, layout.meta_size);
+    if (layout.vault_size)
+        ok = io.write(layout.vault_offset, img + layout.vault_offset, layout.vault_size) && ok;
+    ok = io.write(layout.free_map_offset, img + layout.free_map_offset, layout.free_map_size) && ok;
+
+    std::vector<uint32_t> slots;
+    meta.take_inline_dirty(slots);
+    for (uint32_t i : slots) {
+        uint64_t off = tree_inline_offset + (uint64_t)i * INLINE_CAPACITY;
+        ok = io.write(off, img + off, INLINE_CAPACITY) && ok;
+    }
+
+    // snapshot slots taken or freed since the last sync
+    for (uint32_t i = 0; i < snap_dirty.size(); i++) {
+        if (!snap_dirty[i]) continue;
+        snap_dirty[i] = 0;
+        ok = io.write(slot_offset(i), img + slot_offset(i), layout.snap_slot_size) && ok;
+    }
+
+    // data blocks still dirty in the cache, then the sums and fingerprints
+    // of every block changed since the last sync
+    uint64_t errors = cache.failed_io();
+    cache.flush();
+    ok = ok && cache.failed_io() == errors;
+    std::vector<uint32_t> dirty;
+    blockman.take_dirty(dirty);
+    std::sort(dirty.begin(), dirty.end());
+    if (blockman.has_checksums()) {
+        for (uint32_t b : dirty) {
+            uint64_t off = layout.sum_offset + (uint64_t)b * 4;
+            ok = io.write(off, img + off, 4) && ok;
+        }
+    }
+    if (blockman.refcounted()) {
+        for (uint32_t b : dirty) {
+            uint64_t off = layout.fp_offset + (uint64_t)b * sizeof(Fingerprint);
+            ok = io.write(off, img + off, sizeof(Fingerprint)) && ok;
+        }
+    }
+    return ok;
+}
+
+void FileSystem::io_step(uint32_t max_blocks) {
+    if (!is_open || file_image.empty()) return;
+    cache.poll();
+    cache.write_behind(max_blocks);
+}
+
+uint32_t FileSystem::scrub_step(uint32_t max_blocks) {
+    if (!is_open || config.verify_mode != VERIFY_SCRUB) return 0;
+    return blockman.scrub(max_blocks);
+}
+
 // ==========================================================
 // SHUTDOWN
 // ==========================================================
 void FileSystem::shutdown() {
-    for (auto* s : sessions) delete s;
+    for (auto* r : snapshots) delete r;
+    snapshots.clear();
+    gens.reset();
+
+    if (is_open && !file_image.empty()) sync();
+
+    session_timers.init(now_timestamp());
+    sessions.for_each([](uint64_t, ActiveSession* s) { delete s; });
     sessions.clear();
-    close_stream();
+    sessions_by_token.clear();
+    close_file();
 }
 
 // ==========================================================
@@ -277,23 +626,76 @@ OFSErrorCodes FileSystem::user_login(const char* username,
     if (!users[idx].is_active)
         return OFSErrorCodes::ERROR_NOT_FOUND;
 
-    ActiveSession* s = new ActiveSession;
-    s->info = SessionInfo("session-ID", users[idx], now_timestamp());
-    sessions.push_back(s);
+    if (!password) password = "";
+    PasswordCheck pc = passwords.verify(idx, password, users[idx], now_timestamp());
+    if (pc == PasswordCheck::LEGACY) {
+        // Containers formatted before hashing stored no password at all.
+        // The admin can still prove itself with the configured password,
+        // which upgrades the record; other legacy accounts must be recreated.
+        if (users[idx].role != UserRole::ADMIN ||
+            strncmp(password, config.admin_password, sizeof(config.admin_password)) != 0)
+            return OFSErrorCodes::ERROR_PERMISSION_DENIED;
+        passwords.make_record(password, users[idx]);
+        flush_user_slot(idx);
+    } else if (pc == PasswordCheck::MISMATCH) {
+        return OFSErrorCodes::ERROR_PERMISSION_DENIED;
+    }
 
-    *out_session = s;
+    ActiveSession* s = new ActiveSession;
+    do {
+        random_token(s->token);
+    } while (sessions_by_token.contains(s->token));
+
+    char id[33];
+    token_to_hex(s->token, id);
+    s->info = SessionInfo(id, users[idx], now_timestamp());
+    memset(s->info.user.password_hash, 0, sizeof(s->info.user.password_hash));
+    s->handle = next_session_handle++;
+    s->user_index = (uint32_t)idx;
+    s->role = users[idx].role;
+
+    sessions.put(s->handle, s);
+    sessions_by_token.put(s->token, s);
+
+    s->timer.id = s->handle;
+    uint64_t deadline = session_deadline(s);
+    if (deadline) session_timers.schedule(&s->timer, deadline);
+
+    *out_session = (void*)(uintptr_t)s->handle;
     return OFSErrorCodes::SUCCESS;
 }
 
 OFSErrorCodes FileSystem::user_logout(void* session) {
-    for (size_t i = 0; i < sessions.size(); i++) {
-        if (sessions[i] == session) {
-            delete sessions[i];
-            sessions.erase(sessions.begin() + i);
-            return OFSErrorCodes::SUCCESS;
-        }
-    }
-    return OFSErrorCodes::ERROR_INVALID_SESSION;
+    ActiveSession** found = sessions.find((uint64_t)(uintptr_t)session);
+    if (!found) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    ActiveSession* s = *found;
+
+    // a session's snapshots die with it
+    for (size_t j = snapshots.size(); j-- > 0; )
+        if (snapshots[j]->owner == s)
+            snapshot_close(snapshots[j]);
+
+    session_timers.cancel(&s->timer);
+    sessions.erase(s->handle);
+    sessions_by_token.erase(s->token);
+    delete s;
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::session_lookup(const char* session_id, void** out_session) {
+    SessionToken t;
+    if (!session_id || !hex_to_token(session_id, t))
+        return OFSErrorCodes::ERROR_INVALID_SESSION;
+    return session_lookup(t.bytes, out_session);
+}
+
+OFSErrorCodes FileSystem::session_lookup(const uint8_t token[16], void** out_session) {
+    SessionToken t;
+    memcpy(t.bytes, token, 16);
+    ActiveSession** s = sessions_by_token.find(t);
+    if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    *out_session = (void*)(uintptr_t)(*s)->handle;
+    return OFSErrorCodes::SUCCESS;
 }
 
 OFSErrorCodes FileSystem::user_create(void* admin,
@@ -307,15 +709,16 @@ OFSErrorCodes FileSystem::user_create(void* admin,
     if (find_user_index(username) >= 0)
         return OFSErrorCodes::ERROR_FILE_EXISTS;
 
-    for (auto& u : users) {
-        if (!u.is_active) {
-            u = UserInfo(username, "HASH", role, now_timestamp());
-            u.is_active = 1;
-            flush_users_to_disk();
-            return OFSErrorCodes::SUCCESS;
-        }
-    }
-    return OFSErrorCodes::ERROR_NO_SPACE;
+    int slot = user_index.take_slot();
+    if (slot < 0) return OFSErrorCodes::ERROR_NO_SPACE;
+
+    UserInfo& u = users[slot];
+    u = UserInfo(username, "", role, now_timestamp());
+    u.is_active = 1;
+    passwords.make_record(password ? password : "", u);
+    user_index.add(u.username, slot);
+    flush_user_slot(slot);
+    return OFSErrorCodes::SUCCESS;
 }
 
 OFSErrorCodes FileSystem::user_delete(void* admin, const char* username) {
@@ -325,8 +728,9 @@ OFSErrorCodes FileSystem::user_delete(void* admin, const char* username) {
     int idx = find_user_index(username);
     if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
 
+    user_index.remove(users[idx].username, idx);
     users[idx].is_active = 0;
-    flush_users_to_disk();
+    flush_user_slot(idx);
     return OFSErrorCodes::SUCCESS;
 }
 
@@ -380,7 +784,7 @@ bool FileSystem::has_permission(const ActiveSession* sess,
     // For now simplified: all can read, admin can write
     if (!write_needed) return true;
 
-    if (sess->info.user.role == UserRole::ADMIN)
+    if (sess->role == UserRole::ADMIN)
         return true;
 
     return false;
@@ -411,6 +815,434 @@ OFSErrorCodes FileSystem::allocate_file_entry(
     return OFSErrorCodes::SUCCESS;
 }
 
+// Free a file's chain, or hand it to the generation manager when a snapshot
+// reader may still be walking it. Blocks another chain shares stay.
+void FileSystem::release_chain(uint32_t inode, uint32_t start) {
+    if (!gens.has_readers(inode)) {
+        blockman.free_block_chain(start);
+        return;
+    }
+    std::vector<uint32_t> old;
+    blockman.unlink_chain(start, old);
+    gens.retire(old);
+}
+
+void FileSystem::write_inline(int idx, uint64_t off, const uint8_t* data, uint64_t n,
+                              uint64_t old_size) {
+    uint8_t* slot = meta.inline_data(idx);
+    if (off > old_size) {
+        static const uint8_t zero[INLINE_CAPACITY] = { 0 };
+        codec.encode_copy(slot + old_size, zero, off - old_size);
+    }
+    codec.encode_copy(slot + off, data, n);
+    meta.mark_inline_dirty(idx);
+}
+
+// Snapshot readers of an inline file hold their own copy, so the new chain
+// is private until the entry is written.
+OFSErrorCodes FileSystem::promote_inline(int idx, MetadataEntry& e) {
+    int blk = blockman.allocate_block();
+    if (blk < 0) return OFSErrorCodes::ERROR_NO_SPACE;
+
+    uint8_t plain[INLINE_CAPACITY];
+    codec.decode_copy(plain, meta.inline_data(idx), e.total_size);
+    if (e.total_size > 0 && blockman.write_file(blk, 0, plain, e.total_size) < 0) {
+        blockman.free_block_chain(blk);
+        return OFSErrorCodes::ERROR_NO_SPACE;
+    }
+
+    e.storage = STORAGE_CHAIN;
+    e.start_index = blk;
+    return OFSErrorCodes::SUCCESS;
+}
+
+int FileSystem::read_blocks(const MetadataEntry& e, uint64_t off, uint8_t* out, uint64_t n) {
+    if (e.storage == STORAGE_COMPRESSED) return read_compressed(e, off, out, n);
+    if (e.storage != STORAGE_TAIL) return blockman.read_file(e.start_index, off, out, n);
+
+    uint64_t payload = blockman.payload_size();
+    uint64_t full = e.total_size / payload * payload;
+    if (off < full) {
+        uint64_t k = std::min<uint64_t>(n, full - off);
+        if (blockman.read_file(e.start_index, off, out, k) < 0) return -1;
+        off += k;
+        out += k;
+        n -= k;
+    }
+    if (n == 0) return 1;
+    return blockman.read_at(e.tail_block, e.tail_offset + (uint32_t)(off - full), out, (uint32_t)n);
+}
+
+void FileSystem::queue_tail(int idx) {
+    if (!(header.feature_flags & OMNI_FEATURE_TAILS) || tail_queued[idx]) return;
+    tail_queued[idx] = 1;
+    tail_queue.push_back(idx);
+}
+
+uint32_t FileSystem::pack_tails() {
+    if (!is_open || read_only || tail_queue.empty()) return 0;
+
+    std::vector<uint32_t> pending;
+    pending.swap(tail_queue);
+    uint32_t packed = 0;
+    for (uint32_t idx : pending) {
+        tail_queued[idx] = 0;
+        // a snapshot may still walk the last block; retry on a later pass
+        if (gens.has_readers(idx)) queue_tail(idx);
+        else if (pack_tail(idx)) packed++;
+    }
+    return packed;
+}
+
+// Tails over half a block keep their block: packing them saves little and
+// an append would soon unpack them again.
+bool FileSystem::pack_tail(int idx) {
+    MetadataEntry e;
+    meta.read_entry(idx, e);
+    if (!e.valid_flag || e.type_flag != 0 || e.storage != STORAGE_CHAIN || meta_bad[idx])
+        return false;
+
+    uint32_t payload = blockman.payload_size();
+    uint32_t tail = (uint32_t)(e.total_size % payload);
+    uint64_t nfull = e.total_size / payload;
+    if (tail == 0 || tail > payload / 2) return false;
+
+    uint32_t prev = 0xFFFFFFFF, last = e.start_index;
+    for (uint64_t i = 0; i < nfull; i++) {
+        prev = last;
+        last = blockman.get_next(last);
+        if (last == 0xFFFFFFFF) return false;
+    }
+    // relinking would touch shared blocks; an indexed tail is worth more
+    // for deduplicating the next identical file
+    if (blockman.chain_shared(e.start_index, 0, e.total_size) || blockman.indexed(last))
+        return false;
+
+    uint32_t fb, off;
+    if (!tails.alloc(tail, fb, off)) return false;
+    if (blockman.copy_payload(fb, off, last, 0, tail) < 0) {
+        tails.release(fb, off, tail);
+        return false;
+    }
+
+    if (prev == 0xFFFFFFFF) e.start_index = 0xFFFFFFFF;
+    else blockman.set_next(prev, 0xFFFFFFFF);
+    blockman.free_block_chain(last);
+
+    e.storage = STORAGE_TAIL;
+    e.tail_block = fb;
+    e.tail_offset = (uint16_t)off;
+    meta.write_entry(idx, e);
+    return true;
+}
+
+// Snapshot readers copied the tail at open and read only the full blocks
+// from the chain, so relinking the last full block is invisible to them.
+// Another tree sharing the chain would see it, though: a shared chain is
+// copied whole instead, as a write to its last block would copy it.
+OFSErrorCodes FileSystem::unpack_tail(int idx, MetadataEntry& e) {
+    uint32_t payload = blockman.payload_size();
+    uint32_t tail = (uint32_t)(e.total_size % payload);
+    uint64_t nfull = e.total_size / payload;
+
+    if (nfull && blockman.chain_shared(e.start_index, 0, nfull * payload)) {
+        std::vector<uint8_t> img(e.total_size);
+        if (read_blocks(e, 0, img.data(), img.size()) < 0) return OFSErrorCodes::ERROR_IO_ERROR;
+        uint32_t start = 0xFFFFFFFF;
+        OFSErrorCodes rc = write_chain(img, start);
+        if (rc != OFSErrorCodes::SUCCESS) return rc;
+        tails.release(e.tail_block, e.tail_offset, tail);
+        release_chain(idx, e.start_index);
+        e.start_index = start;
+        e.storage = STORAGE_CHAIN;
+        return OFSErrorCodes::SUCCESS;
+    }
+
+    int nb = blockman.allocate_block();
+    if (nb < 0) return OFSErrorCodes::ERROR_NO_SPACE;
+    if (blockman.copy_payload(nb, 0, e.tail_block, e.tail_offset, tail) < 0) {
+        blockman.free_block_chain(nb);
+        return OFSErrorCodes::ERROR_IO_ERROR;
+    }
+
+    if (nfull == 0) {
+        e.start_index = nb;
+    } else {
+        uint32_t last = e.start_index;
+        for (uint64_t i = 1; i < nfull; i++) last = blockman.get_next(last);
+        blockman.set_next(last, nb);
+    }
+    tails.release(e.tail_block, e.tail_offset, tail);
+    e.storage = STORAGE_CHAIN;
+    return OFSErrorCodes::SUCCESS;
+}
+
+void FileSystem::release_content(uint32_t inode, const MetadataEntry& e) {
+    if (e.storage == STORAGE_INLINE) return;
+    if (e.storage == STORAGE_TAIL)
+        tails.release(e.tail_block, e.tail_offset, (uint32_t)(e.total_size % blockman.payload_size()));
+    if (e.start_index != 0xFFFFFFFF) release_chain(inode, e.start_index);
+}
+
+int FileSystem::read_content(int idx, const MetadataEntry& e, uint64_t off, uint8_t* out, uint64_t n) {
+    if (n == 0) return 1;
+    if (e.storage == STORAGE_INLINE) {
+        codec.decode_copy(out, meta.inline_data(idx) + off, n);
+        return 1;
+    }
+    return read_blocks(e, off, out, n);
+}
+
+// ==========================================================
+// DELTA VAULT
+// ==========================================================
+// Numbers keep rising even when a version cannot be kept. Without space
+// for its delta, the file's older versions go too: they could not be
+// rebuilt across the gap.
+void FileSystem::keep_version(uint32_t idx, const MetadataEntry& prev, MetadataEntry& e,
+                              uint64_t off, uint64_t len,
+                              const std::vector<uint8_t>* bytes, uint32_t chain)
+{
+    e.versions = prev.versions + 1;
+
+    VaultRecord old;
+    if (bytes) {
+        chain = 0xFFFFFFFF;
+        while (len && write_chain(*bytes, chain) != OFSErrorCodes::SUCCESS) {
+            if (!vault.pop_oldest(old)) {
+                drop_versions(idx);
+                return;
+            }
+            release_version(old);
+        }
+    }
+
+    VaultRecord r;
+    memset(&r, 0, sizeof(r));
+    r.inode = idx;
+    r.version = e.versions;
+    r.modified_time = prev.modified_time;
+    r.replaced_time = e.modified_time;
+    r.size = prev.total_size;
+    r.delta_off = off;
+    r.delta_len = len;
+    r.delta_start = len ? chain : 0xFFFFFFFF;
+    while (!vault.add(r) && vault.pop_oldest(old)) release_version(old);
+}
+
+// a truncated chain may still be walked by a snapshot reader of the file
+void FileSystem::release_version(const VaultRecord& r) {
+    if (r.delta_start != 0xFFFFFFFF) release_chain(r.inode, r.delta_start);
+}
+
+void FileSystem::drop_versions(uint32_t idx) {
+    std::vector<VaultRecord> gone;
+    vault.take_all(idx, gone);
+    for (const VaultRecord& r : gone) release_version(r);
+}
+
+// ==========================================================
+// COMPRESSED FILES
+// ==========================================================
+// bytes an extent takes in the chain, slack included
+static uint32_t slot_size(uint32_t w) {
+    return (w & COMPRESS_LEN_MASK) + ((w & ~COMPRESS_RAW) >> COMPRESS_SLACK_SHIFT);
+}
+
+// The len file bytes of the extent stored at p: p itself when raw, else
+// decoded into plain. Null if the extent is corrupt.
+static const uint8_t* extent_content(const uint8_t* p, uint32_t w, uint32_t len,
+                                     std::vector<uint8_t>& plain) {
+    uint32_t n = w & COMPRESS_LEN_MASK;
+    if (w & COMPRESS_RAW) return n == len ? p : nullptr;
+    plain.resize(len);
+    return lz4_decompress(p, n, plain.data(), len) == (long)len ? plain.data() : nullptr;
+}
+
+// An extent stays raw unless LZ4 saves at least an eighth of it. A
+// compressed one gets a sixteenth more room, so an edit that packs it a
+// little larger still fits in place.
+void FileSystem::pack_extent(const uint8_t* src, uint32_t n, std::vector<uint8_t>& img,
+                             uint32_t& len_word) {
+    size_t at = img.size();
+    img.resize(at + lz4_bound(n));
+    size_t c = lz4_worth_trying(src, n) ? lz4_compress(src, n, img.data() + at, n - n / 8) : 0;
+    size_t slack = 0;
+    if (c == 0) {
+        memcpy(img.data() + at, src, n);
+        c = n;
+        len_word = n | COMPRESS_RAW;
+    } else {
+        slack = std::min<size_t>(c / 16, COMPRESS_MAX_SLACK);
+        len_word = (uint32_t)(c | slack << COMPRESS_SLACK_SHIFT);
+    }
+    img.resize(at + c);
+    img.resize(at + c + slack, 0);
+}
+
+bool FileSystem::compress_image(const uint8_t* data, uint64_t size, std::vector<uint8_t>& img) {
+    uint32_t count = (uint32_t)((size + COMPRESS_EXTENT - 1) / COMPRESS_EXTENT);
+    std::vector<uint32_t> lens(count);
+    img.assign(4 + 4ull * count, 0);
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t beg = (uint64_t)i * COMPRESS_EXTENT;
+        pack_extent(data + beg, (uint32_t)std::min<uint64_t>(COMPRESS_EXTENT, size - beg), img, lens[i]);
+    }
+    memcpy(img.data(), &count, 4);
+    memcpy(img.data() + 4, lens.data(), 4ull * count);
+    return img.size() + blockman.payload_size() <= size;
+}
+
+bool FileSystem::read_extent_table(const MetadataEntry& e, std::vector<uint32_t>& lens) {
+    uint32_t count = 0;
+    if (blockman.read_file(e.start_index, 0, (uint8_t*)&count, 4) < 0) return false;
+    if (count != (e.total_size + COMPRESS_EXTENT - 1) / COMPRESS_EXTENT) return false;
+    lens.resize(count);
+    if (count && blockman.read_file(e.start_index, 4, (uint8_t*)lens.data(), 4ull * count) < 0)
+        return false;
+    for (uint32_t w : lens)
+        if ((w & COMPRESS_LEN_MASK) > COMPRESS_EXTENT) return false;
+    return true;
+}
+
+// Only the extents overlapping the range are read, in one pass over the chain.
+int FileSystem::read_compressed(const MetadataEntry& e, uint64_t off, uint8_t* out, uint64_t n) {
+    if (n == 0) return 1;
+    std::vector<uint32_t> lens;
+    if (!read_extent_table(e, lens)) return -1;
+
+    uint32_t first = (uint32_t)(off / COMPRESS_EXTENT);
+    uint32_t last = (uint32_t)((off + n - 1) / COMPRESS_EXTENT);
+    uint64_t phys = 4 + 4ull * lens.size();
+    for (uint32_t i = 0; i < first; i++) phys += slot_size(lens[i]);
+    uint64_t span = 0;
+    for (uint32_t i = first; i <= last; i++) span += slot_size(lens[i]);
+
+    std::vector<uint8_t> stored(span);
+    if (blockman.read_file(e.start_index, phys, stored.data(), span) < 0) return -1;
+
+    std::vector<uint8_t> plain;
+    const uint8_t* p = stored.data();
+    for (uint32_t i = first; i <= last; i++) {
+        uint64_t beg = (uint64_t)i * COMPRESS_EXTENT;
+        uint32_t len = (uint32_t)std::min<uint64_t>(COMPRESS_EXTENT, e.total_size - beg);
+        const uint8_t* src = extent_content(p, lens[i], len, plain);
+        if (!src) return -1;
+        uint64_t a = std::max(off, beg);
+        uint64_t b = std::min(off + n, beg + len);
+        memcpy(out + (a - off), src + (a - beg), b - a);
+        p += slot_size(lens[i]);
+    }
+    return 1;
+}
+
+// Only the extents the edit touches are packed again. One that still fits
+// its old slot goes back there, so the extents after it keep their place
+// and the new chain shares the old one past the last block that changes.
+// An extent that outgrows its slot, or a longer extent table, moves
+// everything after it.
+OFSErrorCodes FileSystem::rewrite_compressed(MetadataEntry& e, uint64_t index,
+                                             const uint8_t* data, uint64_t size,
+                                             std::vector<uint32_t>& replaced) {
+    std::vector<uint32_t> lens;
+    if (!read_extent_table(e, lens)) return OFSErrorCodes::ERROR_IO_ERROR;
+
+    uint32_t old_count = (uint32_t)lens.size();
+    uint64_t new_size = std::max<uint64_t>(uint64_t(e.total_size), index + size);
+    uint32_t count = (uint32_t)((new_size + COMPRESS_EXTENT - 1) / COMPRESS_EXTENT);
+
+    std::vector<uint64_t> old_pos(old_count + 1);
+    old_pos[0] = 4 + 4ull * old_count;
+    for (uint32_t i = 0; i < old_count; i++) old_pos[i + 1] = old_pos[i] + slot_size(lens[i]);
+
+    // extents whose content changes; old ones past the last stay as they are
+    auto touched = [&](uint32_t i) {
+        uint64_t beg = (uint64_t)i * COMPRESS_EXTENT;
+        uint64_t len = std::min<uint64_t>(COMPRESS_EXTENT, new_size - beg);
+        if (i >= old_count || len != std::min<uint64_t>(COMPRESS_EXTENT, e.total_size - beg))
+            return true;
+        return index < beg + len && index + size > beg;
+    };
+    uint32_t last_touched = 0;
+    for (uint32_t i = 0; i < old_count; i++)
+        if (touched(i)) last_touched = i + 1;
+
+    // the old image, read as far as needed
+    std::vector<uint8_t> old;
+    auto load_old = [&](uint64_t end) {
+        if (end <= old.size()) return true;
+        uint64_t at = old.size();
+        old.resize(end);
+        return blockman.read_file(e.start_index, at, old.data() + at, end - at) >= 0;
+    };
+
+    // the new image up to the last byte that differs
+    std::vector<uint32_t> words(lens);
+    words.resize(count);
+    std::vector<uint8_t> img(4 + 4ull * count);
+    std::vector<uint8_t> plain, cur(COMPRESS_EXTENT);
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t pos = img.size();
+        if (count == old_count && i >= last_touched && pos == old_pos[i]) break;
+
+        uint64_t beg = (uint64_t)i * COMPRESS_EXTENT;
+        uint32_t len = (uint32_t)std::min<uint64_t>(COMPRESS_EXTENT, new_size - beg);
+        uint32_t old_slot = 0;
+        const uint8_t* slot = nullptr;
+        if (i < old_count) {
+            old_slot = slot_size(lens[i]);
+            if (!load_old(old_pos[i] + old_slot)) return OFSErrorCodes::ERROR_IO_ERROR;
+            slot = old.data() + old_pos[i];
+        }
+        if (!touched(i)) {
+            img.insert(img.end(), slot, slot + old_slot);
+            continue;
+        }
+
+        memset(cur.data(), 0, len);
+        if (slot) {
+            uint32_t old_len = (uint32_t)std::min<uint64_t>(COMPRESS_EXTENT, e.total_size - beg);
+            const uint8_t* src = extent_content(slot, lens[i], old_len, plain);
+            if (!src) return OFSErrorCodes::ERROR_IO_ERROR;
+            memcpy(cur.data(), src, old_len);
+        }
+        uint64_t a = std::max(index, beg);
+        uint64_t b = std::min(index + size, beg + len);
+        if (a < b) memcpy(cur.data() + (a - beg), data + (a - index), b - a);
+        pack_extent(cur.data(), len, img, words[i]);
+
+        // back into the old slot when it fits
+        uint32_t n = words[i] & COMPRESS_LEN_MASK;
+        if (n <= old_slot && old_slot - n <= COMPRESS_MAX_SLACK) {
+            img.resize(pos + old_slot, 0);
+            words[i] = (words[i] & (COMPRESS_RAW | COMPRESS_LEN_MASK)) |
+                       (old_slot - n) << COMPRESS_SLACK_SHIFT;
+        }
+    }
+    memcpy(img.data(), &count, 4);
+    memcpy(img.data() + 4, words.data(), 4ull * count);
+
+    uint32_t start = e.start_index;
+    if (blockman.cow_write_file(e.start_index, 0, img.data(), img.size(), start, replaced) < 0)
+        return OFSErrorCodes::ERROR_NO_SPACE;
+    e.start_index = start;
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::write_chain(const std::vector<uint8_t>& img, uint32_t& start) {
+    if (config.dedup && blockman.refcounted())
+        return blockman.write_dedup(img.data(), img.size(), start) < 0
+               ? OFSErrorCodes::ERROR_NO_SPACE : OFSErrorCodes::SUCCESS;
+    int blk = blockman.allocate_block();
+    if (blk < 0) return OFSErrorCodes::ERROR_NO_SPACE;
+    if (!img.empty() && blockman.write_file(blk, 0, img.data(), img.size()) < 0) {
+        blockman.free_block_chain(blk);
+        return OFSErrorCodes::ERROR_NO_SPACE;
+    }
+    start = blk;
+    return OFSErrorCodes::SUCCESS;
+}
+
 // ==========================================================
 // DIRECTORY CREATE
 // ==========================================================
@@ -420,6 +1252,7 @@ OFSErrorCodes FileSystem::allocate_file_entry(
 OFSErrorCodes FileSystem::dir_create(void* session, const char* path) {
     ActiveSession* s = find_session(session);
     if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    if (read_only) return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     std::string p(path);
     if (p == "/" || p.empty())
@@ -447,7 +1280,9 @@ OFSErrorCodes FileSystem::dir_create(void* session, const char* path) {
         return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     // duplicate?
-    if (meta.find_in_dir(parent_idx, name) >= 0)
+    char short_name[12];
+    MetadataManager::to_short_name(name, short_name);
+    if (tree.find_exact(parent_idx, short_name) >= 0)
         return OFSErrorCodes::ERROR_FILE_EXISTS;
 
     int idx = meta.allocate_entry();
@@ -465,7 +1300,7 @@ OFSErrorCodes FileSystem::dir_create(void* session, const char* path) {
     e.modified_time = now_timestamp();
 
     meta.write_entry(idx, e);
-    tree.rebuild();
+    tree.add_child(parent_idx, idx);
 
     return OFSErrorCodes::SUCCESS;
 }
@@ -476,6 +1311,7 @@ OFSErrorCodes FileSystem::dir_create(void* session, const char* path) {
 OFSErrorCodes FileSystem::dir_delete(void* session, const char* path) {
     ActiveSession* s = find_session(session);
     if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    if (read_only) return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     int idx = resolve_path(path);
     if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
@@ -486,8 +1322,8 @@ OFSErrorCodes FileSystem::dir_delete(void* session, const char* path) {
     if (!tree.is_empty_dir(idx))
         return OFSErrorCodes::ERROR_DIRECTORY_NOT_EMPTY;
 
+    tree.remove_child(meta.get_const(idx).parent_index, idx);
     meta.free_entry(idx);
-    tree.rebuild();
     return OFSErrorCodes::SUCCESS;
 }
 
@@ -508,16 +1344,46 @@ OFSErrorCodes FileSystem::dir_list(void* session,
     if (!is_dir(dir_idx))
         return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
-    // gather children
-    std::vector<FileEntry> out;
-    MetadataEntry e;
+    return list_entries(dir_idx, "", "", 0, entries, count);
+}
 
-    for (uint32_t i = 0; i < meta.capacity(); i++) {
-        meta.read_entry(i, e);
-        if (!e.valid_flag) continue;
-        if (e.parent_index != (uint32_t)dir_idx) continue;
+OFSErrorCodes FileSystem::dir_list_page(void* session,
+                                        const char* path,
+                                        const char* prefix,
+                                        const char* cursor,
+                                        uint32_t limit,
+                                        FileEntry** entries,
+                                        int* count)
+{
+    ActiveSession* s = find_session(session);
+    if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
 
-        FileEntry fe;
+    int dir_idx = resolve_path(path);
+    if (dir_idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
+
+    if (!is_dir(dir_idx))
+        return OFSErrorCodes::ERROR_INVALID_OPERATION;
+
+    return list_entries(dir_idx, prefix ? prefix : "", cursor ? cursor : "", limit,
+                        entries, count);
+}
+
+// Children in name order, straight from the directory index.
+OFSErrorCodes FileSystem::list_entries(int dir_idx,
+                                       const std::string& prefix,
+                                       const std::string& cursor,
+                                       uint32_t limit,
+                                       FileEntry** entries,
+                                       int* count)
+{
+    std::vector<int> idx;
+    if (!tree.list(dir_idx, prefix, cursor, limit, idx))
+        return OFSErrorCodes::ERROR_NOT_FOUND;
+
+    std::vector<FileEntry> out(idx.size());
+    for (size_t k = 0; k < idx.size(); k++) {
+        const MetadataEntry& e = meta.get_const(idx[k]);
+        FileEntry& fe = out[k];
         strncpy(fe.name, e.short_name, 255);
         fe.name[255] = '\0';
 
@@ -526,9 +1392,7 @@ OFSErrorCodes FileSystem::dir_list(void* session,
         fe.permissions = e.permissions;
         fe.created_time = e.created_time;
         fe.modified_time = e.modified_time;
-        fe.inode = i;
-
-        out.push_back(fe);
+        fe.inode = idx[k];
     }
 
     *count = out.size();
@@ -548,6 +1412,7 @@ OFSErrorCodes FileSystem::file_create(void* session,
 {
     ActiveSession* s = find_session(session);
     if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    if (read_only) return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     std::string p(path);
     size_t pos = p.find_last_of('/');
@@ -564,7 +1429,9 @@ OFSErrorCodes FileSystem::file_create(void* session,
     if (!is_dir(dir_idx))
         return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
-    if (meta.find_in_dir(dir_idx, name) >= 0)
+    char short_name[12];
+    MetadataManager::to_short_name(name, short_name);
+    if (tree.find_exact(dir_idx, short_name) >= 0)
         return OFSErrorCodes::ERROR_FILE_EXISTS;
 
     // allocate metadata
@@ -581,23 +1448,48 @@ e.short_name[10] = '\0';
     e.created_time = now_timestamp();
     e.modified_time = now_timestamp();
 
-    // allocate first block
-    int blk = blockman.allocate_block();
-    if (blk < 0) return OFSErrorCodes::ERROR_NO_SPACE;
-
-    e.start_index = blk;
-    e.total_size = 0;
-
-    if (size > 0) {
-        if (blockman.write_file(blk, 0, (uint8_t*)data, size) < 0) {
-            blockman.free_block_chain(blk);
-            return OFSErrorCodes::ERROR_IO_ERROR;
-        }
+    std::vector<uint8_t> img;
+    if (meta.has_inline() && size <= INLINE_CAPACITY) {
+        // small: no block at all until the file outgrows its slot
+        e.storage = STORAGE_INLINE;
+        e.start_index = 0xFFFFFFFF;
         e.total_size = size;
+        write_inline(idx, 0, (const uint8_t*)data, size, 0);
+    } else if (config.compression && (header.feature_flags & OMNI_FEATURE_COMPRESS) &&
+               size > blockman.payload_size() &&
+               compress_image((const uint8_t*)data, size, img)) {
+        uint32_t start;
+        OFSErrorCodes rc = write_chain(img, start);
+        if (rc != OFSErrorCodes::SUCCESS) return rc;
+        e.storage = STORAGE_COMPRESSED;
+        e.start_index = start;
+        e.total_size = size;
+    } else if (config.dedup && blockman.refcounted()) {
+        uint32_t start;
+        if (blockman.write_dedup((const uint8_t*)data, size, start) < 0)
+            return OFSErrorCodes::ERROR_NO_SPACE;
+        e.start_index = start;
+        e.total_size = size;
+    } else {
+        // allocate first block
+        int blk = blockman.allocate_block();
+        if (blk < 0) return OFSErrorCodes::ERROR_NO_SPACE;
+
+        e.start_index = blk;
+        e.total_size = 0;
+
+        if (size > 0) {
+            if (blockman.write_file(blk, 0, (uint8_t*)data, size) < 0) {
+                blockman.free_block_chain(blk);
+                return OFSErrorCodes::ERROR_IO_ERROR;
+            }
+            e.total_size = size;
+        }
     }
 
     meta.write_entry(idx, e);
-    tree.rebuild();
+    tree.add_child(dir_idx, idx);
+    if (e.storage == STORAGE_CHAIN) queue_tail(idx);
 
     return OFSErrorCodes::SUCCESS;
 }
@@ -619,6 +1511,8 @@ OFSErrorCodes FileSystem::file_read(
 
     if (!is_file(idx))
         return OFSErrorCodes::ERROR_INVALID_OPERATION;
+    if (meta_bad[idx])
+        return OFSErrorCodes::ERROR_IO_ERROR;
 
     MetadataEntry e;
     meta.read_entry(idx, e);
@@ -626,10 +1520,13 @@ OFSErrorCodes FileSystem::file_read(
     *out_size = e.total_size;
     *out_buffer = (char*)malloc(e.total_size + 1);
 
-    if (blockman.read_file(e.start_index, 0,
-                           (uint8_t*)*out_buffer,
-                           e.total_size) < 0)
+    if (e.storage == STORAGE_INLINE) {
+        codec.decode_copy((uint8_t*)*out_buffer, meta.inline_data(idx), e.total_size);
+    } else if (read_blocks(e, 0, (uint8_t*)*out_buffer, e.total_size) < 0) {
+        free(*out_buffer);
+        *out_buffer = nullptr;
         return OFSErrorCodes::ERROR_IO_ERROR;
+    }
 
     (*out_buffer)[e.total_size] = '\0';
     return OFSErrorCodes::SUCCESS;
@@ -647,20 +1544,87 @@ OFSErrorCodes FileSystem::file_edit(
 {
     ActiveSession* s = find_session(session);
     if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    if (read_only) return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     int idx = resolve_path(path);
     if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
+    if (meta_bad[idx]) return OFSErrorCodes::ERROR_IO_ERROR;
 
     MetadataEntry e;
     meta.read_entry(idx, e);
+    MetadataEntry prev = e;
+
+    // the blocks the edit overwrites, as they are now, for the vault
+    std::vector<uint8_t> before;
+    uint64_t before_off = 0;
+    if (versioning()) {
+        uint64_t payload = blockman.payload_size();
+        before_off = std::min<uint64_t>(index / payload * payload, uint64_t(e.total_size));
+        uint64_t end = std::min<uint64_t>(((uint64_t)index + size + payload - 1) / payload * payload,
+                                          uint64_t(e.total_size));
+        before.resize(end > before_off ? end - before_off : 0);
+        if (read_content(idx, e, before_off, before.data(), before.size()) < 0)
+            return OFSErrorCodes::ERROR_IO_ERROR;
+    }
 
-    if (blockman.write_file(e.start_index, index,
-                            (uint8_t*)data, size) < 0)
+    std::vector<uint32_t> replaced;
+    uint32_t old_chain = 0xFFFFFFFF;
+
+    // writes go to a plain chain; the tail is packed again afterwards
+    if (e.storage == STORAGE_TAIL) {
+        OFSErrorCodes rc = unpack_tail(idx, e);
+        if (rc != OFSErrorCodes::SUCCESS) return rc;
+    }
+
+    if (e.storage == STORAGE_COMPRESSED) {
+        // never in place, so snapshot readers keep the old extents
+        uint32_t old_start = e.start_index;
+        OFSErrorCodes rc = rewrite_compressed(e, index, (const uint8_t*)data, size, replaced);
+        if (rc != OFSErrorCodes::SUCCESS) return rc;
+        if (blockman.refcounted()) {
+            old_chain = old_start;
+            replaced.clear();
+        }
+    } else if (e.storage == STORAGE_INLINE) {
+        if (std::max<uint64_t>(uint64_t(e.total_size), (uint64_t)index + size) <= INLINE_CAPACITY) {
+            write_inline(idx, index, (const uint8_t*)data, size, e.total_size);
+        } else {
+            OFSErrorCodes rc = promote_inline(idx, e);
+            if (rc != OFSErrorCodes::SUCCESS) return rc;
+            if (blockman.write_file(e.start_index, index, (uint8_t*)data, size) < 0) {
+                blockman.free_block_chain(e.start_index);
+                return OFSErrorCodes::ERROR_NO_SPACE;
+            }
+        }
+    } else if ((size > 0 && gens.has_readers(idx)) ||
+               blockman.chain_shared(e.start_index, index, size)) {
+        // a snapshot or another file still sees the current chain: write a
+        // new version
+        uint32_t new_start = e.start_index;
+        if (blockman.cow_write_file(e.start_index, index, (uint8_t*)data,
+                                    size, new_start, replaced) < 0)
+            return OFSErrorCodes::ERROR_NO_SPACE;
+        if (blockman.refcounted()) {
+            // the copied blocks may be shared too; release by reference
+            old_chain = e.start_index;
+            replaced.clear();
+        }
+        e.start_index = new_start;
+    } else if (blockman.write_file(e.start_index, index,
+                                   (uint8_t*)data, size) < 0) {
         return OFSErrorCodes::ERROR_IO_ERROR;
+    }
 
-    e.total_size = std::max<uint64_t>(e.total_size, index + size);
+    e.total_size = std::max<uint64_t>(uint64_t(e.total_size), index + size);
     e.modified_time = now_timestamp();
+    if (versioning())
+        keep_version(idx, prev, e, before_off, before.size(), &before, 0xFFFFFFFF);
     meta.write_entry(idx, e);
+    if (e.storage == STORAGE_CHAIN) queue_tail(idx);
+
+    gens.publish();
+    gens.retire(replaced);
+    if (old_chain != 0xFFFFFFFF) release_chain(idx, old_chain);
 
     return OFSErrorCodes::SUCCESS;
 }
@@ -673,6 +1637,7 @@ OFSErrorCodes FileSystem::file_delete(void* session,
 {
     ActiveSession* s = find_session(session);
     if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    if (read_only) return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     int idx = resolve_path(path);
     if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
@@ -683,13 +1648,13 @@ OFSErrorCodes FileSystem::file_delete(void* session,
     MetadataEntry e;
     meta.read_entry(idx, e);
 
-    // free block chain
-    blockman.free_block_chain(e.start_index);
-
-    // free metadata
+    // free metadata, then the chain (deferred if a snapshot holds it)
+    tree.remove_child(e.parent_index, idx);
     meta.free_entry(idx);
+    gens.publish();
+    release_content(idx, e);
+    if (versioning()) drop_versions(idx);
 
-    tree.rebuild();
     return OFSErrorCodes::SUCCESS;
 }
 
@@ -701,6 +1666,7 @@ OFSErrorCodes FileSystem::file_truncate(void* session,
 {
     ActiveSession* s = find_session(session);
     if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    if (read_only) return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     int idx = resolve_path(path);
     if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
@@ -711,21 +1677,456 @@ OFSErrorCodes FileSystem::file_truncate(void* session,
     MetadataEntry e;
     meta.read_entry(idx, e);
 
-    blockman.free_block_chain(e.start_index);
+    MetadataEntry old = e;
 
-    // allocate fresh empty block
-    int blk = blockman.allocate_block();
-    if (blk < 0) return OFSErrorCodes::ERROR_NO_SPACE;
+    // a plain chain is kept by the vault as it is; other kinds are copied
+    bool adopt = versioning() && old.total_size > 0 && old.storage == STORAGE_CHAIN;
+    std::vector<uint8_t> before;
+    if (versioning() && old.total_size > 0 && !adopt) {
+        before.resize(old.total_size);
+        if (read_content(idx, old, 0, before.data(), before.size()) < 0)
+            return OFSErrorCodes::ERROR_IO_ERROR;
+    }
 
-    e.start_index = blk;
+    if (meta.has_inline()) {
+        // an empty file needs no block
+        e.storage = STORAGE_INLINE;
+        e.start_index = 0xFFFFFFFF;
+    } else {
+        // allocate fresh empty block
+        int blk = blockman.allocate_block();
+        if (blk < 0) return OFSErrorCodes::ERROR_NO_SPACE;
+        e.storage = STORAGE_CHAIN;
+        e.start_index = blk;
+    }
     e.total_size = 0;
     e.modified_time = now_timestamp();
+    if (adopt)
+        keep_version(idx, old, e, 0, old.total_size, nullptr, old.start_index);
+    else if (!before.empty())
+        keep_version(idx, old, e, 0, before.size(), &before, 0xFFFFFFFF);
 
     meta.write_entry(idx, e);
+    gens.publish();
+    if (!adopt) release_content(idx, old);
+
+    return OFSErrorCodes::SUCCESS;
+}
+
+// ==========================================================
+// FILE VERSIONS
+// ==========================================================
+OFSErrorCodes FileSystem::file_list_versions(void* session,
+                                             const char* path,
+                                             FileVersion** out_versions,
+                                             int* out_count)
+{
+    ActiveSession* s = find_session(session);
+    if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+
+    int idx = resolve_path(path);
+    if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
+
+    if (!is_file(idx))
+        return OFSErrorCodes::ERROR_INVALID_OPERATION;
+
+    const std::vector<uint32_t>* list = versioning() ? vault.versions(idx) : nullptr;
+    size_t n = list ? list->size() : 0;
+    *out_count = (int)n;
+    *out_versions = (FileVersion*)malloc(std::max<size_t>(n, 1) * sizeof(FileVersion));
+    for (size_t i = 0; i < n; i++) {
+        const VaultRecord& r = vault.record((*list)[i]);
+        FileVersion& v = (*out_versions)[i];
+        v.version = r.version;
+        v.size = r.size;
+        v.modified_time = r.modified_time;
+        v.replaced_time = r.replaced_time;
+    }
+    return OFSErrorCodes::SUCCESS;
+}
+
+// The current content with the deltas of every newer version undone, newest
+// first; reads the file once and each of those deltas once.
+OFSErrorCodes FileSystem::file_read_version(void* session,
+                                            const char* path,
+                                            uint32_t version,
+                                            char** out_buffer,
+                                            size_t* out_size)
+{
+    ActiveSession* s = find_session(session);
+    if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+
+    int idx = resolve_path(path);
+    if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
+
+    if (!is_file(idx))
+        return OFSErrorCodes::ERROR_INVALID_OPERATION;
+    if (meta_bad[idx])
+        return OFSErrorCodes::ERROR_IO_ERROR;
+
+    const std::vector<uint32_t>* list = versioning() ? vault.versions(idx) : nullptr;
+    if (!list || version < vault.record(list->front()).version ||
+        version > vault.record(list->back()).version)
+        return OFSErrorCodes::ERROR_NOT_FOUND;
+
+    MetadataEntry e;
+    meta.read_entry(idx, e);
+
+    std::vector<uint8_t> content(e.total_size);
+    if (read_content(idx, e, 0, content.data(), content.size()) < 0)
+        return OFSErrorCodes::ERROR_IO_ERROR;
+
+    for (size_t i = list->size(); i-- > 0;) {
+        const VaultRecord& r = vault.record((*list)[i]);
+        if (r.version < version) break;
+        if (r.delta_off > r.size || r.delta_len > r.size - r.delta_off)
+            return OFSErrorCodes::ERROR_IO_ERROR;
+        content.resize(r.size);
+        if (r.delta_len && blockman.read_file(r.delta_start, 0, content.data() + r.delta_off,
+                                              r.delta_len) < 0)
+            return OFSErrorCodes::ERROR_IO_ERROR;
+    }
 
+    *out_size = content.size();
+    *out_buffer = (char*)malloc(content.size() + 1);
+    memcpy(*out_buffer, content.data(), content.size());
+    (*out_buffer)[content.size()] = '\0';
     return OFSErrorCodes::SUCCESS;
 }
 
+// ==========================================================
+// CONTAINER SNAPSHOTS
+// ==========================================================
+int FileSystem::find_slot(const char* name) {
+    if (!name || !name[0]) return -1;
+    for (uint32_t i = 0; i < header.snapshot_slots && layout.snap_size; i++) {
+        const SnapshotRecord& r = slot_record(i);
+        if (r.name[0] && strncmp(r.name, name, sizeof(r.name)) == 0) return (int)i;
+    }
+    return -1;
+}
+
+void FileSystem::tree_view(int slot, MetadataManager& m) {
+    uint64_t meta_off = slot < 0 ? layout.meta_offset : slot_offset(slot) + sizeof(SnapshotRecord);
+    uint64_t inline_off = slot < 0 ? layout.inline_offset : meta_off + layout.meta_size;
+    m.init(file_image.data(), meta_off, config.max_files);
+    m.set_checksums((header.feature_flags & OMNI_FEATURE_CHECKSUMS) != 0);
+    m.set_inline((header.feature_flags & OMNI_FEATURE_INLINE) ? inline_off : 0);
+}
+
+// A tree holds one reference on each chain head (the rest of the chain is
+// reached through it) and one on each packed tail. Damaged entries hold
+// none, as at mount. Returns the number of files.
+uint32_t FileSystem::reference_tree(MetadataManager& m, TreeRef op) {
+    uint32_t payload = blockman.payload_size();
+    uint32_t files = 0;
+    for (uint32_t i = 0; i < config.max_files; i++) {
+        const MetadataEntry& e = m.get_const(i);
+        if (!e.valid_flag || e.type_flag != 0 || !m.verify_entry(i)) continue;
+        files++;
+
+        if (e.storage == STORAGE_TAIL) {
+            uint32_t len = (uint32_t)(e.total_size % payload);
+            if (op == TREE_RELEASE) tails.release(e.tail_block, e.tail_offset, len);
+            else tails.note(e.tail_block, e.tail_offset, len);
+        }
+        if (e.storage == STORAGE_INLINE || e.start_index == 0xFFFFFFFF) continue;
+
+        switch (op) {
+        case TREE_MOUNT:
+            blockman.count_refs(e.start_index);
+            break;
+        case TREE_SHARE:
+            blockman.share_chain(e.start_index);
+            break;
+        case TREE_RELEASE:
+            // a reader pinned in the mounted tree may walk the same blocks
+            if (gens.any_pinned()) {
+                std::vector<uint32_t> old;
+                blockman.unlink_chain(e.start_index, old);
+                gens.retire(old);
+            } else {
+                blockman.free_block_chain(e.start_index);
+            }
+            break;
+        }
+    }
+    return files;
+}
+
+OFSErrorCodes FileSystem::claim_slot(const char* name, uint32_t& slot) {
+    if (!layout.snap_size) return OFSErrorCodes::ERROR_INVALID_OPERATION;
+    if (!name || !name[0] || strlen(name) >= sizeof(SnapshotRecord::name))
+        return OFSErrorCodes::ERROR_INVALID_PATH;
+    if (find_slot(name) >= 0) return OFSErrorCodes::ERROR_FILE_EXISTS;
+
+    for (uint32_t i = 0; i < header.snapshot_slots; i++) {
+        if (!slot_record(i).name[0]) {
+            slot = i;
+            return OFSErrorCodes::SUCCESS;
+        }
+    }
+    return OFSErrorCodes::ERROR_NO_SPACE;
+}
+
+void FileSystem::seal_slot(uint32_t slot, const char* name, uint32_t files, bool writable) {
+    SnapshotRecord& r = slot_record(slot);
+    memset(&r, 0, sizeof(r));
+    strncpy(r.name, name, sizeof(r.name) - 1);
+    r.created_time = now_timestamp();
+    r.files = files;
+    r.writable = writable ? 1 : 0;
+    if (header.feature_flags & OMNI_FEATURE_CHECKSUMS) r.crc = crc32c(&r, sizeof(r));
+    snap_dirty[slot] = 1;
+}
+
+// The tables are resident, so taking a snapshot copies them in memory and
+// adds a reference per file; no data block is read or written. Blocks the
+// tree shares with the snapshot are copied on the next write to them.
+OFSErrorCodes FileSystem::container_snapshot(void* admin_session, const char* name) {
+    if (!session_is_admin(admin_session))
+        return OFSErrorCodes::ERROR_PERMISSION_DENIED;
+
+    uint32_t slot;
+    OFSErrorCodes rc = claim_slot(name, slot);
+    if (rc != OFSErrorCodes::SUCCESS) return rc;
+
+    uint8_t* img = file_image.data();
+    uint64_t to = slot_offset(slot) + sizeof(SnapshotRecord);
+    memcpy(img + to, img + tree_meta_offset, layout.meta_size);
+    memcpy(img + to + layout.meta_size, img + tree_inline_offset, layout.inline_size);
+
+    MetadataManager m;
+    tree_view((int)slot, m);
+    seal_slot(slot, name, reference_tree(m, TREE_SHARE), false);
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::container_clone(void* admin_session, const char* snapshot, const char* name) {
+    if (!session_is_admin(admin_session))
+        return OFSErrorCodes::ERROR_PERMISSION_DENIED;
+
+    int from = find_slot(snapshot);
+    if (from < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
+
+    uint32_t slot;
+    OFSErrorCodes rc = claim_slot(name, slot);
+    if (rc != OFSErrorCodes::SUCCESS) return rc;
+
+    uint8_t* img = file_image.data();
+    memcpy(img + slot_offset(slot) + sizeof(SnapshotRecord),
+           img + slot_offset(from) + sizeof(SnapshotRecord),
+           layout.snap_slot_size - sizeof(SnapshotRecord));
+
+    MetadataManager m;
+    tree_view((int)slot, m);
+    seal_slot(slot, name, reference_tree(m, TREE_SHARE), true);
+    return OFSErrorCodes::SUCCESS;
+}
+
+// Blocks no other tree references are freed with the slot.
+OFSErrorCodes FileSystem::container_snapshot_delete(void* admin_session, const char* name) {
+    if (!session_is_admin(admin_session))
+        return OFSErrorCodes::ERROR_PERMISSION_DENIED;
+
+    int slot = find_slot(name);
+    if (slot < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
+    if (slot == tree_slot) return OFSErrorCodes::ERROR_INVALID_OPERATION;
+
+    MetadataManager m;
+    tree_view(slot, m);
+    reference_tree(m, TREE_RELEASE);
+
+    memset(&slot_record(slot), 0, sizeof(SnapshotRecord));
+    snap_dirty[slot] = 1;
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::container_snapshot_list(void* session,
+                                                  SnapshotInfo** out_snapshots,
+                                                  int* out_count)
+{
+    ActiveSession* s = find_session(session);
+    if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+
+    std::vector<SnapshotInfo> list;
+    for (uint32_t i = 0; i < header.snapshot_slots && layout.snap_size; i++) {
+        const SnapshotRecord& r = slot_record(i);
+        if (!r.name[0]) continue;
+        SnapshotInfo info;
+        memset(&info, 0, sizeof(info));
+        memcpy(info.name, r.name, sizeof(info.name));
+        info.created_time = r.created_time;
+        info.files = r.files;
+        info.writable = r.writable;
+        info.mounted = (int)i == tree_slot;
+        list.push_back(info);
+    }
+
+    *out_count = (int)list.size();
+    *out_snapshots = (SnapshotInfo*)malloc(std::max<size_t>(list.size(), 1) * sizeof(SnapshotInfo));
+    if (!list.empty()) memcpy(*out_snapshots, list.data(), list.size() * sizeof(SnapshotInfo));
+    return OFSErrorCodes::SUCCESS;
+}
+
+// ==========================================================
+// SNAPSHOT READS
+// ==========================================================
+OFSErrorCodes FileSystem::snapshot_open(void* session,
+                                        const char* path,
+                                        void** out_snapshot,
+                                        uint64_t* out_size,
+                                        bool* out_streamable)
+{
+    ActiveSession* s = find_session(session);
+    if (!s) return OFSErrorCodes::ERROR_INVALID_SESSION;
+
+    int idx = resolve_path(path);
+    if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
+
+    if (!is_file(idx))
+        return OFSErrorCodes::ERROR_INVALID_OPERATION;
+    if (meta_bad[idx])
+        return OFSErrorCodes::ERROR_IO_ERROR;
+
+    ReadSnapshot* r = new ReadSnapshot;
+    r->owner = s;
+    r->inode = idx;
+    meta.read_entry(idx, r->entry);
+    r->generation = gens.pin(idx);
+    r->cursor_blk = r->entry.start_index;
+    r->cursor_off = 0;
+    if (r->entry.storage == STORAGE_INLINE) {
+        r->content_copy.resize(r->entry.total_size);
+        codec.decode_copy(r->content_copy.data(), meta.inline_data(idx), r->entry.total_size);
+    } else if (r->entry.storage == STORAGE_TAIL) {
+        uint32_t tail = (uint32_t)(r->entry.total_size % blockman.payload_size());
+        r->content_copy.resize(tail);
+        if (blockman.read_at(r->entry.tail_block, r->entry.tail_offset, r->content_copy.data(), tail) < 0) {
+            gens.unpin(r->generation, idx);
+            delete r;
+            return OFSErrorCodes::ERROR_IO_ERROR;
+        }
+    }
+    snapshots.push_back(r);
+
+    *out_snapshot = r;
+    if (out_size) *out_size = r->entry.total_size;
+    // inline content lives in the metadata slot; compressed or encoded
+    // content on disk has to be decoded first
+    if (out_streamable)
+        *out_streamable = codec.is_identity() && r->entry.storage != STORAGE_INLINE &&
+                          r->entry.storage != STORAGE_COMPRESSED;
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::snapshot_read(void* snapshot,
+                                        uint64_t offset,
+                                        char* buffer,
+                                        size_t len,
+                                        size_t* out_read)
+{
+    ReadSnapshot* r = find_snapshot(snapshot);
+    if (!r) return OFSErrorCodes::ERROR_INVALID_SESSION;
+
+    *out_read = 0;
+    if (offset >= r->entry.total_size) return OFSErrorCodes::SUCCESS;
+
+    uint64_t n = std::min<uint64_t>(len, r->entry.total_size - offset);
+    if (r->entry.storage == STORAGE_COMPRESSED) {
+        if (read_compressed(r->entry, offset, (uint8_t*)buffer, n) < 0)
+            return OFSErrorCodes::ERROR_IO_ERROR;
+        *out_read = n;
+        return OFSErrorCodes::SUCCESS;
+    }
+
+    uint64_t full = r->entry.total_size;        // bytes held in the chain
+    if (r->entry.storage == STORAGE_INLINE) full = 0;
+    else if (r->entry.storage == STORAGE_TAIL) full -= r->content_copy.size();
+
+    uint64_t k = offset < full ? std::min<uint64_t>(n, full - offset) : 0;
+    if (k > 0 && blockman.read_file(r->entry.start_index, offset, (uint8_t*)buffer, k, &r->ra) < 0)
+        return OFSErrorCodes::ERROR_IO_ERROR;
+    if (k < n)
+        memcpy(buffer + k, r->content_copy.data() + (offset + k - full), n - k);
+
+    *out_read = n;
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::snapshot_next_extent(void* snapshot,
+                                               uint64_t* out_offset,
+                                               uint64_t* out_len)
+{
+    ReadSnapshot* r = find_snapshot(snapshot);
+    if (!r) return OFSErrorCodes::ERROR_INVALID_SESSION;
+
+    *out_len = 0;
+    if (r->cursor_off >= r->entry.total_size) return OFSErrorCodes::SUCCESS;
+    // inline and compressed content is not stored as a run of file bytes
+    if (r->entry.storage == STORAGE_INLINE || r->entry.storage == STORAGE_COMPRESSED)
+        return OFSErrorCodes::ERROR_INVALID_OPERATION;
+
+    // a packed tail is the last extent, inside a shared fragment block
+    if (r->entry.storage == STORAGE_TAIL &&
+        r->cursor_off == r->entry.total_size - r->content_copy.size()) {
+        *out_offset = blockman.block_offset(r->entry.tail_block) + 4 + r->entry.tail_offset;
+        *out_len = r->content_copy.size();
+        r->cursor_off = r->entry.total_size;
+        return OFSErrorCodes::SUCCESS;
+    }
+    if (r->cursor_blk == 0xFFFFFFFF) return OFSErrorCodes::SUCCESS;
+
+    if (!blockman.check_read(r->cursor_blk)) return OFSErrorCodes::ERROR_IO_ERROR;
+
+    uint64_t n = std::min<uint64_t>(blockman.payload_size(),
+                                    r->entry.total_size - r->cursor_off);
+    *out_offset = blockman.block_offset(r->cursor_blk) + 4;
+    *out_len = n;
+
+    r->cursor_off += n;
+    r->cursor_blk = blockman.get_next(r->cursor_blk);
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::snapshot_flush(void* snapshot) {
+    ReadSnapshot* r = find_snapshot(snapshot);
+    if (!r) return OFSErrorCodes::ERROR_INVALID_SESSION;
+
+    // full blocks of the chain, then the fragment holding a packed tail
+    std::vector<uint32_t> blocks;
+    uint64_t chain_bytes = r->entry.total_size - r->content_copy.size();
+    uint32_t blk = r->entry.start_index;
+    for (uint64_t at = 0; at < chain_bytes && blk != 0xFFFFFFFF; at += blockman.payload_size()) {
+        blocks.push_back(blk);
+        blk = blockman.get_next(blk);
+    }
+    if (r->entry.storage == STORAGE_TAIL) blocks.push_back(uint32_t(r->entry.tail_block));
+
+    uint64_t errors = cache.failed_io();
+    cache.flush(blocks);
+    return cache.failed_io() == errors ? OFSErrorCodes::SUCCESS : OFSErrorCodes::ERROR_IO_ERROR;
+}
+
+OFSErrorCodes FileSystem::snapshot_detach(void* snapshot) {
+    ReadSnapshot* r = find_snapshot(snapshot);
+    if (!r) return OFSErrorCodes::ERROR_INVALID_SESSION;
+    r->owner = nullptr;
+    return OFSErrorCodes::SUCCESS;
+}
+
+OFSErrorCodes FileSystem::snapshot_close(void* snapshot) {
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        if (snapshots[i] == snapshot) {
+            gens.unpin(snapshots[i]->generation, snapshots[i]->inode);
+            delete snapshots[i];
+            snapshots.erase(snapshots.begin() + i);
+            return OFSErrorCodes::SUCCESS;
+        }
+    }
+    return OFSErrorCodes::ERROR_INVALID_SESSION;
+}
+
 // ==========================================================
 // METADATA
 // ==========================================================
@@ -768,6 +2169,7 @@ OFSErrorCodes FileSystem::set_permissions(
 {
     if (!session_is_admin(session))
         return OFSErrorCodes::ERROR_PERMISSION_DENIED;
+    if (read_only) return OFSErrorCodes::ERROR_INVALID_OPERATION;
 
     int idx = resolve_path(path);
     if (idx < 0) return OFSErrorCodes::ERROR_NOT_FOUND;
@@ -794,6 +2196,7 @@ OFSErrorCodes FileSystem::get_stats(void* session,
                   layout.data_size);
 
     stats.total_users = header.max_users;
+    stats.active_sessions = (uint32_t)sessions.size();
     stats.total_files = 0;
     stats.total_directories = 0;
 
@@ -3,16 +3,30 @@
 
 #include <string>
 #include <vector>
-#include <fstream>
 #include <cstdint>
 #include <cstring>
 
 #include "../include/odf_types.hpp"    // OMNIHeader, UserInfo, SessionInfo, FSStats, FileEntry...
 #include "config_parser.cpp"             // FSConfig + parse_uconf
+#include "crc32c.cpp"
+#include "lz4.cpp"
 #include "MetadataManager.cpp"
 #include "directory_tree.cpp"
 #include "FreeSpaceManager.cpp"
+#include "hash128.cpp"
+#include "DedupIndex.cpp"
+#include "FileIo.cpp"
+#include "BlockCache.cpp"
 #include "BlockManager.cpp"
+#include "TailPacker.cpp"
+#include "GenerationManager.cpp"
+#include "DeltaVault.cpp"
+#include "TimerWheel.cpp"
+#include "UserManager.h"
+#include "sha256.cpp"
+#include "PasswordHasher.cpp"
+#include "SecurityManager.cpp"
+#include "../data_structures/HashTable.h"
 
 // ===============================
 // On-disk layout information
@@ -26,9 +40,25 @@ struct FSLayout {
     uint64_t meta_offset;
     uint64_t meta_size;
 
+    uint64_t inline_offset;     // inline slots, empty without OMNI_FEATURE_INLINE
+    uint64_t inline_size;
+
+    uint64_t vault_offset;      // Delta Vault records, empty without OMNI_FEATURE_VAULT
+    uint64_t vault_size;
+
+    uint64_t snap_offset;       // container snapshot slots, empty without OMNI_FEATURE_SNAPSHOTS
+    uint64_t snap_slot_size;    // SnapshotRecord, metadata table, inline slots
+    uint64_t snap_size;
+
     uint64_t free_map_offset;
     uint64_t free_map_size;
 
+    uint64_t sum_offset;        // per-block CRC32C, empty without checksums
+    uint64_t sum_size;
+
+    uint64_t fp_offset;         // per-block Fingerprint, empty without dedup
+    uint64_t fp_size;
+
     uint64_t data_offset;
     uint64_t data_size;
 
@@ -38,8 +68,49 @@ struct FSLayout {
 // ===============================
 // In-memory active session
 // ===============================
+// 128-bit random session token; info.session_id holds it as 32 hex chars.
+struct SessionToken {
+    uint8_t bytes[16];
+
+    bool operator<(const SessionToken& o) const { return memcmp(bytes, o.bytes, 16) < 0; }
+};
+
+// tokens are random, so their first 8 bytes already are a good hash
+struct SessionTokenHash {
+    unsigned long long operator()(const SessionToken& t) const {
+        unsigned long long h;
+        memcpy(&h, t.bytes, sizeof(h));
+        return h;
+    }
+};
+
 struct ActiveSession {
     SessionInfo info;   // includes user info + timestamps + ops count
+    SessionToken token;
+    uint64_t handle;    // the void* given to callers; never reused
+    uint32_t user_index;
+    UserRole role;
+    TimerNode timer;    // idle / lifetime expiry
+};
+
+// ===============================
+// Pinned read snapshot (MVCC)
+// ===============================
+struct ReadSnapshot {
+    ActiveSession* owner;
+    uint32_t inode;
+    uint64_t generation;   // generation pinned at open
+    MetadataEntry entry;   // metadata as published at that generation
+
+    // cursor for snapshot_next_extent
+    uint32_t cursor_blk;
+    uint64_t cursor_off;
+
+    ReadAhead ra;          // for snapshot_read
+
+    // decoded inline content or packed tail, copied at open since both are
+    // updated in place
+    std::vector<uint8_t> content_copy;
 };
 
 // ===============================
@@ -55,8 +126,14 @@ public:
     // ===============================
     bool format_new(const FSConfig& cfg, const char* omni_path);
     bool load_existing(const FSConfig& cfg, const char* omni_path);
+    // mounts the named container snapshot (read-only) or clone (writable)
+    // instead of the container's own tree
+    bool load_snapshot(const FSConfig& cfg, const char* omni_path, const char* name);
     void shutdown();
 
+    // write metadata, free map and every dirty block back to the container
+    bool sync();
+
     // ===============================
     // USER + SESSION MANAGEMENT
     // ===============================
@@ -81,6 +158,15 @@ public:
     OFSErrorCodes get_session_info(void* session,
                                    SessionInfo* out_info);
 
+    // Session handle for a token, as 32 hex chars (SessionInfo::session_id)
+    // or 16 raw bytes, so a request can authenticate without connection state.
+    OFSErrorCodes session_lookup(const char* session_id, void** out_session);
+    OFSErrorCodes session_lookup(const uint8_t token[16], void** out_session);
+
+    // Logs out sessions past their idle or lifetime limit. Cheap enough to
+    // call on every server loop; returns the number expired.
+    uint32_t expire_sessions();
+
     // ===============================
     // DIRECTORY OPERATIONS (Phase 2)
     // ===============================
@@ -88,6 +174,19 @@ public:
     OFSErrorCodes dir_delete(void* session, const char* path);
     OFSErrorCodes dir_list(void* session, const char* path, FileEntry** entries, int* count);
 
+    // Ordered, paginated listing: names starting with `prefix` (case-
+    // insensitive) that sort after `cursor`, page_cursor() of the last entry
+    // of the previous page ("" or null to start). A bare name as cursor
+    // skips every entry with that name. At most `limit` entries, 0 = all.
+    OFSErrorCodes dir_list_page(void* session, const char* path, const char* prefix,
+                                const char* cursor, uint32_t limit,
+                                FileEntry** entries, int* count);
+    // "name/inode": names differing only in case sort by inode, so the
+    // name alone cannot say where a page ended
+    static std::string page_cursor(const FileEntry& fe) {
+        return std::string(fe.name) + "/" + std::to_string(fe.inode);
+    }
+
     // ===============================
     // FILE OPERATIONS (Phase 2)
     // ===============================
@@ -113,6 +212,108 @@ public:
     OFSErrorCodes file_truncate(void* session,
                                 const char* path);
 
+    // ===============================
+    // DELTA VAULT (earlier versions)
+    // ===============================
+    // In a container formatted with vault_slots, file_edit and file_truncate
+    // hand the version they replace to the vault. Only the blocks a change
+    // overwrites are copied; a truncated chain is kept as it is. When the
+    // table or the free space runs out, the oldest versions are dropped.
+    OFSErrorCodes file_list_versions(void* session,
+                                     const char* path,
+                                     FileVersion** out_versions,
+                                     int* out_count);
+
+    OFSErrorCodes file_read_version(void* session,
+                                    const char* path,
+                                    uint32_t version,
+                                    char** out_buffer,
+                                    size_t* out_size);
+
+    // ===============================
+    // CONTAINER SNAPSHOTS
+    // ===============================
+    // In a container formatted with snapshot_slots, a snapshot copies the
+    // mounted tree's metadata table and inline slots and takes a reference
+    // on every chain and packed tail; no data block is copied. Writers then
+    // copy the blocks they change, as for blocks shared by dedup. A clone
+    // is a writable copy of a snapshot. Admin only, except the listing.
+    OFSErrorCodes container_snapshot(void* admin_session, const char* name);
+    OFSErrorCodes container_clone(void* admin_session, const char* snapshot, const char* name);
+    OFSErrorCodes container_snapshot_delete(void* admin_session, const char* name);
+    OFSErrorCodes container_snapshot_list(void* session, SnapshotInfo** out_snapshots, int* out_count);
+
+    // true when mounted on a snapshot: file and directory changes fail
+    bool is_read_only() const { return read_only; }
+
+    // ===============================
+    // SNAPSHOT READS (MVCC)
+    // ===============================
+    // A snapshot pins the file as it is at open time. Writers that touch the
+    // file afterwards copy the affected blocks instead of overwriting them,
+    // so a large read can be split into chunks without blocking writers.
+    // *out_streamable tells whether snapshot_next_extent can walk the
+    // content as stored bytes; when false it has to go through snapshot_read.
+    OFSErrorCodes snapshot_open(void* session,
+                                const char* path,
+                                void** out_snapshot,
+                                uint64_t* out_size,
+                                bool* out_streamable = nullptr);
+
+    OFSErrorCodes snapshot_read(void* snapshot,
+                                uint64_t offset,
+                                char* buffer,
+                                size_t len,
+                                size_t* out_read);
+
+    OFSErrorCodes snapshot_close(void* snapshot);
+
+    // Walks the snapshot block by block as byte ranges of the container
+    // file (the 4-byte next pointer is skipped), so a caller can stream the
+    // content straight from disk. *out_len is 0 at the end. Call
+    // snapshot_flush() first so the on-disk bytes are current.
+    OFSErrorCodes snapshot_next_extent(void* snapshot,
+                                       uint64_t* out_offset,
+                                       uint64_t* out_len);
+
+    // Writes back the snapshot's blocks still dirty in the cache, and only
+    // those.
+    OFSErrorCodes snapshot_flush(void* snapshot);
+
+    // Hands the snapshot over to the caller: it no longer closes with its
+    // session, only through snapshot_close().
+    OFSErrorCodes snapshot_detach(void* snapshot);
+
+    // Background verification for VERIFY_SCRUB: checks up to max_blocks
+    // more blocks and returns how many failed. No-op in other modes.
+    uint32_t scrub_step(uint32_t max_blocks);
+    // blocks and metadata entries that failed their checksum since mount
+    uint64_t integrity_errors() const { return blockman.failures() + meta_errors; }
+
+    // Packs the final partial block of recently written files into shared
+    // fragment blocks. Runs at sync; the server also calls it every loop.
+    uint32_t pack_tails();
+
+    // false when on-disk content is stored as-is, so extents may be sent
+    // without decoding
+    bool content_encoded() const { return !codec.is_identity(); }
+
+    const BlockCache& block_cache() const { return cache; }
+
+    // Background I/O for the server loop: collects finished reads and
+    // writes and starts writing back up to max_blocks dirty blocks, so
+    // eviction and sync find less to write. Only the io_uring backend has
+    // anything in flight; with pread this is a no-op.
+    void io_step(uint32_t max_blocks);
+    // readable when io_step has completions to collect; -1 without io_uring
+    int io_event_fd() const { return io.event_fd(); }
+    const char* io_backend_name() const { return io.backend_name(); }
+    // true when config.direct_io took effect for this mount
+    bool direct_io() const { return io.direct(); }
+
+    // blocks written by file_create that were shared with an identical one
+    uint64_t dedup_hits() const { return dedup.hit_count(); }
+
     // ===============================
     // METADATA + PERMISSIONS
     // ===============================
@@ -136,6 +337,7 @@ public:
     const FSConfig&   get_config() const { return config; }
     const OMNIHeader& get_header() const { return header; }
     const FSLayout&   get_layout() const { return layout; }
+    const std::string& get_path() const { return omni_path; }
 
 private:
     // ===============================
@@ -145,12 +347,35 @@ private:
     OMNIHeader header;
     FSLayout   layout;
 
-    std::fstream stream;
+    FileIo io;
     bool is_open;
     std::string omni_path;
 
+    std::vector<uint8_t> file_image;    // everything before the data region, managers point into it
     std::vector<UserInfo> users;
-    std::vector<ActiveSession*> sessions;
+    UserManager user_index;             // username -> slot in `users`
+    PasswordHasher passwords;
+    SecurityManager codec;              // content encoding from the header
+    std::vector<uint8_t> meta_bad;      // entries that failed their crc at mount
+    TailPacker tails;
+    std::vector<uint32_t> tail_queue;   // files written since the last pack_tails
+    std::vector<uint8_t> tail_queued;
+    uint64_t meta_errors;
+    // Handles are opaque counters rather than pointers, so a stale handle
+    // can never alias a newer session.
+    HashTable<uint64_t, ActiveSession*> sessions;
+    HashTable<SessionToken, ActiveSession*, SessionTokenHash> sessions_by_token;
+    uint64_t next_session_handle;
+    TimerWheel session_timers;          // one-second ticks
+    std::vector<ReadSnapshot*> snapshots;
+
+    // the tree this mount works on: the container's own (-1) or a
+    // snapshot slot
+    int tree_slot;
+    bool read_only;
+    uint64_t tree_meta_offset;
+    uint64_t tree_inline_offset;
+    std::vector<uint8_t> snap_dirty;    // slots to write at the next sync
 
     // ===============================
     // MANAGERS (Phase 2)
@@ -158,33 +383,91 @@ private:
     MetadataManager meta;
     DirectoryTree   tree;
     FreeSpaceManager fsm;
+    DedupIndex       dedup;
+    BlockCache       cache;             // the data region
     BlockManager     blockman;
+    GenerationManager gens;
+    DeltaVault       vault;
 
     // ===============================
     // INTERNAL HELPERS
     // ===============================
     bool compute_layout();
-    bool open_stream(bool write);
-    void close_stream();
+    bool open_file(bool truncate);
+    void close_file();
 
     bool load_header();
     bool load_users_from_disk();
     bool flush_users_to_disk();
+    bool flush_user_slot(uint32_t idx);
 
     int  find_user_index(const char* username) const;
-    bool session_is_admin(void* session) const;
-    ActiveSession* find_session(void* session) const;
+    bool session_is_admin(void* session);
+    ActiveSession* find_session(void* session);
+    uint64_t session_deadline(const ActiveSession* s) const;
+    ReadSnapshot* find_snapshot(void* snapshot) const;
 
     static uint64_t now_timestamp();
 
     // ------- INTERNAL FS HELPERS -------
     int resolve_path(const char* path);
+    OFSErrorCodes list_entries(int dir_idx, const std::string& prefix, const std::string& cursor,
+                               uint32_t limit, FileEntry** entries, int* count);
     bool is_dir(int meta_idx);
     bool is_file(int meta_idx);
     bool has_permission(const ActiveSession* sess, const MetadataEntry& e, bool write_needed);
     OFSErrorCodes allocate_file_entry(int parent_idx,
                                       const std::string& name,
                                       uint32_t& out_meta_idx);
+    void release_chain(uint32_t inode, uint32_t start);
+    // inline slot content [off, off+n), zero-filling any gap past old_size
+    void write_inline(int idx, uint64_t off, const uint8_t* data, uint64_t n, uint64_t old_size);
+    // moves an inline file's content into a new block chain
+    OFSErrorCodes promote_inline(int idx, MetadataEntry& e);
+
+    // chain or packed-tail content [off, off+n), n within total_size
+    int read_blocks(const MetadataEntry& e, uint64_t off, uint8_t* out, uint64_t n);
+    void queue_tail(int idx);
+    bool pack_tail(int idx);
+    // moves a packed tail back into a block at the end of the chain
+    OFSErrorCodes unpack_tail(int idx, MetadataEntry& e);
+    // frees whatever blocks and fragments hold the content of e
+    void release_content(uint32_t inode, const MetadataEntry& e);
+    // content [off, off+n) of any storage kind
+    int read_content(int idx, const MetadataEntry& e, uint64_t off, uint8_t* out, uint64_t n);
+
+    // Delta Vault; keep_version records prev's bytes [off, off+len), taken
+    // from `bytes`, or already in `chain` when bytes is null
+    void keep_version(uint32_t idx, const MetadataEntry& prev, MetadataEntry& e, uint64_t off,
+                      uint64_t len, const std::vector<uint8_t>* bytes, uint32_t chain);
+    void release_version(const VaultRecord& r);
+    void drop_versions(uint32_t idx);
+    bool versioning() const { return vault.enabled() && tree_slot < 0; }
+
+    // container snapshots
+    enum TreeRef { TREE_MOUNT, TREE_SHARE, TREE_RELEASE };
+    bool mount(const FSConfig& cfg, const char* path, const char* snapshot);
+    uint64_t slot_offset(uint32_t slot) const { return layout.snap_offset + slot * layout.snap_slot_size; }
+    SnapshotRecord& slot_record(uint32_t slot) { return *(SnapshotRecord*)(file_image.data() + slot_offset(slot)); }
+    int find_slot(const char* name);
+    // a manager over the tables of a slot, or of the container's tree (-1)
+    void tree_view(int slot, MetadataManager& m);
+    // counts at mount, adds or drops the references a tree holds on chains
+    // and packed tails; returns the number of files
+    uint32_t reference_tree(MetadataManager& m, TreeRef op);
+    OFSErrorCodes claim_slot(const char* name, uint32_t& slot);
+    void seal_slot(uint32_t slot, const char* name, uint32_t files, bool writable);
+
+    // compressed files; compress_image is false when compression saves no block
+    bool compress_image(const uint8_t* data, uint64_t size, std::vector<uint8_t>& img);
+    void pack_extent(const uint8_t* src, uint32_t n, std::vector<uint8_t>& img, uint32_t& len_word);
+    bool read_extent_table(const MetadataEntry& e, std::vector<uint32_t>& lens);
+    int read_compressed(const MetadataEntry& e, uint64_t off, uint8_t* out, uint64_t n);
+    // writes [index, index+size) into a new chain that shares the old one
+    // past the last extent that changes; replaced as for cow_write_file
+    OFSErrorCodes rewrite_compressed(MetadataEntry& e, uint64_t index, const uint8_t* data, uint64_t size,
+                                     std::vector<uint32_t>& replaced);
+    OFSErrorCodes write_chain(const std::vector<uint8_t>& img, uint32_t& start);
 };
 
 #endif // FILE_SYSTEM_H
@@ -0,0 +1,70 @@
+#include "GenerationManager.h"
+
+void GenerationManager::init(FreeSpaceManager* free_mgr) {
+    fsm = free_mgr;
+    current = 1;
+    pins.clear();
+    readers.clear();
+    retired.clear();
+}
+
+uint64_t GenerationManager::pin(uint32_t inode) {
+    pins[current]++;
+    readers[inode]++;
+    return current;
+}
+
+void GenerationManager::unpin(uint64_t gen, uint32_t inode) {
+    auto p = pins.find(gen);
+    if (p != pins.end() && --p->second == 0) pins.erase(p);
+
+    auto r = readers.find(inode);
+    if (r != readers.end() && --r->second == 0) readers.erase(r);
+
+    reclaim();
+}
+
+bool GenerationManager::has_readers(uint32_t inode) const {
+    return readers.count(inode) != 0;
+}
+
+// The caller has already published the new version, so the blocks stop
+// being visible from generation `current` onward.
+void GenerationManager::retire(std::vector<uint32_t>& blocks) {
+    if (blocks.empty()) return;
+
+    Retired r;
+    r.gen = current;
+    r.blocks.swap(blocks);
+    retired.push_back(std::move(r));
+
+    reclaim();
+}
+
+// Retired batches are ordered by generation; a batch can be freed when the
+// oldest pinned snapshot is already at or past the generation that dropped it.
+uint32_t GenerationManager::reclaim() {
+    uint64_t oldest = pins.empty() ? UINT64_MAX : pins.begin()->first;
+    uint32_t freed = 0;
+
+    while (!retired.empty() && retired.front().gen <= oldest) {
+        for (uint32_t b : retired.front().blocks) {
+            fsm->free_block(b);
+            freed++;
+        }
+        retired.pop_front();
+    }
+    return freed;
+}
+
+uint32_t GenerationManager::pending_blocks() const {
+    uint32_t n = 0;
+    for (const auto& r : retired) n += (uint32_t)r.blocks.size();
+    return n;
+}
+
+void GenerationManager::reset() {
+    pins.clear();
+    readers.clear();
+    reclaim();
+}
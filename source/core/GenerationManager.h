@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+
+#include "FreeSpaceManager.h"
+
+// Tracks the global write generation, the generations pinned by open
+// snapshot readers, and blocks that were replaced by copy-on-write but may
+// still be visible to one of those readers.
+class GenerationManager {
+private:
+    struct Retired {
+        uint64_t gen;                   // first generation that no longer sees these blocks
+        std::vector<uint32_t> blocks;
+    };
+
+    uint64_t current;
+    std::map<uint64_t, uint32_t> pins;              // generation -> reader count
+    std::unordered_map<uint32_t, uint32_t> readers; // inode -> reader count
+    std::deque<Retired> retired;
+
+    FreeSpaceManager* fsm;
+
+public:
+    GenerationManager() {
+        current = 1;
+        fsm = nullptr;
+    }
+
+    void init(FreeSpaceManager* free_mgr);
+
+    uint64_t generation() const { return current; }
+    uint64_t publish() { return ++current; }
+
+    // snapshot pins
+    uint64_t pin(uint32_t inode);
+    void unpin(uint64_t gen, uint32_t inode);
+    bool has_readers(uint32_t inode) const;
+    bool any_pinned() const { return !pins.empty(); }
+
+    // blocks replaced at the current generation; freed once unpinned
+    void retire(std::vector<uint32_t>& blocks);
+    uint32_t reclaim();
+    uint32_t pending_blocks() const;
+
+    // drop every pin and release all retired blocks (shutdown)
+    void reset();
+};
@@ -1,14 +1,37 @@
 #include "MetadataManager.h"
 #include <cstring>
+#include <algorithm>
 #include <iostream>
 
 bool MetadataManager::init(void* file, uint64_t off, uint32_t count) {
     base = file;
     offset = off;
     max_entries = count;
+    inline_offset = 0;
+    inline_dirty.clear();
+    inline_dirty_list.clear();
     return true;
 }
 
+void MetadataManager::set_inline(uint64_t off) {
+    inline_offset = off;
+    inline_dirty.assign(off ? (max_entries + 7) / 8 : 0, 0);
+    inline_dirty_list.clear();
+}
+
+void MetadataManager::mark_inline_dirty(int idx) {
+    uint8_t bit = (uint8_t)(1u << (idx & 7));
+    if (inline_dirty[idx >> 3] & bit) return;
+    inline_dirty[idx >> 3] |= bit;
+    inline_dirty_list.push_back(idx);
+}
+
+void MetadataManager::take_inline_dirty(std::vector<uint32_t>& out) {
+    out.clear();
+    out.swap(inline_dirty_list);
+    for (uint32_t i : out) inline_dirty[i >> 3] &= (uint8_t)~(1u << (i & 7));
+}
+
 int MetadataManager::allocate_entry() {
     for (uint32_t i = 0; i < max_entries; i++) {
         MetadataEntry e;
@@ -31,9 +54,27 @@ bool MetadataManager::write_entry(int idx, const MetadataEntry& e) {
     if (idx < 0 || idx >= (int)max_entries) return false;
     uint8_t* ptr = (uint8_t*)base + offset + idx * sizeof(MetadataEntry);
     memcpy(ptr, &e, sizeof(MetadataEntry));
+    if (checksums && e.valid_flag)
+        ((MetadataEntry*)ptr)->crc = entry_crc(e, has_inline() ? inline_data(idx) : nullptr);
     return true;
 }
 
+uint32_t MetadataManager::entry_crc(const MetadataEntry& e, const uint8_t* inline_bytes) {
+    MetadataEntry c;
+    memcpy(&c, &e, sizeof(c));
+    c.crc = 0;
+    uint32_t crc = crc32c(&c, sizeof(c));
+    if (e.storage == STORAGE_INLINE && inline_bytes)
+        crc = crc32c_extend(crc, inline_bytes, (size_t)std::min<uint64_t>(uint64_t(e.total_size), INLINE_CAPACITY));
+    return crc;
+}
+
+bool MetadataManager::verify_entry(int idx) const {
+    const MetadataEntry& e = get_const(idx);
+    if (!checksums || !e.valid_flag) return true;
+    return e.crc == entry_crc(e, has_inline() ? inline_data(idx) : nullptr);
+}
+
 bool MetadataManager::read_entry(int idx, MetadataEntry& e) {
     if (idx < 0 || idx >= (int)max_entries) return false;
     uint8_t* ptr = (uint8_t*)base + offset + idx * sizeof(MetadataEntry);
@@ -2,20 +2,30 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <vector>
 #include "config_parser.h"
 #include "../include/ofs_internal.h"   
+#include "crc32c.h"
 
 class MetadataManager {
 private:
     void* base;             
     uint64_t offset;        
     uint32_t max_entries;   
+    bool checksums;         // stamp MetadataEntry::crc on every write
+
+    // inline slots, INLINE_CAPACITY bytes per entry (0 = none)
+    uint64_t inline_offset;
+    std::vector<uint8_t> inline_dirty;
+    std::vector<uint32_t> inline_dirty_list;
 
 public:
     MetadataManager() {
         base = nullptr;
         offset = 0;
         max_entries = 0;
+        checksums = false;
+        inline_offset = 0;
     }
     static void to_short_name(const std::string &src, char dest[12]) {
     memset(dest, 0, 12);
@@ -33,6 +43,23 @@ public:
     bool write_entry(int idx, const MetadataEntry& e);
     bool read_entry(int idx, MetadataEntry& e);
 
+    void set_checksums(bool on) { checksums = on; }
+    // inline_bytes is the entry's slot; only read for STORAGE_INLINE entries
+    static uint32_t entry_crc(const MetadataEntry& e, const uint8_t* inline_bytes = nullptr);
+    static void stamp(MetadataEntry& e) { e.crc = entry_crc(e); }
+    // false when a valid entry does not match its stored crc
+    bool verify_entry(int idx) const;
+
+    // inline slots (the region follows the table)
+    void set_inline(uint64_t off);
+    bool has_inline() const { return inline_offset != 0; }
+    uint8_t* inline_data(int idx) const {
+        return (uint8_t*)base + inline_offset + (uint64_t)idx * INLINE_CAPACITY;
+    }
+    // call after changing a slot, before write_entry re-stamps the crc
+    void mark_inline_dirty(int idx);
+    void take_inline_dirty(std::vector<uint32_t>& out);
+
     // directory search
     int find_in_dir(uint32_t parent, const std::string& name);
 
@@ -0,0 +1,65 @@
+#include "PasswordHasher.h"
+#include <random>
+
+PasswordHasher::PasswordHasher() {
+    iterations = DEFAULT_ITERATIONS;
+    random_bytes(pepper, sizeof(pepper));
+}
+
+void PasswordHasher::random_bytes(uint8_t* out, size_t n) {
+    static std::random_device rd;
+    for (size_t i = 0; i < n; i += 4) {
+        uint32_t r = rd();
+        memcpy(out + i, &r, n - i < 4 ? n - i : 4);
+    }
+}
+
+PasswordHasher::CacheKey PasswordHasher::cache_key(uint32_t slot, const char* password) const {
+    CacheKey k;
+    k.slot = slot;
+    hmac_sha256(pepper, sizeof(pepper), password, strlen(password), k.digest);
+    return k;
+}
+
+void PasswordHasher::make_record(const char* password, UserInfo& user) {
+    PasswordRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    memcpy(rec.tag, "pbk2", 4);
+    rec.iterations = iterations;
+    random_bytes(rec.salt, sizeof(rec.salt));
+    pbkdf2_sha256(password, strlen(password), rec.salt, sizeof(rec.salt),
+                  rec.iterations, rec.key, sizeof(rec.key));
+
+    static_assert(sizeof(rec) == sizeof(user.password_hash), "record size");
+    memcpy(user.password_hash, &rec, sizeof(rec));
+}
+
+PasswordCheck PasswordHasher::verify(uint32_t slot, const char* password,
+                                     const UserInfo& user, uint64_t now) {
+    PasswordRecord rec;
+    memcpy(&rec, user.password_hash, sizeof(rec));
+    if (memcmp(rec.tag, "pbk2", 4) != 0 || rec.iterations == 0)
+        return PasswordCheck::LEGACY;
+
+    CacheKey ck = cache_key(slot, password);
+    CacheEntry* hit = cache.find(ck);
+    if (hit && hit->expires > now && memcmp(hit->key, rec.key, 32) == 0)
+        return PasswordCheck::MATCH;
+
+    uint8_t key[32];
+    pbkdf2_sha256(password, strlen(password), rec.salt, sizeof(rec.salt),
+                  rec.iterations, key, sizeof(key));
+
+    // constant-time compare
+    uint8_t diff = 0;
+    for (int i = 0; i < 32; i++) diff |= (uint8_t)(key[i] ^ rec.key[i]);
+    if (diff) return PasswordCheck::MISMATCH;
+
+    // bounded: when full, start over rather than track ages
+    if (cache.size() >= CACHE_MAX) cache.clear();
+    CacheEntry e;
+    e.expires = now + CACHE_TTL;
+    memcpy(e.key, rec.key, 32);
+    cache.put(ck, e);
+    return PasswordCheck::MATCH;
+}
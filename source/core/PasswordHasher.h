@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "../include/odf_types.hpp"
+#include "../data_structures/HashTable.h"
+#include "sha256.h"
+
+// Layout of UserInfo::password_hash (64 bytes). The iteration count is kept
+// per record, so raising the container cost only affects new passwords.
+#pragma pack(push, 1)
+struct PasswordRecord {
+    char tag[4];            // "pbk2"
+    uint32_t iterations;
+    uint8_t salt[16];
+    uint8_t key[32];        // PBKDF2-HMAC-SHA256(password, salt, iterations)
+    uint8_t pad[8];
+};
+#pragma pack(pop)
+static_assert(sizeof(PasswordRecord) == 64, "PasswordRecord must fill password_hash");
+
+enum class PasswordCheck {
+    MATCH,
+    MISMATCH,
+    LEGACY          // not a PBKDF2 record (written before hashing existed)
+};
+
+// Salted PBKDF2 password records plus a short-lived cache of successful
+// verifications, so repeated logins with the same credentials skip the KDF.
+// Cache entries are keyed by (user slot, HMAC of the password under a
+// per-process random key) and remember the record they matched, so a
+// changed or recreated user never hits a stale entry.
+class PasswordHasher {
+private:
+    struct CacheKey {
+        uint32_t slot;
+        uint8_t digest[32];
+
+        bool operator<(const CacheKey& o) const {
+            if (slot != o.slot) return slot < o.slot;
+            return memcmp(digest, o.digest, 32) < 0;
+        }
+    };
+    struct CacheKeyHash {
+        unsigned long long operator()(const CacheKey& k) const {
+            unsigned long long h;
+            memcpy(&h, k.digest, sizeof(h));
+            return h ^ k.slot;
+        }
+    };
+    struct CacheEntry {
+        uint64_t expires;
+        uint8_t key[32];    // record key the credentials matched
+    };
+
+    static const uint32_t CACHE_TTL = 60;           // seconds
+    static const uint32_t CACHE_MAX = 4096;
+
+    uint32_t iterations;
+    uint8_t pepper[32];
+    HashTable<CacheKey, CacheEntry, CacheKeyHash> cache;
+
+    static void random_bytes(uint8_t* out, size_t n);
+    CacheKey cache_key(uint32_t slot, const char* password) const;
+
+public:
+    static const uint32_t DEFAULT_ITERATIONS = 100000;
+
+    PasswordHasher();
+
+    // cost for new records; 0 selects DEFAULT_ITERATIONS
+    void set_iterations(uint32_t n) { iterations = n ? n : DEFAULT_ITERATIONS; }
+    uint32_t get_iterations() const { return iterations; }
+
+    // fills user.password_hash with a fresh salted record
+    void make_record(const char* password, UserInfo& user);
+
+    PasswordCheck verify(uint32_t slot, const char* password, const UserInfo& user, uint64_t now);
+
+    void clear_cache() { cache.clear(); }
+};
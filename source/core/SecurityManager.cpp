@@ -0,0 +1,177 @@
+#include "SecurityManager.h"
+#include "sha256.h"
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SUBST_X86 1
+#endif
+
+static void subst_scalar(uint8_t* dst, const uint8_t* src, size_t n, const uint8_t* t) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8_t a0 = t[src[i]], a1 = t[src[i + 1]], a2 = t[src[i + 2]], a3 = t[src[i + 3]];
+        uint8_t a4 = t[src[i + 4]], a5 = t[src[i + 5]], a6 = t[src[i + 6]], a7 = t[src[i + 7]];
+        dst[i] = a0; dst[i + 1] = a1; dst[i + 2] = a2; dst[i + 3] = a3;
+        dst[i + 4] = a4; dst[i + 5] = a5; dst[i + 6] = a6; dst[i + 7] = a7;
+    }
+    for (; i < n; i++) dst[i] = t[src[i]];
+}
+
+#ifdef SUBST_X86
+
+// Nibble split: row h of the table covers bytes 0xh0..0xhF and pshufb looks
+// it up by the low nibble. Row selection rides on pshufb zeroing any lane
+// whose index has bit 7 set: with x stepped down by 0x10 per row, a
+// saturating +0x70 leaves bit 7 clear only in lanes whose high nibble is h,
+// so OR-ing the 16 shuffles assembles the result.
+__attribute__((target("ssse3")))
+static void subst_ssse3(uint8_t* dst, const uint8_t* src, size_t n, const uint8_t* t) {
+    __m128i rows[16];
+    for (int h = 0; h < 16; h++) rows[h] = _mm_loadu_si128((const __m128i*)(t + h * 16));
+    const __m128i bias = _mm_set1_epi8(0x70);
+    const __m128i step = _mm_set1_epi8(0x10);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i r = _mm_setzero_si128();
+#pragma GCC unroll 16
+        for (int h = 0; h < 16; h++) {
+            r = _mm_or_si128(r, _mm_shuffle_epi8(rows[h], _mm_adds_epu8(x, bias)));
+            x = _mm_sub_epi8(x, step);
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), r);
+    }
+    subst_scalar(dst + i, src + i, n - i, t);
+}
+
+// vpshufb works per 128-bit lane, so each row is broadcast to both lanes
+__attribute__((target("avx2")))
+static void subst_avx2(uint8_t* dst, const uint8_t* src, size_t n, const uint8_t* t) {
+    __m256i rows[16];
+    for (int h = 0; h < 16; h++)
+        rows[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(t + h * 16)));
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const __m256i step = _mm256_set1_epi8(0x10);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i r = _mm256_setzero_si256();
+#pragma GCC unroll 16
+        for (int h = 0; h < 16; h++) {
+            r = _mm256_or_si256(r, _mm256_shuffle_epi8(rows[h], _mm256_adds_epu8(x, bias)));
+            x = _mm256_sub_epi8(x, step);
+        }
+        _mm256_storeu_si256((__m256i*)(dst + i), r);
+    }
+    subst_scalar(dst + i, src + i, n - i, t);
+}
+
+// vpermi2b indexes 128 bytes with the low 7 bits; two lookups cover the
+// table halves and bit 7 of the input picks between them. The tail uses
+// masked loads/stores instead of falling back to scalar.
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void subst_avx512(uint8_t* dst, const uint8_t* src, size_t n, const uint8_t* t) {
+    const __m512i t0 = _mm512_loadu_si512(t);
+    const __m512i t1 = _mm512_loadu_si512(t + 64);
+    const __m512i t2 = _mm512_loadu_si512(t + 128);
+    const __m512i t3 = _mm512_loadu_si512(t + 192);
+
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_loadu_si512(src + i);
+        __m512i a = _mm512_permutex2var_epi8(t0, x, t1);
+        __m512i b = _mm512_permutex2var_epi8(t2, x, t3);
+        _mm512_storeu_si512(dst + i, _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), a, b));
+    }
+    if (i < n) {
+        __mmask64 m = (1ULL << (n - i)) - 1;
+        __m512i x = _mm512_maskz_loadu_epi8(m, src + i);
+        __m512i a = _mm512_permutex2var_epi8(t0, x, t1);
+        __m512i b = _mm512_permutex2var_epi8(t2, x, t3);
+        _mm512_mask_storeu_epi8(dst + i, m, _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), a, b));
+    }
+}
+
+#endif
+
+bool subst_supported(SubstKernel k) {
+#ifdef SUBST_X86
+    switch (k) {
+    case SubstKernel::SCALAR: return true;
+    case SubstKernel::SSSE3: return __builtin_cpu_supports("ssse3");
+    case SubstKernel::AVX2: return __builtin_cpu_supports("avx2");
+    case SubstKernel::AVX512_VBMI:
+        return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi");
+    }
+    return false;
+#else
+    return k == SubstKernel::SCALAR;
+#endif
+}
+
+SubstKernel subst_best() {
+    static const SubstKernel best =
+        subst_supported(SubstKernel::AVX512_VBMI) ? SubstKernel::AVX512_VBMI :
+        subst_supported(SubstKernel::AVX2) ? SubstKernel::AVX2 :
+        subst_supported(SubstKernel::SSSE3) ? SubstKernel::SSSE3 : SubstKernel::SCALAR;
+    return best;
+}
+
+const char* subst_name(SubstKernel k) {
+    switch (k) {
+    case SubstKernel::SCALAR: return "scalar";
+    case SubstKernel::SSSE3: return "ssse3";
+    case SubstKernel::AVX2: return "avx2";
+    case SubstKernel::AVX512_VBMI: return "avx512vbmi";
+    }
+    return "?";
+}
+
+void subst_run(SubstKernel k, uint8_t* dst, const uint8_t* src, size_t n, const uint8_t* table) {
+    switch (k) {
+#ifdef SUBST_X86
+    case SubstKernel::SSSE3: subst_ssse3(dst, src, n, table); return;
+    case SubstKernel::AVX2: subst_avx2(dst, src, n, table); return;
+    case SubstKernel::AVX512_VBMI: subst_avx512(dst, src, n, table); return;
+#endif
+    default: subst_scalar(dst, src, n, table); return;
+    }
+}
+
+void SecurityManager::derive_table(const char* key, size_t key_len, uint8_t out[256]) {
+    for (int i = 0; i < 256; i++) out[i] = (uint8_t)i;
+
+    std::random_device rd;
+    uint8_t stream[32];
+    uint32_t counter = 0;
+    int used = 32;
+    auto next_u32 = [&]() -> uint32_t {
+        if (used + 4 > 32) {
+            if (key_len) {
+                Sha256 h;
+                h.update(key, key_len);
+                h.update(&counter, sizeof(counter));
+                h.finish(stream);
+                counter++;
+            } else {
+                for (int i = 0; i < 32; i += 4) {
+                    uint32_t r = rd();
+                    memcpy(stream + i, &r, 4);
+                }
+            }
+            used = 0;
+        }
+        uint32_t v;
+        memcpy(&v, stream + used, 4);
+        used += 4;
+        return v;
+    };
+
+    for (int i = 255; i > 0; i--) {
+        int j = (int)(next_u32() % (uint32_t)(i + 1));
+        uint8_t t = out[i]; out[i] = out[j]; out[j] = t;
+    }
+}
@@ -1,22 +1,81 @@
 #pragma once
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include "../include/odf_types.hpp"
 
+// Byte-substitution kernels. Each maps n bytes of src through a 256-entry
+// table into dst; dst == src is allowed. The SIMD ones are only valid on a
+// CPU that supports them (see subst_supported).
+enum class SubstKernel {
+    SCALAR,
+    SSSE3,          // pshufb over the 16 nibble rows, 16 bytes per step
+    AVX2,           // same, 32 bytes per step
+    AVX512_VBMI     // vpermi2b over the whole table, 64 bytes per step
+};
+
+bool subst_supported(SubstKernel k);
+SubstKernel subst_best();           // fastest kernel this CPU supports
+const char* subst_name(SubstKernel k);
+void subst_run(SubstKernel k, uint8_t* dst, const uint8_t* src, size_t n, const uint8_t* table);
+
 class SecurityManager {
-    unsigned char enc[256];
-    unsigned char dec[256];
+    alignas(64) unsigned char enc[256];
+    alignas(64) unsigned char dec[256];
+    bool identity;
+    SubstKernel kernel;
 public:
     SecurityManager() {
+        set_identity();
+        kernel = subst_best();
+    }
+    void set_identity() {
         for (int i = 0; i < 256; i++) { enc[i] = (unsigned char)i; dec[i] = (unsigned char)i; }
+        identity = true;
     }
     void set_table(const std::vector<unsigned char>& table) {
         for (int i = 0; i < 256 && i < (int)table.size(); i++) enc[i] = table[i];
         for (int i = 0; i < 256; i++) dec[enc[i]] = (unsigned char)i;
+        identity = true;
+        for (int i = 0; i < 256; i++) if (enc[i] != i) { identity = false; break; }
     }
-    void encode(std::vector<unsigned char>& data) const {
-        for (unsigned long long i = 0; i < data.size(); i++) data[i] = enc[data[i]];
+    // rejects (and leaves the table alone) unless it is a permutation
+    bool set_table(const uint8_t table[256]) {
+        uint8_t seen[256] = { 0 };
+        for (int i = 0; i < 256; i++) {
+            if (seen[table[i]]) return false;
+            seen[table[i]] = 1;
+        }
+        set_table(std::vector<unsigned char>(table, table + 256));
+        return true;
     }
-    void decode(std::vector<unsigned char>& data) const {
-        for (unsigned long long i = 0; i < data.size(); i++) data[i] = dec[data[i]];
+    const uint8_t* table() const { return enc; }
+    bool is_identity() const { return identity; }
+    SubstKernel get_kernel() const { return kernel; }
+
+    // Keyed Fisher-Yates shuffle of 0..255 driven by SHA-256(key || counter);
+    // an empty key draws a random table instead.
+    static void derive_table(const char* key, size_t key_len, uint8_t out[256]);
+
+    // transform while copying, so content makes a single pass over memory
+    void encode_copy(uint8_t* dst, const uint8_t* src, size_t n) const {
+        if (identity) memcpy(dst, src, n);
+        else subst_run(kernel, dst, src, n, enc);
     }
+    void decode_copy(uint8_t* dst, const uint8_t* src, size_t n) const {
+        if (identity) memcpy(dst, src, n);
+        else subst_run(kernel, dst, src, n, dec);
+    }
+
+    // in place; a no-op for the identity table
+    void encode(uint8_t* data, size_t n) const {
+        if (!identity) subst_run(kernel, data, data, n, enc);
+    }
+    void decode(uint8_t* data, size_t n) const {
+        if (!identity) subst_run(kernel, data, data, n, dec);
+    }
+
+    void encode(std::vector<unsigned char>& data) const { encode(data.data(), data.size()); }
+    void decode(std::vector<unsigned char>& data) const { decode(data.data(), data.size()); }
 };
@@ -0,0 +1,106 @@
+#include "TailPacker.h"
+
+void TailPacker::init(BlockManager* blocks) {
+    bm = blocks;
+    units = bm->payload_size() / UNIT;
+    frags.clear();
+    open.clear();
+}
+
+int TailPacker::find_run(const FragBlock& f, uint32_t need) const {
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < units; i++) {
+        run = f.used[i] ? 0 : run + 1;
+        if (run == need) return (int)(i + 1 - need);
+    }
+    return -1;
+}
+
+void TailPacker::drop_open(uint32_t blk) {
+    for (size_t i = 0; i < open.size(); i++) {
+        if (open[i] == blk) {
+            open[i] = open.back();
+            open.pop_back();
+            return;
+        }
+    }
+}
+
+bool TailPacker::note(uint32_t blk, uint32_t off, uint32_t len) {
+    if (off % UNIT || off + len > units * UNIT) return false;
+    FragBlock* f = frags.find(blk);
+    if (!f) {
+        FragBlock nf;
+        nf.used.assign(units, 0);
+        nf.free_units = units;
+        nf.in_open = true;
+        frags.put(blk, nf);
+        open.push_back(blk);
+        f = frags.find(blk);
+    }
+    uint32_t first = off / UNIT, need = (len + UNIT - 1) / UNIT;
+    for (uint32_t i = first; i < first + need; i++) {
+        if (!f->used[i]) f->free_units--;
+        f->used[i]++;
+    }
+    return true;
+}
+
+bool TailPacker::alloc(uint32_t len, uint32_t& blk, uint32_t& off) {
+    uint32_t need = (len + UNIT - 1) / UNIT;
+    if (need == 0 || need > units) return false;
+
+    // most recently opened blocks first; blocks that are nearly full stop
+    // being probed until a release frees enough of them
+    uint32_t probes = 0;
+    for (size_t i = open.size(); i-- > 0 && probes < MAX_PROBES; probes++) {
+        uint32_t b = open[i];
+        FragBlock* f = frags.find(b);
+        if (f && f->free_units >= need) {
+            int at = find_run(*f, need);
+            if (at >= 0) {
+                for (uint32_t u = 0; u < need; u++) f->used[at + u] = 1;
+                f->free_units -= need;
+                blk = b;
+                off = (uint32_t)at * UNIT;
+                return true;
+            }
+        }
+        if (!f || f->free_units < units / 8) {
+            if (f) f->in_open = false;
+            open[i] = open.back();
+            open.pop_back();
+        }
+    }
+
+    int nb = bm->allocate_block();
+    if (nb < 0) return false;
+    FragBlock nf;
+    nf.used.assign(units, 0);
+    for (uint32_t u = 0; u < need; u++) nf.used[u] = 1;
+    nf.free_units = units - need;
+    nf.in_open = true;
+    frags.put((uint32_t)nb, nf);
+    open.push_back((uint32_t)nb);
+    blk = (uint32_t)nb;
+    off = 0;
+    return true;
+}
+
+void TailPacker::release(uint32_t blk, uint32_t off, uint32_t len) {
+    FragBlock* f = frags.find(blk);
+    if (!f) return;
+    uint32_t first = off / UNIT, need = (len + UNIT - 1) / UNIT;
+    for (uint32_t i = first; i < first + need && i < units; i++) {
+        if (f->used[i] && --f->used[i] == 0) f->free_units++;
+    }
+
+    if (f->free_units == units) {
+        if (f->in_open) drop_open(blk);
+        frags.erase(blk);
+        bm->free_block_chain(blk);
+    } else if (!f->in_open && f->free_units >= units / 8) {
+        f->in_open = true;
+        open.push_back(blk);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "BlockManager.h"
+#include "../data_structures/HashTable.h"
+
+// Shared fragment blocks holding the final partial block of many files.
+// Space in a fragment block is handed out in UNIT-byte runs. Occupancy is
+// kept in memory only and rebuilt from the metadata table at mount.
+class TailPacker {
+private:
+    struct FragBlock {
+        std::vector<uint8_t> used;      // references per unit: the mounted tree
+                                        // and every container snapshot
+        uint32_t free_units;
+        bool in_open;
+    };
+
+    HashTable<uint32_t, FragBlock> frags;
+    std::vector<uint32_t> open;         // fragment blocks worth probing for space
+    BlockManager* bm;
+    uint32_t units;                     // units per block payload
+
+    static const uint32_t MAX_PROBES = 16;
+
+    int find_run(const FragBlock& f, uint32_t need) const;
+    void drop_open(uint32_t blk);
+
+public:
+    static const uint32_t UNIT = 16;
+
+    TailPacker() {
+        bm = nullptr;
+        units = 0;
+    }
+
+    void init(BlockManager* blocks);
+
+    // records a tail found in a metadata table at mount, or one more
+    // reference to a tail (a container snapshot taking it)
+    bool note(uint32_t blk, uint32_t off, uint32_t len);
+
+    // reserves len bytes, starting a new fragment block if none has room
+    bool alloc(uint32_t len, uint32_t& blk, uint32_t& off);
+
+    // drops a reference; an emptied fragment block goes back to the free map
+    void release(uint32_t blk, uint32_t off, uint32_t len);
+
+    uint32_t block_count() const { return (uint32_t)frags.size(); }
+};
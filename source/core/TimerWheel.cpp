@@ -0,0 +1,106 @@
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel() {
+    now = 0;
+    armed_count = 0;
+    for (int l = 0; l < LEVELS; l++)
+        for (int s = 0; s < SLOTS; s++)
+            slots[l][s].prev = slots[l][s].next = &slots[l][s];
+}
+
+void TimerWheel::init(uint64_t tick) {
+    for (int l = 0; l < LEVELS; l++) {
+        for (int s = 0; s < SLOTS; s++) {
+            TimerNode* head = &slots[l][s];
+            while (head->next != head) unlink(head->next);
+        }
+    }
+    now = tick;
+    armed_count = 0;
+}
+
+void TimerWheel::unlink(TimerNode* n) {
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    n->prev = n->next = nullptr;
+}
+
+// Places n by its distance from `now`: the lowest level whose span still
+// covers it, slot chosen by that level's digit of the expiry tick.
+void TimerWheel::link(TimerNode* n) {
+    uint64_t when = n->expires < now ? now : n->expires;
+    uint64_t delta = when - now;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= ((uint64_t)1 << (BITS * (level + 1))))
+        level++;
+    if (delta >= ((uint64_t)1 << (BITS * LEVELS)))
+        when = now + ((uint64_t)1 << (BITS * LEVELS)) - 1;    // re-armed on the way down
+
+    TimerNode* head = &slots[level][(when >> (BITS * level)) & (SLOTS - 1)];
+    n->prev = head->prev;
+    n->next = head;
+    head->prev->next = n;
+    head->prev = n;
+}
+
+void TimerWheel::schedule(TimerNode* n, uint64_t tick) {
+    if (n->armed()) unlink(n);
+    else armed_count++;
+    n->expires = tick > now ? tick : now + 1;
+    link(n);
+}
+
+void TimerWheel::cancel(TimerNode* n) {
+    if (!n->armed()) return;
+    unlink(n);
+    armed_count--;
+}
+
+// Re-files the slot of `level` that the current tick has reached.
+void TimerWheel::cascade(int level) {
+    TimerNode* head = &slots[level][(now >> (BITS * level)) & (SLOTS - 1)];
+    TimerNode list;
+    if (head->next == head) return;
+
+    // detach the whole slot first; link() may append back into this level
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head->next = head->prev = head;
+
+    while (list.next != &list) {
+        TimerNode* n = list.next;
+        unlink(n);
+        link(n);
+    }
+}
+
+void TimerWheel::advance(uint64_t tick, std::vector<uint64_t>& fired) {
+    while (now < tick) {
+        now++;
+
+        for (int l = 1; l < LEVELS; l++) {
+            if ((now & (((uint64_t)1 << (BITS * l)) - 1)) != 0) break;
+            cascade(l);
+        }
+
+        TimerNode* head = &slots[0][now & (SLOTS - 1)];
+        TimerNode* n = head->next;
+        while (n != head) {
+            TimerNode* nx = n->next;
+            unlink(n);
+            if (n->expires > now) {
+                link(n);            // clamped far timer, not due yet
+            } else {
+                armed_count--;
+                fired.push_back(n->id);
+            }
+            n = nx;
+        }
+
+        // nothing left to fire: jump straight to the target
+        if (armed_count == 0) now = tick;
+    }
+}
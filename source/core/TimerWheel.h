@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Intrusive timer entry, embedded in the object it times.
+struct TimerNode {
+    TimerNode* prev;
+    TimerNode* next;
+    uint64_t expires;       // tick
+    uint64_t id;            // handed back when the timer fires
+
+    TimerNode() : prev(nullptr), next(nullptr), expires(0), id(0) {}
+    bool armed() const { return prev != nullptr; }
+};
+
+// Hierarchical timer wheel: 4 levels of 64 slots. Level 0 holds timers due
+// within 64 ticks, and each higher level covers 64 times the span of the
+// one below, so with one-second ticks it reaches about 194 days. Timers
+// further out sit in the last level and are re-armed when they come due.
+// schedule/cancel are O(1); each tick fires one slot, and every 64 ticks
+// one higher-level slot is cascaded down.
+class TimerWheel {
+private:
+    static const int LEVELS = 4;
+    static const int BITS = 6;
+    static const int SLOTS = 1 << BITS;
+
+    TimerNode slots[LEVELS][SLOTS];     // circular list heads
+    uint64_t now;
+    uint32_t armed_count;
+
+    void link(TimerNode* n);
+    static void unlink(TimerNode* n);
+    void cascade(int level);
+
+public:
+    TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // start ticking at `tick`; drops every armed timer
+    void init(uint64_t tick);
+
+    // (re)arm n to fire at `tick`; due timers fire on the next tick
+    void schedule(TimerNode* n, uint64_t tick);
+    void cancel(TimerNode* n);
+
+    // move time forward to `tick`, appending the ids of fired timers
+    void advance(uint64_t tick, std::vector<uint64_t>& fired);
+
+    uint64_t current() const { return now; }
+    uint32_t size() const { return armed_count; }
+};
@@ -93,6 +93,34 @@ bool parse_uconf(const char* path, FSConfig& cfg) {
                 cfg.max_files = static_cast<uint32_t>(std::stoul(value));
             } else if (iequals(key, "max_filename_length")) {
                 cfg.max_filename_length = static_cast<uint32_t>(std::stoul(value));
+            } else if (iequals(key, "verify_mode")) {
+                std::string v = strip_quotes(value);
+                if (iequals(v, "off")) cfg.verify_mode = VERIFY_OFF;
+                else if (iequals(v, "sampled")) cfg.verify_mode = VERIFY_SAMPLED;
+                else if (iequals(v, "scrub")) cfg.verify_mode = VERIFY_SCRUB;
+                else cfg.verify_mode = VERIFY_ALWAYS;
+            } else if (iequals(key, "verify_sample")) {
+                cfg.verify_sample = static_cast<uint32_t>(std::stoul(value));
+            } else if (iequals(key, "compression")) {
+                std::string v = strip_quotes(value);
+                cfg.compression = (iequals(v, "on") || iequals(v, "true") || v == "1") ? 1 : 0;
+            } else if (iequals(key, "dedup")) {
+                std::string v = strip_quotes(value);
+                cfg.dedup = (iequals(v, "on") || iequals(v, "true") || v == "1") ? 1 : 0;
+            } else if (iequals(key, "cache_size")) {
+                cfg.cache_size = static_cast<uint64_t>(std::stoull(value));
+            } else if (iequals(key, "io_backend")) {
+                std::string v = strip_quotes(value);
+                if (iequals(v, "pread")) cfg.io_backend = IO_PREAD;
+                else if (iequals(v, "uring") || iequals(v, "io_uring")) cfg.io_backend = IO_URING;
+                else cfg.io_backend = IO_AUTO;
+            } else if (iequals(key, "direct_io")) {
+                std::string v = strip_quotes(value);
+                cfg.direct_io = (iequals(v, "on") || iequals(v, "true") || v == "1") ? 1 : 0;
+            } else if (iequals(key, "vault_slots")) {
+                cfg.vault_slots = static_cast<uint32_t>(std::stoul(value));
+            } else if (iequals(key, "snapshot_slots")) {
+                cfg.snapshot_slots = static_cast<uint32_t>(std::stoul(value));
             }
         } else if (iequals(current_section, "security")) {
             if (iequals(key, "max_users")) {
@@ -114,6 +142,8 @@ bool parse_uconf(const char* path, FSConfig& cfg) {
                 } else {
                     cfg.require_auth = 0;
                 }
+            } else if (iequals(key, "kdf_iterations")) {
+                cfg.kdf_iterations = static_cast<uint32_t>(std::stoul(value));
             } else if (iequals(key, "key") || iequals(key, "private_key")) {
                 std::string v = strip_quotes(value);
                 std::memset(cfg.private_key, 0, sizeof(cfg.private_key));
@@ -127,6 +157,12 @@ bool parse_uconf(const char* path, FSConfig& cfg) {
                 cfg.max_connections = static_cast<uint32_t>(std::stoul(value));
             } else if (iequals(key, "queue_timeout")) {
                 cfg.queue_timeout = static_cast<uint32_t>(std::stoul(value));
+            } else if (iequals(key, "session_idle_timeout")) {
+                cfg.session_idle_timeout = static_cast<uint32_t>(std::stoul(value));
+            } else if (iequals(key, "session_max_lifetime")) {
+                cfg.session_max_lifetime = static_cast<uint32_t>(std::stoul(value));
+            } else if (iequals(key, "stream_stall_timeout")) {
+                cfg.stream_stall_timeout = static_cast<uint32_t>(std::stoul(value));
             }
         }
     }
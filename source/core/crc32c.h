@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// ===============================
+// CRC32C (Castagnoli), SSE4.2 crc32 when the CPU has it
+// ===============================
+// crc32c(p, n) is the standard checksum; crc32c_extend continues one over
+// more data, starting from crc32c(first part).
+uint32_t crc32c_extend(uint32_t crc, const void* data, size_t len);
+inline uint32_t crc32c(const void* data, size_t len) { return crc32c_extend(0, data, len); }
+
+bool crc32c_hw();
@@ -1,5 +1,7 @@
 #include "directory_tree.h"
 #include <algorithm>
+#include <cstring>
+#include <cstdlib>
 #include <iostream>
 
 DirectoryTree::DirectoryTree() {
@@ -45,6 +47,22 @@ std::vector<std::string> DirectoryTree::split(const std::string &path) {
     return parts;
 }
 
+bool DirectoryTree::make_key(const std::string &name, uint32_t index, DirKey &out) {
+    if (name.size() >= sizeof(out.name)) return false;
+    memset(out.name, 0, sizeof(out.name));
+    for (size_t i = 0; i < name.size(); i++)
+        out.name[i] = (char)std::tolower((unsigned char)name[i]);
+    out.index = index;
+    return true;
+}
+
+static DirKey key_of_entry(const MetadataEntry &e, uint32_t index) {
+    DirKey k;
+    DirectoryTree::make_key(std::string(e.short_name, strnlen(e.short_name, sizeof(e.short_name))),
+                            index, k);
+    return k;
+}
+
 void DirectoryTree::rebuild() {
     nodes.clear();
 
@@ -54,30 +72,38 @@ void DirectoryTree::rebuild() {
         if (!e.valid_flag) continue;
 
         if (e.type_flag == 1) { // DIRECTORY ONLY
-            DirNode n;
+            DirNode &n = nodes[i];
             n.meta_index = i;
             n.parent_index = e.parent_index;
             n.name = e.short_name;
 
             std::transform(n.name.begin(), n.name.end(), n.name.begin(),
                            [](unsigned char c){ return std::tolower(c); });
-
-            nodes[i] = n;
         }
     }
 
-    // SECOND PASS: add all children (files + directories)
+    // SECOND PASS: gather all children (files + directories), then
+    // bulk-load each directory's index from the sorted list
+    std::unordered_map<int, std::vector<std::pair<DirKey, int>>> kids;
     for (uint32_t i = 0; i < meta->capacity(); i++) {
         const MetadataEntry &e = meta->get_const(i);
         if (!e.valid_flag) continue;
 
         int parent = e.parent_index;
 
-        // parent must be a directory node
-        if (nodes.count(parent)) {
-            nodes[parent].children.push_back(i);
+        // parent must be a directory node (the root is its own parent)
+        if (parent != (int)i && nodes.count(parent)) {
+            kids[parent].push_back(std::make_pair(key_of_entry(e, i), (int)i));
         }
     }
+
+    for (auto &kv : kids) {
+        std::sort(kv.second.begin(), kv.second.end(),
+            [](const std::pair<DirKey, int> &a, const std::pair<DirKey, int> &b) {
+                return a.first < b.first;
+            });
+        nodes[kv.first].children.bulk_load(kv.second);
+    }
 }
 
 
@@ -91,48 +117,57 @@ int DirectoryTree::resolve(const std::string &path) {
     int curr = 0;
 
     for (auto &seg : parts) {
-        bool found = false;
-        if (!nodes.count(curr)) return -1;
+        auto it = nodes.find(curr);
+        if (it == nodes.end()) return -1;
+
+        DirKey k;
+        if (!make_key(seg, 0, k)) return -1;
 
-        for (auto child : nodes[curr].children) {
-            const MetadataEntry &e = meta->get_const(child);
+        auto c = it->second.children.lower_bound(k);
+        if (!c.valid() || memcmp(c.key().name, k.name, sizeof(k.name)) != 0) return -1;
+        curr = c.value();
+    }
+    return curr;
+}
 
-            std::string nm = e.short_name;
-            std::transform(nm.begin(), nm.end(), nm.begin(),
-                [](unsigned char c){ return std::tolower(c); });
+// Case-sensitive match on the stored short name (duplicate detection).
+int DirectoryTree::find_exact(int dir_idx, const char short_name[12]) {
+    auto it = nodes.find(dir_idx);
+    if (it == nodes.end()) return -1;
 
-            if (nm == seg) {
-                curr = child;
-                found = true;
-                break;
-            }
-        }
+    DirKey k;
+    if (!make_key(std::string(short_name, strnlen(short_name, 12)), 0, k)) return -1;
 
-        if (!found) return -1;
+    for (auto c = it->second.children.lower_bound(k);
+         c.valid() && memcmp(c.key().name, k.name, sizeof(k.name)) == 0; c.next()) {
+        if (strncmp(meta->get_const(c.value()).short_name, short_name, 12) == 0)
+            return c.value();
     }
-    return curr;
+    return -1;
 }
 
 void DirectoryTree::add_child(int parent_idx, int child_idx) {
     if (!nodes.count(parent_idx)) return;
-    nodes[parent_idx].children.push_back(child_idx);
 
     const MetadataEntry &e = meta->get_const(child_idx);
+    nodes[parent_idx].children.insert(key_of_entry(e, child_idx), child_idx);
+
     if (e.type_flag == 1) {
-        DirNode n;
+        DirNode &n = nodes[child_idx];
         n.meta_index = child_idx;
         n.parent_index = parent_idx;
         n.name = e.short_name;
         std::transform(n.name.begin(), n.name.end(), n.name.begin(),
             [](unsigned char c){ return std::tolower(c); });
-        nodes[child_idx] = n;
     }
 }
+
+// Must run while the child's metadata entry still holds its name.
 void DirectoryTree::remove_child(int parent_idx, int child_idx) {
     if (!nodes.count(parent_idx)) return;
 
-    auto &vec = nodes[parent_idx].children;
-    vec.erase(std::remove(vec.begin(), vec.end(), child_idx), vec.end());
+    const MetadataEntry &e = meta->get_const(child_idx);
+    nodes[parent_idx].children.erase(key_of_entry(e, child_idx));
 
     // only remove from nodes if it is a directory
     if (nodes.count(child_idx)) {
@@ -144,3 +179,35 @@ bool DirectoryTree::is_empty_dir(int meta_idx) {
     if (!nodes.count(meta_idx)) return false;
     return nodes[meta_idx].children.empty();
 }
+
+// "name/index" resumes just past that one entry; a bare name resumes past
+// every entry with that name
+static bool resume_key(const std::string &after, DirKey &out) {
+    size_t slash = after.find('/');
+    if (slash == std::string::npos) return DirectoryTree::make_key(after, UINT32_MAX, out);
+    unsigned long index = strtoul(after.c_str() + slash + 1, nullptr, 10);
+    return DirectoryTree::make_key(after.substr(0, slash),
+                                   index < UINT32_MAX ? (uint32_t)index + 1 : UINT32_MAX, out);
+}
+
+bool DirectoryTree::list(int dir_idx, const std::string &prefix, const std::string &after,
+                         uint32_t limit, std::vector<int> &out) {
+    auto it = nodes.find(dir_idx);
+    if (it == nodes.end()) return false;
+
+    DirKey pk;
+    if (!make_key(prefix, 0, pk)) return true;      // no name can match
+    size_t plen = prefix.size();
+
+    // start at the prefix, or just past the cursor
+    DirKey start = pk;
+    DirKey ak;
+    if (!after.empty() && resume_key(after, ak) && pk < ak) start = ak;
+
+    for (auto c = it->second.children.lower_bound(start); c.valid(); c.next()) {
+        if (memcmp(c.key().name, pk.name, plen) != 0) break;
+        if (limit && out.size() >= limit) break;
+        out.push_back(c.value());
+    }
+    return true;
+}
@@ -3,12 +3,25 @@
 #include <unordered_map>
 #include <vector>
 #include "MetadataManager.h"
+#include "../data_structures/BPlusTree.h"
+
+// Child key: lower-cased short name, then metadata index so names that
+// differ only in case stay distinct. Ordered by name, then index.
+struct DirKey {
+    char name[12];
+    uint32_t index;
+
+    bool operator<(const DirKey& o) const {
+        int c = memcmp(name, o.name, sizeof(name));
+        return c < 0 || (c == 0 && index < o.index);
+    }
+};
 
 struct DirNode {
     int meta_index;
     int parent_index;
     std::string name;
-    std::vector<int> children;
+    BPlusTree<DirKey, int> children;     // ordered by name
 };
 
 class DirectoryTree {
@@ -26,8 +39,18 @@ public:
     static std::string normalize(const std::string& path);
     static std::vector<std::string> split(const std::string& path);
 
+    static bool make_key(const std::string& name, uint32_t index, DirKey& out);
+
     int resolve(const std::string& path);
+    int find_exact(int dir_idx, const char short_name[12]);
     void add_child(int parent_idx, int child_idx);
     void remove_child(int parent_idx, int child_idx);
     bool is_empty_dir(int meta_idx);
+
+    // Children of dir_idx in name order whose lower-cased name starts with
+    // `prefix` and sort after `after`, a resume cursor ("" for the start):
+    // "name/index" of the last child returned, or a bare name. At most
+    // `limit` indices (0 = no limit).
+    bool list(int dir_idx, const std::string& prefix, const std::string& after,
+              uint32_t limit, std::vector<int>& out);
 };
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// ===============================
+// MurmurHash3 x64 128-bit
+// ===============================
+// Fast non-cryptographic hash for content fingerprints; a match is always
+// confirmed by comparing the bytes.
+void hash128(const void* data, size_t len, uint64_t seed, uint64_t out[2]);
@@ -0,0 +1,169 @@
+#include "lz4.h"
+#include <cstring>
+#include <cmath>
+
+static const int HASH_BITS = 12;
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;     // the format ends with at least 5 literals
+static const size_t MF_LIMIT = 12;         // no match may start in the last 12 bytes
+
+static inline uint32_t read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t read64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint32_t hash4(uint32_t v) { return (v * 2654435761u) >> (32 - HASH_BITS); }
+
+// length continuation bytes for a field that overflowed its 4-bit nibble
+static bool put_length(uint8_t*& op, const uint8_t* oend, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= oend) return false;
+        *op++ = 255;
+    }
+    if (op >= oend) return false;
+    *op++ = (uint8_t)len;
+    return true;
+}
+
+static bool put_sequence(uint8_t*& op, const uint8_t* oend, const uint8_t* lit, size_t lit_len,
+                         size_t offset, size_t match_len) {
+    if (op >= oend) return false;
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15 && !put_length(op, oend, lit_len - 15)) return false;
+    if ((size_t)(oend - op) < lit_len) return false;
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (offset == 0) return true;           // final literals-only sequence
+
+    if (oend - op < 2) return false;
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    size_t ml = match_len - MIN_MATCH;
+    *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+    if (ml >= 15 && !put_length(op, oend, ml - 15)) return false;
+    return true;
+}
+
+size_t lz4_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+    uint8_t* op = dst;
+    const uint8_t* oend = dst + cap;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + n;
+
+    if (n > MF_LIMIT) {
+        uint32_t table[1 << HASH_BITS];
+        memset(table, 0, sizeof(table));
+        const uint8_t* mflimit = iend - MF_LIMIT;
+        const uint8_t* matchlimit = iend - LAST_LITERALS;
+
+        const uint8_t* ip = src + 1;
+        while (ip < mflimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash4(seq);
+            const uint8_t* ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+
+            if (ref >= ip || ip - ref > 65535 || read32(ref) != seq) {
+                // step faster through data that keeps missing
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) { ip--; ref--; }
+
+            const uint8_t* p = ip + MIN_MATCH;
+            const uint8_t* q = ref + MIN_MATCH;
+            while (p + 8 <= matchlimit) {
+                uint64_t diff = read64(p) ^ read64(q);
+                if (diff) { p += __builtin_ctzll(diff) >> 3; goto matched; }
+                p += 8;
+                q += 8;
+            }
+            while (p < matchlimit && *p == *q) { p++; q++; }
+        matched:
+            if (!put_sequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref),
+                              (size_t)(p - ip)))
+                return 0;
+            ip = p;
+            anchor = ip;
+            if (ip < mflimit) table[hash4(read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+        }
+    }
+
+    if (!put_sequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0)) return 0;
+    return (size_t)(op - dst);
+}
+
+long lz4_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + n;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return -1;
+
+        size_t ml = token & 15;
+        if (ml == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                ml += b;
+            } while (b == 255);
+        }
+        ml += MIN_MATCH;
+        if ((size_t)(oend - op) < ml) return -1;
+
+        const uint8_t* m = op - offset;
+        if (offset >= ml) {
+            memcpy(op, m, ml);
+        } else {
+            // overlapping copy repeats the last `offset` bytes
+            for (size_t i = 0; i < ml; i++) op[i] = m[i];
+        }
+        op += ml;
+    }
+    return (long)(op - dst);
+}
+
+bool lz4_worth_trying(const uint8_t* data, size_t n) {
+    static const size_t WINDOWS = 8;
+    static const size_t WINDOW = 256;
+    if (n < WINDOWS * WINDOW) return true;
+
+    uint32_t hist[256] = { 0 };
+    size_t stride = (n - WINDOW) / (WINDOWS - 1);
+    for (size_t w = 0; w < WINDOWS; w++) {
+        const uint8_t* p = data + w * stride;
+        for (size_t i = 0; i < WINDOW; i++) hist[p[i]]++;
+    }
+
+    // Shannon entropy in bits per byte; 8 is uniform noise
+    const double total = (double)(WINDOWS * WINDOW);
+    double bits = 0;
+    for (int i = 0; i < 256; i++) {
+        if (!hist[i]) continue;
+        double p = hist[i] / total;
+        bits -= p * std::log2(p);
+    }
+    return bits < 7.0;
+}
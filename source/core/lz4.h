@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// ===============================
+// LZ4 block format (no frame, no checksum)
+// ===============================
+// Sequences of literals and 64 KB-window matches; greedy compression over a
+// 4096-entry hash table, so speed is favoured over ratio.
+
+// largest output lz4_compress can produce for n input bytes
+inline size_t lz4_bound(size_t n) { return n + n / 255 + 16; }
+
+// returns the compressed size, or 0 if the output would exceed cap
+size_t lz4_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap);
+
+// returns the decompressed size, or -1 if the input is malformed or would
+// write past dst + cap
+long lz4_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap);
+
+// Quick incompressibility test: the byte entropy of a few windows spread
+// over the buffer. False for data that is already compressed or random.
+bool lz4_worth_trying(const uint8_t* data, size_t n);
@@ -272,8 +272,22 @@
 #include <cstring>
 #include <cstdlib>
 #include <cassert>
+#include <map>
+#include <unistd.h>
+#include <csignal>
+#include <sys/wait.h>
 
 #include "FileSystem.cpp"   // This pulls ALL .cpp files
+#include "../api/ofs_api.cpp"
+#include "../server/json_protocol.cpp"
+#include "../server/binary_protocol.cpp"
+#include "../server/request_handler.cpp"
+#include "../server/server.cpp"
+#include "../data_structures/HashTable.h"
+#include "../data_structures/Queue.h"
+#include "../data_structures/Stack.h"
+#include "../data_structures/AVLTree.h"
+#include "../data_structures/BPlusTree.h"
 
 using std::cout;
 using std::endl;
@@ -309,6 +323,7 @@ FSConfig make_config() {
     cfg.queue_timeout = 30;
     strcpy(cfg.admin_username, "admin");
     strcpy(cfg.admin_password, "admin123");
+    cfg.kdf_iterations = 1000;          // keep the suite fast
 
     return cfg;
 }
@@ -341,7 +356,7 @@ bool test_users() {
     load_fs(fs, "test.omni");
 
     void* admin = nullptr;
-    CHECK(fs.user_login("admin", "x", &admin) == OFSErrorCodes::SUCCESS,
+    CHECK(fs.user_login("admin", "admin123", &admin) == OFSErrorCodes::SUCCESS,
           "admin login");
 
     // create user
@@ -369,6 +384,19 @@ bool test_users() {
     CHECK(fs.get_session_info(s1, &inf) == OFSErrorCodes::SUCCESS,
           "session info OK");
 
+    // sessions are looked up by their random token
+    SessionInfo admin_inf;
+    fs.get_session_info(admin, &admin_inf);
+    CHECK(strlen(inf.session_id) == 32 && strcmp(inf.session_id, admin_inf.session_id) != 0,
+          "unique session tokens");
+    void* by_tok = nullptr;
+    CHECK(fs.session_lookup(inf.session_id, &by_tok) == OFSErrorCodes::SUCCESS && by_tok == s1,
+          "session lookup by token");
+    CHECK(fs.user_logout(s1) == OFSErrorCodes::SUCCESS &&
+          fs.session_lookup(inf.session_id, &by_tok) == OFSErrorCodes::ERROR_INVALID_SESSION &&
+          fs.get_session_info(s1, &inf) == OFSErrorCodes::ERROR_INVALID_SESSION,
+          "logout invalidates token and handle");
+
     // delete user
     CHECK(fs.user_delete(admin, "u1") == OFSErrorCodes::SUCCESS,
           "user_delete OK");
@@ -381,6 +409,19 @@ bool test_users() {
     CHECK(fs.user_logout(admin) == OFSErrorCodes::SUCCESS,
           "admin logout");
 
+    // slot writes survive a remount; the freed slot is reused
+    fs.user_login("admin", "admin123", &admin);
+    CHECK(fs.user_create(admin, "u2", "pw", UserRole::NORMAL) == OFSErrorCodes::SUCCESS,
+          "user_create reuses slot");
+    fs.shutdown();
+
+    FileSystem fs2;
+    load_fs(fs2, "test.omni");
+    void* u2 = nullptr;
+    CHECK(fs2.user_login("u2", "pw", &u2) == OFSErrorCodes::SUCCESS, "user slot persisted");
+    CHECK(fs2.user_login("u1", "pw", &u2) == OFSErrorCodes::ERROR_NOT_FOUND,
+          "deleted user stays deleted");
+
     return true;
 }
 // ======================================================
@@ -394,7 +435,7 @@ bool test_directories() {
     load_fs(fs, "test.omni");
 
     void* admin = nullptr;
-    fs.user_login("admin", "x", &admin);
+    fs.user_login("admin", "admin123", &admin);
 
     // mkdir /docs
     CHECK(fs.dir_create(admin, "/docs") == OFSErrorCodes::SUCCESS,
@@ -440,7 +481,7 @@ bool test_files() {
     load_fs(fs, "test.omni");
 
     void* admin = nullptr;
-    fs.user_login("admin", "x", &admin);
+    fs.user_login("admin", "admin123", &admin);
 
     fs.dir_create(admin, "/docs");
 
@@ -520,7 +561,7 @@ bool test_metadata_stats() {
     load_fs(fs, "test.omni");
 
     void* admin = nullptr;
-    fs.user_login("admin", "x", &admin);
+    fs.user_login("admin", "admin123", &admin);
 
     fs.dir_create(admin, "/docs");
     fs.file_create(admin, "/docs/f1", "abc", 3);
@@ -552,6 +593,1991 @@ bool test_metadata_stats() {
 // ======================================================
 // MAIN
 // ======================================================
+bool test_snapshots() {
+    cout << "\n==== TEST SNAPSHOT READS ====\n";
+
+    FileSystem fs;
+    create_fs(fs, "test.omni");
+    load_fs(fs, "test.omni");
+
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    std::string big(9000, 'A');
+    fs.file_create(admin, "/snap", big.c_str(), big.size());
+
+    void* snap = nullptr;
+    uint64_t snap_size = 0;
+    CHECK(fs.snapshot_open(admin, "/snap", &snap, &snap_size) == OFSErrorCodes::SUCCESS,
+          "snapshot open");
+    CHECK(snap_size == big.size(), "snapshot size");
+
+    // writer replaces a middle block and appends while the snapshot is open
+    std::string mid(100, 'B');
+    CHECK(fs.file_edit(admin, "/snap", mid.c_str(), mid.size(), 5000) == OFSErrorCodes::SUCCESS,
+          "edit under snapshot");
+    CHECK(fs.file_edit(admin, "/snap", "TAIL", 4, big.size()) == OFSErrorCodes::SUCCESS,
+          "append under snapshot");
+
+    char chunk[4096];
+    size_t got = 0;
+    CHECK(fs.snapshot_read(snap, 4096, chunk, sizeof(chunk), &got) == OFSErrorCodes::SUCCESS,
+          "snapshot chunk read");
+    CHECK(got == sizeof(chunk) && chunk[5000 - 4096] == 'A', "snapshot sees old data");
+
+    char* buf;
+    size_t sz;
+    fs.file_read(admin, "/snap", &buf, &sz);
+    CHECK(sz == big.size() + 4 && buf[5000] == 'B' && buf[sz - 1] == 'L', "reader sees new data");
+    free(buf);
+
+    // truncate while pinned, snapshot still readable
+    fs.file_truncate(admin, "/snap");
+    CHECK(fs.snapshot_read(snap, 8990, chunk, sizeof(chunk), &got) == OFSErrorCodes::SUCCESS,
+          "snapshot read after truncate");
+    CHECK(got == 10 && chunk[9] == 'A', "snapshot tail intact");
+
+    CHECK(fs.snapshot_close(snap) == OFSErrorCodes::SUCCESS, "snapshot close");
+    CHECK(fs.snapshot_read(snap, 0, chunk, 1, &got) == OFSErrorCodes::ERROR_INVALID_SESSION,
+          "closed snapshot rejected");
+
+    return true;
+}
+
+bool test_hash_table() {
+    cout << "\n==== TEST HASH TABLE ====\n";
+
+    HashTable<unsigned long long, unsigned int> t(4);
+    for (unsigned int i = 0; i < 10000; i++) t.put(i * 7919ull, i);
+    CHECK(t.size() == 10000, "insert with growth");
+
+    for (unsigned int i = 0; i < 10000; i += 2) t.erase(i * 7919ull);
+    bool ok = t.size() == 5000;
+    for (unsigned int i = 0; i < 10000 && ok; i++) {
+        unsigned int v = 0;
+        ok = t.get(i * 7919ull, v) == (i % 2 == 1) && (i % 2 == 0 || v == i);
+    }
+    CHECK(ok, "erase keeps probe runs intact");
+
+    unsigned int* p = t.find(7919ull);
+    CHECK(p && *p == 1, "find");
+    *p = 42;
+    unsigned int v = 0;
+    CHECK(t.get(7919ull, v) && v == 42, "in-place update");
+
+    HashTable<std::string, int> names;
+    names.put("alice", 1);
+    names.put("bob", 2);
+    names.put("alice", 3);
+    CHECK(names.size() == 2 && names.find("alice") && *names.find("alice") == 3,
+          "heterogeneous lookup");
+
+    return true;
+}
+
+bool test_node_pool() {
+    cout << "\n==== TEST NODE POOL ====\n";
+
+    size_t base = NodePool::local().live_nodes();
+    {
+        Queue<int> q;
+        Stack<int> st;
+        AVLTree<int, int> tree;
+        for (int i = 0; i < 5000; i++) {
+            q.enqueue(i);
+            st.push(i);
+            tree.insert(i, i * 2);
+        }
+        CHECK(NodePool::local().live_nodes() == base + 15000, "nodes come from the pool");
+
+        int v = -1;
+        q.dequeue(v);
+        CHECK(v == 0, "queue order");
+        st.pop(v);
+        CHECK(v == 4999, "stack order");
+        for (int i = 0; i < 5000; i += 2) tree.erase(i);
+        CHECK(tree.get(4001, v) && v == 8002 && !tree.contains(4000), "tree after erase");
+
+        // freed nodes are reused before the slab grows
+        size_t live = NodePool::local().live_nodes();
+        q.enqueue(1);
+        CHECK(NodePool::local().live_nodes() == live + 1, "free list reuse");
+    }
+    CHECK(NodePool::local().live_nodes() == base, "all nodes returned");
+
+    Queue<int, HeapAllocator> heap_q;
+    heap_q.enqueue(7);
+    CHECK(NodePool::local().live_nodes() == base, "heap allocator bypasses pool");
+
+    return true;
+}
+
+bool test_ordered_listing() {
+    cout << "\n==== TEST ORDERED LISTING ====\n";
+
+    // small fanout so splits, borrows and merges happen at every level
+    BPlusTree<int, int, 4> t;
+    std::map<int, int> ref;
+    unsigned int seed = 12345;
+    bool ok = true;
+    for (int i = 0; i < 20000 && ok; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int k = (int)((seed >> 8) % 2000);
+        if ((seed >> 4) % 3 == 0) ok = t.erase(k) == (ref.erase(k) == 1);
+        else { t.insert(k, i); ref[k] = i; }
+    }
+    ok = ok && t.size() == ref.size();
+    auto c = t.begin();
+    for (auto& kv : ref) {
+        if (!c.valid() || c.key() != kv.first || c.value() != kv.second) { ok = false; break; }
+        c.next();
+    }
+    CHECK(ok && !c.valid(), "random insert/erase matches std::map");
+
+    std::vector<std::pair<int, int>> sorted;
+    for (int i = 0; i < 1000; i++) sorted.push_back(std::make_pair(i * 2, i));
+    t.bulk_load(sorted);
+    for (int i = 1; i < 2000; i += 2) t.insert(i, -1);
+    for (int i = 0; i < 2000; i += 3) t.erase(i);
+    c = t.lower_bound(1500);
+    CHECK(t.size() == 2000 - 667 && c.valid() && c.key() == 1501, "bulk load then update");
+
+    FileSystem fs;
+    create_fs(fs, "test.omni");
+    load_fs(fs, "test.omni");
+
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+    fs.dir_create(admin, "/pg");
+    const char* names[] = { "beta", "Alpha", "gamma", "alpine", "delta", "al" };
+    for (const char* n : names) fs.file_create(admin, (std::string("/pg/") + n).c_str(), "x", 1);
+
+    FileEntry* out;
+    int count;
+    fs.dir_list(admin, "/pg", &out, &count);
+    CHECK(count == 6 && strcmp(out[0].name, "al") == 0 && strcmp(out[5].name, "gamma") == 0,
+          "dir_list sorted by name");
+    free(out);
+
+    fs.dir_list_page(admin, "/pg", "al", "", 2, &out, &count);
+    CHECK(count == 2 && strcmp(out[1].name, "Alpha") == 0, "prefix page 1");
+    std::string cursor = FileSystem::page_cursor(out[1]);
+    free(out);
+    fs.dir_list_page(admin, "/pg", "al", cursor.c_str(), 2, &out, &count);
+    CHECK(count == 1 && strcmp(out[0].name, "alpine") == 0, "prefix page 2 resumes after cursor");
+    free(out);
+
+    // names that differ only in case, split across page boundaries
+    fs.dir_create(admin, "/cv");
+    const char* variants[] = { "ab", "AB", "Ab", "aB", "ac", "AC", "ad" };
+    for (const char* n : variants) fs.file_create(admin, (std::string("/cv/") + n).c_str(), "x", 1);
+    std::vector<std::string> seen;
+    cursor.clear();
+    for (int page = 0; page < 10; page++) {
+        fs.dir_list_page(admin, "/cv", "", cursor.c_str(), 2, &out, &count);
+        for (int i = 0; i < count; i++) seen.push_back(out[i].name);
+        if (count) cursor = FileSystem::page_cursor(out[count - 1]);
+        free(out);
+        if (count < 2) break;
+    }
+    std::vector<std::string> want(variants, variants + 7);
+    std::vector<std::string> got = seen;
+    std::sort(want.begin(), want.end());
+    std::sort(got.begin(), got.end());
+    CHECK(got == want, "pages of case variants list every entry once");
+    fs.dir_list_page(admin, "/cv", "", "ab", 0, &out, &count);
+    CHECK(count == 3 && strcasecmp(out[0].name, "ac") == 0, "a bare name skips all its variants");
+    free(out);
+
+    CHECK(fs.file_create(admin, "/pg/beta", "y", 1) == OFSErrorCodes::ERROR_FILE_EXISTS,
+          "duplicate detected through index");
+    fs.file_delete(admin, "/pg/beta");
+    void* snap = nullptr;
+    uint64_t sz = 0;
+    CHECK(fs.snapshot_open(admin, "/pg/BETA", &snap, &sz) == OFSErrorCodes::ERROR_NOT_FOUND,
+          "deleted entry leaves the index");
+
+    return true;
+}
+
+bool test_session_expiry() {
+    cout << "\n==== TEST SESSION EXPIRY ====\n";
+
+    // wheel: timers across every level fire on their own tick
+    TimerWheel w;
+    w.init(1000);
+    const uint64_t due[] = { 1001, 1002, 1063, 1064, 1065, 5000, 300000, 20000000 };
+    TimerNode nodes[8];
+    for (int i = 0; i < 8; i++) {
+        nodes[i].id = i;
+        w.schedule(&nodes[i], due[i]);
+    }
+    TimerNode cancelled;
+    w.schedule(&cancelled, 1500);
+    w.cancel(&cancelled);
+
+    std::vector<uint64_t> fired;
+    bool ok = w.size() == 8;
+    for (int i = 0; i < 8 && ok; i++) {
+        w.advance(due[i] - 1, fired);
+        ok = fired.size() == (size_t)i;
+        w.advance(due[i], fired);
+        ok = ok && fired.size() == (size_t)i + 1 && fired[i] == (uint64_t)i;
+    }
+    CHECK(ok && w.size() == 0, "timer wheel fires on time");
+
+    FileSystem fs;
+    FSConfig cfg = make_config();
+    cfg.session_idle_timeout = 1;
+    fs.format_new(cfg, "test.omni");
+    fs.load_existing(cfg, "test.omni");
+
+    void* a = nullptr;
+    void* b = nullptr;
+    fs.user_login("admin", "admin123", &a);
+    fs.user_login("admin", "admin123", &b);
+
+    SessionInfo inf{};
+    fs.get_session_info(a, &inf);
+    fs.get_session_info(a, &inf);
+    CHECK(inf.operations_count == 2 && inf.last_activity >= inf.login_time, "activity tracked");
+
+    sleep(2);
+    CHECK(fs.expire_sessions() == 2, "idle sessions expired by the wheel");
+    CHECK(fs.get_session_info(a, &inf) == OFSErrorCodes::ERROR_INVALID_SESSION,
+          "expired handle rejected");
+
+    return true;
+}
+
+static std::string to_hex(const uint8_t* p, size_t n) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s;
+    for (size_t i = 0; i < n; i++) { s += digits[p[i] >> 4]; s += digits[p[i] & 15]; }
+    return s;
+}
+
+bool test_passwords() {
+    cout << "\n==== TEST PASSWORDS ====\n";
+
+    uint8_t d[32];
+    Sha256::hash("abc", 3, d);
+    CHECK(to_hex(d, 32) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+          "sha256 test vector");
+    pbkdf2_sha256("passwd", 6, (const uint8_t*)"salt", 4, 1, d, 16);
+    CHECK(to_hex(d, 16) == "55ac046e56e3089fec1691c22544b605", "pbkdf2 test vector");
+
+    FileSystem fs;
+    create_fs(fs, "test.omni");
+    load_fs(fs, "test.omni");
+
+    void* admin = nullptr;
+    CHECK(fs.user_login("admin", "wrong", &admin) == OFSErrorCodes::ERROR_PERMISSION_DENIED,
+          "wrong admin password rejected");
+    fs.user_login("admin", "admin123", &admin);
+    fs.user_create(admin, "carol", "s3cret", UserRole::NORMAL);
+
+    void* c = nullptr;
+    CHECK(fs.user_login("carol", "s3cret", &c) == OFSErrorCodes::SUCCESS, "user login");
+    CHECK(fs.user_login("carol", "s3cret", &c) == OFSErrorCodes::SUCCESS, "cached login");
+    CHECK(fs.user_login("carol", "S3cret", &c) == OFSErrorCodes::ERROR_PERMISSION_DENIED,
+          "wrong user password rejected");
+
+    SessionInfo inf;
+    fs.get_session_info(c, &inf);
+    bool scrubbed = true;
+    for (size_t i = 0; i < sizeof(inf.user.password_hash); i++)
+        if (inf.user.password_hash[i]) scrubbed = false;
+    CHECK(scrubbed, "session info carries no hash");
+
+    // recreated user: the cache must not accept the old password
+    fs.user_delete(admin, "carol");
+    fs.user_create(admin, "carol", "n3w", UserRole::NORMAL);
+    CHECK(fs.user_login("carol", "s3cret", &c) == OFSErrorCodes::ERROR_PERMISSION_DENIED,
+          "cache invalidated by new record");
+
+    return true;
+}
+
+bool test_substitution() {
+    cout << "\n==== TEST SUBSTITUTION ====\n";
+
+    std::vector<unsigned char> table(256);
+    for (int i = 0; i < 256; i++) table[i] = (unsigned char)((i * 167 + 13) & 0xff);
+    SecurityManager sec;
+    sec.set_table(table);
+
+    std::vector<uint8_t> plain(1000), want(1000), got(1000);
+    for (size_t i = 0; i < plain.size(); i++) plain[i] = (uint8_t)(i * 31 + (i >> 8));
+    for (size_t i = 0; i < plain.size(); i++) want[i] = table[plain[i]];
+
+    const SubstKernel kernels[] = { SubstKernel::SCALAR, SubstKernel::SSSE3,
+                                    SubstKernel::AVX2, SubstKernel::AVX512_VBMI };
+    for (SubstKernel k : kernels) {
+        if (!subst_supported(k)) { cout << "  (skip " << subst_name(k) << ")\n"; continue; }
+        // every length up to a few vectors, so all tails are covered
+        bool ok = true;
+        for (size_t n = 0; n <= 200 && ok; n++) {
+            got.assign(plain.begin(), plain.end());
+            subst_run(k, got.data() + 1, got.data() + 1, n, table.data());
+            ok = memcmp(got.data() + 1, want.data() + 1, n) == 0 && got[n + 1] == plain[n + 1];
+        }
+        CHECK(ok, subst_name(k) << " kernel matches table");
+    }
+
+    got.assign(plain.begin(), plain.end());
+    sec.encode(got.data(), got.size());
+    CHECK(got == want, "encode");
+    sec.decode(got.data(), got.size());
+    CHECK(got == plain, "decode round trip");
+
+    return true;
+}
+
+bool test_encoded_content() {
+    cout << "\n==== TEST ENCODED CONTENT ====\n";
+
+    FileSystem fs;
+    create_fs(fs, "test.omni");
+    load_fs(fs, "test.omni");
+    CHECK(fs.content_encoded(), "new container encodes content");
+
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+    std::string text;
+    while (text.size() < 10000) text += "plaintext-marker ";
+    fs.file_create(admin, "/enc", text.c_str(), text.size());
+    fs.file_edit(admin, "/enc", "plaintext-marker", 16, 3);
+    text.replace(3, 16, "plaintext-marker");
+    fs.shutdown();
+
+    std::ifstream in("test.omni", std::ios::binary);
+    std::string disk((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CHECK(disk.find("plaintext-marker") == std::string::npos, "no plaintext on disk");
+
+    FileSystem fs2;
+    load_fs(fs2, "test.omni");
+    fs2.user_login("admin", "admin123", &admin);
+    char* buf;
+    size_t sz;
+    CHECK(fs2.file_read(admin, "/enc", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == text, "decoded on read after remount");
+    free(buf);
+
+    // the same key always yields the same table
+    uint8_t a[256], b[256];
+    SecurityManager::derive_table("k1", 2, a);
+    SecurityManager::derive_table("k1", 2, b);
+    SecurityManager check;
+    CHECK(memcmp(a, b, 256) == 0 && check.set_table(a), "keyed table is a stable permutation");
+
+    return true;
+}
+
+static void flip_byte(const char* path, size_t off) {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(off);
+    char c = 0;
+    f.read(&c, 1);
+    c ^= 0x40;
+    f.seekp(off);
+    f.write(&c, 1);
+}
+
+bool test_checksums() {
+    cout << "\n==== TEST CHECKSUMS ====\n";
+
+    CHECK(crc32c("123456789", 9) == 0xE3069283, "crc32c test vector");
+    CHECK(crc32c_extend(crc32c("1234", 4), "56789", 5) == 0xE3069283, "crc32c extend");
+
+    FileSystem fs;
+    create_fs(fs, "test.omni");
+    load_fs(fs, "test.omni");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+    std::string text(9000, 'q');
+    fs.file_create(admin, "/chkfile", text.c_str(), text.size());
+    fs.file_create(admin, "/other", "x", 1);
+    fs.shutdown();
+
+    std::string disk;
+    {
+        std::ifstream in("test.omni", std::ios::binary);
+        disk.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+    // content is encoded: look for the encoded run of 'q'
+    uint8_t q = (uint8_t)disk[offsetof(OMNIHeader, encoding_table) + 'q'];
+    size_t data_at = disk.find(std::string(64, (char)q));
+    size_t name_at = disk.find("chkfile");
+    CHECK(data_at != std::string::npos && name_at != std::string::npos, "located content and entry");
+
+    {
+        FileSystem clean;
+        load_fs(clean, "test.omni");
+        CHECK(clean.integrity_errors() == 0, "clean container verifies");
+    }
+
+    flip_byte("test.omni", data_at + 100);
+    char* buf;
+    size_t sz;
+    {
+        FileSystem fs2;
+        load_fs(fs2, "test.omni");
+        fs2.user_login("admin", "admin123", &admin);
+        CHECK(fs2.file_read(admin, "/chkfile", &buf, &sz) == OFSErrorCodes::ERROR_IO_ERROR,
+              "corrupt block rejected on read");
+        CHECK(fs2.integrity_errors() == 1, "block failure counted");
+        CHECK(fs2.file_read(admin, "/other", &buf, &sz) == OFSErrorCodes::SUCCESS, "other file intact");
+        free(buf);
+    }
+    {
+        FSConfig cfg = make_config();
+        cfg.verify_mode = VERIFY_SCRUB;
+        FileSystem fs3;
+        fs3.load_existing(cfg, "test.omni");
+        fs3.user_login("admin", "admin123", &admin);
+        CHECK(fs3.file_read(admin, "/chkfile", &buf, &sz) == OFSErrorCodes::SUCCESS,
+              "scrub mode does not check on read");
+        free(buf);
+        CHECK(fs3.scrub_step(1u << 20) == 1, "scrub finds the bad block");
+    }
+
+    // start_index of the entry (name is at offset 6, start_index follows it)
+    flip_byte("test.omni", data_at + 100);
+    flip_byte("test.omni", name_at + 12);
+    {
+        FileSystem fs4;
+        load_fs(fs4, "test.omni");
+        fs4.user_login("admin", "admin123", &admin);
+        CHECK(fs4.integrity_errors() == 1, "damaged entry found at mount");
+        CHECK(fs4.file_read(admin, "/chkfile", &buf, &sz) == OFSErrorCodes::ERROR_IO_ERROR,
+              "damaged entry not followed");
+    }
+
+    return true;
+}
+
+bool test_inline_files() {
+    cout << "\n==== TEST INLINE FILES ====\n";
+
+    FileSystem fs;
+    create_fs(fs, "test.omni");
+    load_fs(fs, "test.omni");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    char* buf;
+    size_t sz;
+    std::string small(150, 'a');
+    fs.file_create(admin, "/small", small.c_str(), small.size());
+    fs.file_edit(admin, "/small", "XY", 2, 10);
+    small.replace(10, 2, "XY");
+    CHECK(fs.file_read(admin, "/small", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == small, "inline read after edit");
+    free(buf);
+
+    // a gap past the end reads back as zeros
+    fs.file_edit(admin, "/small", "Z", 1, 160);
+    small += std::string(10, '\0') + "Z";
+    CHECK(fs.file_read(admin, "/small", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == small, "inline gap zero-filled");
+    free(buf);
+
+    // a snapshot keeps the content it opened with across promotion
+    void* snap = nullptr;
+    uint64_t snap_size = 0;
+    fs.snapshot_open(admin, "/small", &snap, &snap_size);
+
+    std::string more(500, 'b');
+    CHECK(fs.file_edit(admin, "/small", more.c_str(), more.size(), 100) == OFSErrorCodes::SUCCESS,
+          "edit past the slot promotes");
+    std::string grown = small.substr(0, 100) + more;
+
+    std::string old(snap_size, ' ');
+    size_t got = 0;
+    fs.snapshot_read(snap, 0, &old[0], old.size(), &got);
+    CHECK(got == small.size() && old == small, "snapshot unaffected by promotion");
+    fs.snapshot_close(snap);
+
+    fs.file_create(admin, "/gap", "", 0);
+    fs.file_edit(admin, "/gap", "E", 1, 5000);
+    fs.file_create(admin, "/empty", "", 0);
+    fs.file_create(admin, "/trunc", more.c_str(), more.size());
+    fs.file_truncate(admin, "/trunc");
+    fs.file_edit(admin, "/trunc", "tiny", 4, 0);
+    fs.shutdown();
+
+    FileSystem fs2;
+    load_fs(fs2, "test.omni");
+    fs2.user_login("admin", "admin123", &admin);
+    CHECK(fs2.integrity_errors() == 0, "inline slots verify after remount");
+    CHECK(fs2.file_read(admin, "/small", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == grown, "promoted content after remount");
+    free(buf);
+    CHECK(fs2.file_read(admin, "/gap", &buf, &sz) == OFSErrorCodes::SUCCESS && sz == 5001 &&
+          std::string(buf, 5000) == std::string(5000, '\0') && buf[5000] == 'E',
+          "block gap zero-filled");
+    free(buf);
+    CHECK(fs2.file_read(admin, "/empty", &buf, &sz) == OFSErrorCodes::SUCCESS && sz == 0,
+          "empty inline file");
+    free(buf);
+    CHECK(fs2.file_read(admin, "/trunc", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == "tiny", "truncated file goes inline");
+    free(buf);
+
+    return true;
+}
+
+bool test_tail_packing() {
+    cout << "\n==== TEST TAIL PACKING ====\n";
+
+    FileSystem fs;
+    create_fs(fs, "test.omni");
+    load_fs(fs, "test.omni");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    const size_t payload = 4092;
+    std::vector<std::string> body;
+    for (int i = 0; i < 8; i++) {
+        body.push_back(std::string(payload + 300 + i * 40, (char)('a' + i)));
+        std::string path = "/t" + std::to_string(i);
+        fs.file_create(admin, path.c_str(), body[i].c_str(), body[i].size());
+    }
+    std::string big(payload + 3000, 'B');
+    fs.file_create(admin, "/big", big.c_str(), big.size());
+
+    CHECK(fs.pack_tails() == 8, "small tails packed, large tail kept");
+
+    char* buf;
+    size_t sz;
+    CHECK(fs.file_read(admin, "/t3", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == body[3], "packed file reads back");
+    free(buf);
+
+    // a snapshot keeps the packed tail across an append that unpacks it
+    void* snap = nullptr;
+    uint64_t snap_size = 0;
+    fs.snapshot_open(admin, "/t5", &snap, &snap_size);
+    CHECK(fs.file_edit(admin, "/t5", "END", 3, body[5].size()) == OFSErrorCodes::SUCCESS,
+          "append to packed file");
+    std::string old(snap_size, ' ');
+    size_t got = 0;
+    fs.snapshot_read(snap, payload - 10, &old[0], old.size() - (payload - 10), &got);
+    CHECK(got == snap_size - (payload - 10) &&
+          old.substr(0, got) == body[5].substr(payload - 10), "snapshot spans chain and tail");
+    fs.snapshot_close(snap);
+    body[5] += "END";
+
+    fs.file_delete(admin, "/t1");
+    fs.file_truncate(admin, "/t2");
+    fs.file_edit(admin, "/t2", "short", 5, 0);
+    body[2] = "short";
+    fs.shutdown();
+
+    FileSystem fs2;
+    load_fs(fs2, "test.omni");
+    fs2.user_login("admin", "admin123", &admin);
+    CHECK(fs2.integrity_errors() == 0, "packed tails verify after remount");
+    for (int i = 0; i < 8; i++) {
+        if (i == 1) continue;
+        std::string path = "/t" + std::to_string(i);
+        bool ok = fs2.file_read(admin, path.c_str(), &buf, &sz) == OFSErrorCodes::SUCCESS &&
+                  std::string(buf, sz) == body[i];
+        free(buf);
+        CHECK(ok, "tail content after remount");
+    }
+    CHECK(fs2.file_read(admin, "/big", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == big, "unpacked large tail");
+    free(buf);
+
+    // fragment space freed by the delete is reused after remount
+    std::string again(payload + 500, 'z');
+    fs2.file_create(admin, "/again", again.c_str(), again.size());
+    CHECK(fs2.pack_tails() == 1, "new tail packed after remount");
+    CHECK(fs2.file_read(admin, "/again", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == again, "reused fragment reads back");
+    free(buf);
+    CHECK(fs2.file_read(admin, "/t0", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == body[0], "neighbouring tail intact");
+    free(buf);
+
+    return true;
+}
+
+// allocated blocks, from the free map as sync writes it
+static uint32_t used_blocks(FileSystem& fs) {
+    fs.sync();
+    const FSLayout& l = fs.get_layout();
+    std::vector<uint8_t> map(l.free_map_size);
+    FILE* f = fopen(fs.get_path().c_str(), "rb");
+    fseek(f, (long)l.free_map_offset, SEEK_SET);
+    size_t got = fread(map.data(), 1, map.size(), f);
+    fclose(f);
+    uint32_t n = 0;
+    for (size_t i = 0; i < got; i++) n += __builtin_popcount(map[i]);
+    return n;
+}
+
+bool test_compression() {
+    cout << "\n==== TEST COMPRESSION ====\n";
+
+    std::string text;
+    for (int i = 0; text.size() < 200000; i++)
+        text += "{\"id\":" + std::to_string(i) + ",\"name\":\"user" + std::to_string(i % 97) +
+                "\",\"active\":" + (i % 3 ? "true" : "false") + "}\n";
+    std::string noise(200000, ' ');
+    uint32_t x = 12345;
+    for (char& c : noise) { x = x * 1103515245u + 12345u; c = (char)(x >> 24); }
+
+    // codec round trips, including tiny and run-length inputs
+    std::vector<std::string> inputs = { "", "a", "abcdabcdabcdabcdabcd", std::string(5000, 'z'),
+                                        text.substr(0, 65536), noise.substr(0, 4096) };
+    bool ok = true;
+    for (const std::string& in : inputs) {
+        std::vector<uint8_t> c(lz4_bound(in.size())), d(in.size() + 1);
+        size_t cn = lz4_compress((const uint8_t*)in.data(), in.size(), c.data(), c.size());
+        long dn = lz4_decompress(c.data(), cn, d.data(), in.size());
+        ok = ok && cn > 0 && dn == (long)in.size() && memcmp(d.data(), in.data(), in.size()) == 0;
+        if (cn > 2) ok = ok && lz4_decompress(c.data(), cn - 2, d.data(), in.size()) != (long)in.size();
+    }
+    CHECK(ok, "lz4 round trip");
+    CHECK(lz4_worth_trying((const uint8_t*)text.data(), 65536) &&
+          !lz4_worth_trying((const uint8_t*)noise.data(), 65536), "entropy sample");
+
+    FSConfig cfg = make_config();
+    cfg.compression = 1;
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni"), "mount with compression");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    fs.file_create(admin, "/json", text.c_str(), text.size());
+    fs.file_create(admin, "/noise", noise.c_str(), noise.size());
+
+    // compressed content has no extents to send as is
+    void* snap = nullptr;
+    uint64_t snap_size = 0, ext_off, ext_len;
+    fs.snapshot_open(admin, "/json", &snap, &snap_size);
+    CHECK(fs.snapshot_next_extent(snap, &ext_off, &ext_len) == OFSErrorCodes::ERROR_INVALID_OPERATION,
+          "text file stored compressed");
+    void* snap2 = nullptr;
+    fs.snapshot_open(admin, "/noise", &snap2, &snap_size);
+    CHECK(fs.snapshot_next_extent(snap2, &ext_off, &ext_len) == OFSErrorCodes::SUCCESS && ext_len > 0,
+          "incompressible file stored plain");
+    fs.snapshot_close(snap2);
+
+    // edit inside the second extent and extend past the end with a gap
+    std::string old = text;
+    fs.file_edit(admin, "/json", "EDITED", 6, 70000);
+    text.replace(70000, 6, "EDITED");
+    fs.file_edit(admin, "/json", "TAIL", 4, text.size() + 10);
+    text += std::string(10, '\0') + "TAIL";
+
+    char* buf;
+    size_t sz;
+    CHECK(fs.file_read(admin, "/json", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == text, "compressed file after edits");
+    free(buf);
+
+    std::string part(1000, ' ');
+    size_t got = 0;
+    fs.snapshot_read(snap, 65000, &part[0], part.size(), &got);
+    CHECK(got == 1000 && part == old.substr(65000, 1000), "snapshot reads across extents");
+    fs.snapshot_close(snap);
+
+    // an edit packs only the extents it touches; a reader keeps the old
+    // chain, so the blocks it allocates show
+    std::string big;
+    for (int i = 0; big.size() < 1000000; i++)
+        big += "row " + std::to_string(i * 7919 % 100003) + " value " + std::to_string(i % 1000) + "\n";
+    uint32_t used = used_blocks(fs);
+    fs.file_create(admin, "/big", big.c_str(), big.size());
+    uint32_t chain = used_blocks(fs) - used;
+    used += chain;
+    fs.snapshot_open(admin, "/big", &snap, &snap_size);
+    CHECK(fs.file_edit(admin, "/big", "EDIT", 4, 100) == OFSErrorCodes::SUCCESS, "edit the first extent");
+    old = big;
+    big.replace(100, 4, "EDIT");
+    uint32_t copied = used_blocks(fs) - used;
+    CHECK(copied * 8 < chain, "table and first extent copied, the rest shared (" << copied << " of " <<
+          chain << " blocks)");
+    CHECK(fs.file_read(admin, "/big", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == big, "edited content");
+    free(buf);
+    part.assign(old.size(), ' ');
+    fs.snapshot_read(snap, 0, &part[0], part.size(), &got);
+    CHECK(got == old.size() && part == old, "reader sees the content before the edit");
+    fs.snapshot_close(snap);
+
+    // an extent that no longer fits its slot moves the ones after it
+    std::string chunk = noise.substr(0, 20000);
+    fs.file_edit(admin, "/big", chunk.c_str(), chunk.size(), 3 * 65536 + 100);
+    big.replace(3 * 65536 + 100, chunk.size(), chunk);
+    // an extent that shrinks keeps its slot
+    std::string zeros(60000, 'z');
+    fs.file_edit(admin, "/big", zeros.c_str(), zeros.size(), 5 * 65536);
+    big.replace(5 * 65536, zeros.size(), zeros);
+    // an append past the last extent grows the table
+    fs.file_edit(admin, "/big", text.c_str(), 70000, big.size());
+    big += text.substr(0, 70000);
+    CHECK(fs.file_read(admin, "/big", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == big, "content after moving, shrinking and appending extents");
+    free(buf);
+    fs.shutdown();
+
+    FileSystem fs2;
+    CHECK(fs2.load_existing(cfg, "test.omni"), "remount");
+    fs2.user_login("admin", "admin123", &admin);
+    CHECK(fs2.integrity_errors() == 0, "compressed chains verify after remount");
+    CHECK(fs2.file_read(admin, "/json", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == text, "compressed content after remount");
+    free(buf);
+    CHECK(fs2.file_read(admin, "/noise", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == noise, "plain content after remount");
+    free(buf);
+    CHECK(fs2.file_read(admin, "/big", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == big, "rewritten extents after remount");
+    free(buf);
+    CHECK(fs2.file_truncate(admin, "/json") == OFSErrorCodes::SUCCESS &&
+          fs2.file_delete(admin, "/json") == OFSErrorCodes::SUCCESS, "truncate and delete");
+
+    return true;
+}
+
+bool test_dedup() {
+    cout << "\n==== TEST DEDUP ====\n";
+
+    FSConfig cfg = make_config();
+    cfg.dedup = 1;
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni"), "mount with dedup");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    // five blocks, each different so only whole suffixes can match
+    const size_t payload = 4092;
+    std::string x;
+    for (int i = 0; i < 5; i++) x += std::string(payload, (char)('A' + i));
+    x.resize(x.size() - 1000);
+    std::string y = x;
+    y[10] = '#';
+
+    fs.file_create(admin, "/a", x.c_str(), x.size());
+    CHECK(fs.dedup_hits() == 0, "first copy writes every block");
+    fs.file_create(admin, "/b", x.c_str(), x.size());
+    CHECK(fs.dedup_hits() == 5, "identical file shares the whole chain");
+    fs.file_create(admin, "/c", y.c_str(), y.size());
+    CHECK(fs.dedup_hits() == 9, "different first block shares the rest");
+
+    // editing a shared file copies instead of writing through
+    std::string b = x;
+    fs.file_edit(admin, "/b", "EDIT", 4, 2 * payload + 5);
+    b.replace(2 * payload + 5, 4, "EDIT");
+    char* buf;
+    size_t sz;
+    CHECK(fs.file_read(admin, "/a", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == x, "shared chain unchanged by edit");
+    free(buf);
+    CHECK(fs.file_read(admin, "/b", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == b, "edited copy");
+    free(buf);
+
+    // deleting one owner leaves the blocks to the others
+    fs.file_delete(admin, "/a");
+    fs.file_truncate(admin, "/b");
+    CHECK(fs.file_read(admin, "/c", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == y, "shared suffix survives delete");
+    free(buf);
+    fs.shutdown();
+
+    FileSystem fs2;
+    CHECK(fs2.load_existing(cfg, "test.omni"), "remount");
+    fs2.user_login("admin", "admin123", &admin);
+    CHECK(fs2.integrity_errors() == 0, "dedup chains verify after remount");
+    CHECK(fs2.file_read(admin, "/c", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == y, "shared content after remount");
+    free(buf);
+
+    // the persisted index still knows the surviving blocks
+    fs2.file_create(admin, "/d", x.c_str(), x.size());
+    CHECK(fs2.dedup_hits() == 4, "index rebuilt from persisted fingerprints");
+    fs2.file_delete(admin, "/c");
+    CHECK(fs2.file_read(admin, "/d", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == x, "content after the other owner is deleted");
+    free(buf);
+
+    return true;
+}
+
+bool test_block_cache() {
+    cout << "\n==== TEST BLOCK CACHE ====\n";
+
+    FSConfig cfg = make_config();
+    cfg.cache_size = 64 * 4096;          // far smaller than the data written below
+    cfg.dedup = 1;
+    cfg.compression = 1;
+    cfg.verify_mode = VERIFY_ALWAYS;
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni"), "mount with a small cache");
+    CHECK(fs.block_cache().capacity() == 64, "cache holds the configured budget");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    // many files, several written twice so dedup shares their chains, with
+    // edits and a snapshot interleaved so frames are evicted mid-operation
+    std::vector<std::string> body(24);
+    uint32_t x = 7;
+    for (int i = 0; i < 24; i++) {
+        body[i].resize(20000 + i * 3001);
+        for (char& c : body[i]) { x = x * 1103515245u + 12345u; c = (char)(x >> 24); }
+        if (i % 6 == 5) body[i] = body[i - 1];
+        std::string path = "/f" + std::to_string(i);
+        fs.file_create(admin, path.c_str(), body[i].c_str(), body[i].size());
+    }
+    void* snap = nullptr;
+    uint64_t snap_size = 0;
+    fs.snapshot_open(admin, "/f3", &snap, &snap_size);
+    std::string before = body[3];
+    for (int i = 0; i < 24; i += 3) {
+        std::string path = "/f" + std::to_string(i);
+        std::string patch(5000, (char)('a' + i));
+        fs.file_edit(admin, path.c_str(), patch.c_str(), patch.size(), 9000);
+        body[i].replace(9000, patch.size(), patch);
+    }
+    std::string old(snap_size, ' ');
+    size_t got = 0;
+    fs.snapshot_read(snap, 0, &old[0], old.size(), &got);
+    CHECK(got == snap_size && old == before, "snapshot across evictions");
+    fs.snapshot_close(snap);
+
+    bool ok = true;
+    char* buf;
+    size_t sz;
+    for (int i = 0; i < 24; i++) {
+        std::string path = "/f" + std::to_string(i);
+        ok = ok && fs.file_read(admin, path.c_str(), &buf, &sz) == OFSErrorCodes::SUCCESS &&
+             std::string(buf, sz) == body[i];
+        free(buf);
+    }
+    CHECK(ok, "content read back through the cache");
+    CHECK(fs.block_cache().misses() > 64 && fs.integrity_errors() == 0, "evicted blocks reload intact");
+    fs.shutdown();
+
+    FileSystem fs2;
+    CHECK(fs2.load_existing(cfg, "test.omni"), "remount");
+    fs2.user_login("admin", "admin123", &admin);
+    ok = true;
+    for (int i = 0; i < 24; i++) {
+        std::string path = "/f" + std::to_string(i);
+        ok = ok && fs2.file_read(admin, path.c_str(), &buf, &sz) == OFSErrorCodes::SUCCESS &&
+             std::string(buf, sz) == body[i];
+        free(buf);
+    }
+    CHECK(ok && fs2.integrity_errors() == 0, "written-back content after remount");
+
+    // a small file read repeatedly stays resident while a large one streams by
+    uint64_t m0 = fs2.block_cache().misses();
+    for (int round = 0; round < 4; round++) {
+        fs2.file_read(admin, "/f1", &buf, &sz);
+        free(buf);
+        fs2.file_read(admin, "/f23", &buf, &sz);
+        free(buf);
+    }
+    uint64_t f23_blocks = (body[23].size() + 4091) / 4092;
+    CHECK(fs2.block_cache().misses() - m0 < 4 * f23_blocks + 4 * 6, "hot file kept over a scan");
+
+    return true;
+}
+
+bool test_readahead() {
+    cout << "\n==== TEST READAHEAD ====\n";
+
+    FSConfig cfg = make_config();
+    cfg.cache_size = 256 * 4096;
+    cfg.verify_mode = VERIFY_ALWAYS;
+    {
+        FileSystem fs;
+        fs.format_new(cfg, "test.omni");
+        fs.load_existing(cfg, "test.omni");
+        void* admin = nullptr;
+        fs.user_login("admin", "admin123", &admin);
+        std::string big(600 * 4092 + 77, ' ');
+        for (size_t i = 0; i < big.size(); i++) big[i] = (char)(i * 31 + i / 4092);
+        fs.file_create(admin, "/big", big.c_str(), big.size());
+        fs.shutdown();
+    }
+
+    FileSystem fs;
+    CHECK(fs.load_existing(cfg, "test.omni"), "cold mount");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    // one whole-file read: the range is fetched in batches, not per block
+    char* buf;
+    size_t sz;
+    CHECK(fs.file_read(admin, "/big", &buf, &sz) == OFSErrorCodes::SUCCESS && sz == 600 * 4092 + 77,
+          "cold whole-file read");
+    std::string big(buf, sz);
+    free(buf);
+    bool ok = true;
+    for (size_t i = 0; i < big.size(); i++) ok = ok && big[i] == (char)(i * 31 + i / 4092);
+    CHECK(ok, "content");
+    CHECK(fs.block_cache().misses() < 20 && fs.block_cache().read_ahead() >= 1200,
+          "whole-file read batched");
+
+    // a handle streaming small reads ramps up its window
+    FileSystem fs2;
+    fs2.load_existing(cfg, "test.omni");
+    fs2.user_login("admin", "admin123", &admin);
+    void* snap = nullptr;
+    uint64_t size = 0;
+    fs2.snapshot_open(admin, "/big", &snap, &size);
+    std::string got;
+    char chunk[1000];
+    size_t n = 0;
+    for (uint64_t off = 0; off < size; off += n) {
+        if (fs2.snapshot_read(snap, off, chunk, sizeof(chunk), &n) != OFSErrorCodes::SUCCESS || !n) break;
+        got.append(chunk, n);
+    }
+    CHECK(got == big, "sequential handle reads");
+    CHECK(fs2.block_cache().misses() < 20, "sequential reads stay ahead of the reader");
+
+    // random reads on the same handle still return the right bytes
+    ok = true;
+    uint32_t x = 99;
+    for (int i = 0; i < 200; i++) {
+        x = x * 1103515245u + 12345u;
+        uint64_t off = x % (size - sizeof(chunk));
+        ok = ok && fs2.snapshot_read(snap, off, chunk, sizeof(chunk), &n) == OFSErrorCodes::SUCCESS &&
+             n == sizeof(chunk) && memcmp(chunk, big.data() + off, n) == 0;
+    }
+    CHECK(ok && fs2.integrity_errors() == 0, "random reads");
+    fs2.snapshot_close(snap);
+
+    return true;
+}
+
+bool test_io_backends() {
+    cout << "\n==== TEST IO BACKENDS ====\n";
+
+    std::vector<std::string> body(12);
+    uint32_t x = 5;
+    for (int i = 0; i < 12; i++) {
+        body[i].resize(30000 + i * 7001);
+        for (char& c : body[i]) { x = x * 1103515245u + 12345u; c = (char)(x >> 24); }
+    }
+
+    // written with one backend, edited with the other, read with the first
+    uint32_t order[3] = { IO_URING, IO_PREAD, IO_URING };
+    bool ok = true;
+    for (int round = 0; round < 3; round++) {
+        FSConfig cfg = make_config();
+        cfg.cache_size = 64 * 4096;
+        cfg.io_backend = order[round];
+        FileSystem fs;
+        if (round == 0) fs.format_new(cfg, "test.omni");
+        CHECK(fs.load_existing(cfg, "test.omni"), "mount");
+        cout << "  backend: " << fs.io_backend_name() << "\n";
+        void* admin = nullptr;
+        fs.user_login("admin", "admin123", &admin);
+
+        char* buf;
+        size_t sz;
+        for (int i = 0; i < 12; i++) {
+            std::string path = "/f" + std::to_string(i);
+            if (round == 0) {
+                fs.file_create(admin, path.c_str(), body[i].c_str(), body[i].size());
+            } else if (round == 1) {
+                std::string patch(9000, (char)('A' + i));
+                fs.file_edit(admin, path.c_str(), patch.c_str(), patch.size(), 12000);
+                body[i].replace(12000, patch.size(), patch);
+            } else {
+                ok = ok && fs.file_read(admin, path.c_str(), &buf, &sz) == OFSErrorCodes::SUCCESS &&
+                     std::string(buf, sz) == body[i];
+                free(buf);
+            }
+            // write-behind between operations, as the server loop does
+            fs.io_step(16);
+        }
+        CHECK(fs.sync() && fs.block_cache().failed_io() == 0, "sync");
+        CHECK(fs.block_cache().idle(), "nothing left in flight after sync");
+        fs.shutdown();
+    }
+    CHECK(ok, "content survives both backends");
+
+    FSConfig cfg = make_config();
+    cfg.io_backend = IO_PREAD;
+    FileSystem fs;
+    fs.load_existing(cfg, "test.omni");
+    CHECK(std::string(fs.io_backend_name()) == "pread" && fs.io_event_fd() == -1, "pread when asked");
+    CHECK(fs.integrity_errors() == 0, "checksums");
+    return true;
+}
+
+// Write-behind leaves frames pinned until their completions are seen; a
+// get() in between must wait for one rather than take a frame that is not
+// there, and must not hand out a frame the kernel is still writing from.
+bool test_cache_in_flight() {
+    cout << "\n==== TEST CACHE IN FLIGHT ====\n";
+
+    const uint32_t bs = 4096, nblocks = 32;
+    FileIo io;
+    CHECK(io.open("test.omni", IO_URING, true) && io.resize((uint64_t)nblocks * bs), "open");
+    cout << "  backend: " << io.backend_name() << "\n";
+    BlockCache cache;
+    cache.init(&io, 0, bs, nblocks, BlockCache::MIN_SHARD_FRAMES * bs);
+    CHECK(cache.capacity() == BlockCache::MIN_SHARD_FRAMES, "one shard of the fewest frames");
+
+    // blocks 0-3 used twice sit in T2; the scan after them leaves ghosts in B1
+    for (int round = 0; round < 2; round++)
+        for (uint32_t b = 0; b < 4; b++) cache.get(b);
+    for (uint32_t b = 4; b < 24; b++) cache.get(b);
+
+    // every frame dirty, then all of them in flight at once
+    std::vector<uint32_t> held;
+    for (uint32_t b = 0; b < 24; b++) {
+        if (!cache.resident(b)) continue;
+        memset(cache.get(b), (int)(b + 1), bs);
+        cache.set_dirty(b);
+        held.push_back(b);
+    }
+    CHECK(held.size() == BlockCache::MIN_SHARD_FRAMES, "cache full");
+    CHECK(!io.async() || cache.write_behind(256) == held.size(), "all frames written behind");
+
+    uint32_t ghost = 23;
+    while (cache.resident(ghost)) ghost--;
+    const uint8_t* p = cache.get(ghost);
+    CHECK(p[0] == 0 && p[bs - 1] == 0, "ghost reloaded while every frame was pinned");
+    CHECK(cache.get(30)[0] == 0, "new block admitted the same way");
+
+    cache.flush();
+    CHECK(cache.idle() && cache.failed_io() == 0, "flushed");
+    std::vector<uint8_t> disk(bs);
+    bool ok = true;
+    for (uint32_t h : held)
+        ok = ok && io.read((uint64_t)h * bs, disk.data(), bs) &&
+             std::count(disk.begin(), disk.end(), (uint8_t)(h + 1)) == (long)bs;
+    CHECK(ok, "contents on disk");
+
+    // a frame being written is only handed out once the write is done
+    uint32_t b = ghost;
+    memset(cache.get(b), 0x55, bs);
+    cache.set_dirty(b);
+    cache.write_behind(256);
+    memset(cache.get(b), 0xAA, bs);
+    CHECK(cache.idle(), "get waited for the write");
+    CHECK(io.read((uint64_t)b * bs, disk.data(), bs) &&
+          std::count(disk.begin(), disk.end(), 0x55) == (long)bs, "write finished before the frame changed");
+
+    cache.set_dirty(b);
+    cache.flush();
+    CHECK(io.read((uint64_t)b * bs, disk.data(), bs) && disk[0] == 0xAA, "later change flushed");
+    io.close();
+    return true;
+}
+
+bool test_direct_io() {
+    cout << "\n==== TEST DIRECT IO ====\n";
+
+    FSConfig cfg = make_config();
+    cfg.cache_size = 64 * 4096;
+    cfg.direct_io = 1;
+    cfg.verify_mode = VERIFY_SCRUB;
+
+    std::string body(300000, ' ');
+    for (size_t i = 0; i < body.size(); i++) body[i] = (char)(i * 13 + i / 777);
+
+    for (uint32_t backend : { IO_URING, IO_PREAD }) {
+        cfg.io_backend = backend;
+        FileSystem fs;
+        fs.format_new(cfg, "test.omni");
+        CHECK(fs.load_existing(cfg, "test.omni"), "mount");
+        CHECK(fs.get_layout().data_offset % DATA_ALIGN == 0, "data region aligned");
+        // tmpfs and some others refuse O_DIRECT; the mount then stays buffered
+        cout << "  " << fs.io_backend_name() << (fs.direct_io() ? ", direct" : ", buffered") << "\n";
+
+        void* admin = nullptr;
+        fs.user_login("admin", "admin123", &admin);
+        fs.file_create(admin, "/a", body.c_str(), body.size());
+        fs.file_create(admin, "/b", body.c_str(), 5000);
+        std::string patch(20000, 'z');
+        fs.file_edit(admin, "/a", patch.c_str(), patch.size(), 100000);
+        std::string want = body;
+        want.replace(100000, patch.size(), patch);
+        fs.io_step(32);
+
+        char* buf;
+        size_t sz;
+        CHECK(fs.file_read(admin, "/a", &buf, &sz) == OFSErrorCodes::SUCCESS && std::string(buf, sz) == want,
+              "read back");
+        free(buf);
+        CHECK(fs.sync(), "sync");
+        fs.shutdown();
+
+        FileSystem fs2;
+        fs2.load_existing(cfg, "test.omni");
+        fs2.user_login("admin", "admin123", &admin);
+        CHECK(fs2.file_read(admin, "/a", &buf, &sz) == OFSErrorCodes::SUCCESS && std::string(buf, sz) == want,
+              "read after remount");
+        free(buf);
+        // scrub reads blocks that are not cached into an unaligned buffer
+        CHECK(fs2.scrub_step(fs2.get_layout().blocks_count) == 0 && fs2.block_cache().failed_io() == 0,
+              "scrub");
+    }
+    return true;
+}
+
+bool test_delta_vault() {
+    cout << "\n==== TEST DELTA VAULT ====\n";
+
+    FSConfig cfg = make_config();
+    cfg.dedup = 1;
+    cfg.vault_slots = 4;
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni"), "mount with a vault");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    const size_t payload = 4092;
+    std::string v1(5 * payload + 100, ' ');
+    for (size_t i = 0; i < v1.size(); i++) v1[i] = (char)('a' + i % 23);
+    fs.file_create(admin, "/a", v1.c_str(), v1.size());
+
+    uint32_t used = used_blocks(fs);
+
+    // a small edit keeps the one block it overwrites
+    std::string v2 = v1;
+    v2.replace(2 * payload + 10, 6, "CHANGE");
+    fs.file_edit(admin, "/a", "CHANGE", 6, 2 * payload + 10);
+    CHECK(used_blocks(fs) == used + 1, "edit keeps one block");
+
+    std::string v3 = v2 + "tail";
+    fs.file_edit(admin, "/a", "tail", 4, v2.size());
+    used = used_blocks(fs);
+    fs.file_truncate(admin, "/a");
+    CHECK(used_blocks(fs) == used, "truncate keeps the chain instead of copying it");
+
+    FileVersion* vs;
+    int n;
+    CHECK(fs.file_list_versions(admin, "/a", &vs, &n) == OFSErrorCodes::SUCCESS && n == 3 &&
+          vs[0].version == 1 && vs[0].size == v1.size() && vs[2].size == v3.size(), "three versions");
+    free(vs);
+
+    char* buf;
+    size_t sz;
+    const std::string want[] = { v1, v2, v3 };
+    for (uint32_t v = 1; v <= 3; v++) {
+        CHECK(fs.file_read_version(admin, "/a", v, &buf, &sz) == OFSErrorCodes::SUCCESS &&
+              std::string(buf, sz) == want[v - 1], "read version " << v);
+        free(buf);
+    }
+    CHECK(fs.file_read_version(admin, "/a", 4, &buf, &sz) == OFSErrorCodes::ERROR_NOT_FOUND,
+          "current content is not a kept version");
+
+    // inline files keep their bytes the same way
+    fs.file_create(admin, "/s", "small", 5);
+    fs.file_edit(admin, "/s", "ALL", 3, 1);
+    CHECK(fs.file_read_version(admin, "/s", 1, &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == "small", "inline version");
+    free(buf);
+    CHECK(fs.sync(), "sync");
+    fs.shutdown();
+
+    FileSystem fs2;
+    CHECK(fs2.load_existing(cfg, "test.omni"), "remount");
+    fs2.user_login("admin", "admin123", &admin);
+    CHECK(fs2.integrity_errors() == 0, "vault records verify after remount");
+    CHECK(fs2.file_read_version(admin, "/a", 2, &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == v2, "version after remount");
+    free(buf);
+
+    // four slots: the next version of /a pushes out its oldest
+    fs2.file_edit(admin, "/a", "new", 3, 0);
+    CHECK(fs2.file_list_versions(admin, "/a", &vs, &n) == OFSErrorCodes::SUCCESS && n == 3 &&
+          vs[0].version == 2 && vs[2].version == 4 && vs[2].size == 0, "oldest dropped when full");
+    free(vs);
+    CHECK(fs2.file_read_version(admin, "/a", 1, &buf, &sz) == OFSErrorCodes::ERROR_NOT_FOUND,
+          "dropped version is gone");
+    CHECK(fs2.file_read_version(admin, "/a", 3, &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == v3, "remaining versions still rebuild");
+    free(buf);
+
+    // deleting the file frees its versions
+    used = used_blocks(fs2);
+    fs2.file_delete(admin, "/a");
+    CHECK(used_blocks(fs2) == used - 7, "delete frees the kept blocks");
+    CHECK(fs2.file_list_versions(admin, "/a", &vs, &n) == OFSErrorCodes::ERROR_NOT_FOUND,
+          "no versions after delete");
+    CHECK(fs2.file_read_version(admin, "/s", 1, &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == "small", "other files keep theirs");
+    free(buf);
+    return true;
+}
+
+bool test_container_snapshots() {
+    cout << "\n==== TEST CONTAINER SNAPSHOTS ====\n";
+
+    // dedup off so the tail of /a gets packed; blocks are counted regardless
+    FSConfig cfg = make_config();
+    cfg.vault_slots = 4;
+    cfg.snapshot_slots = 3;
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni"), "mount with snapshot slots");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+
+    const size_t payload = 4092;
+    std::string a(3 * payload + 100, ' ');
+    for (size_t i = 0; i < a.size(); i++) a[i] = (char)('a' + i % 19);
+    std::string x(2 * payload, 'x');
+    fs.file_create(admin, "/a", a.c_str(), a.size());
+    fs.file_create(admin, "/s", "small", 5);
+    fs.dir_create(admin, "/d");
+    fs.file_create(admin, "/d/x", x.c_str(), x.size());
+    CHECK(fs.pack_tails() == 1, "tail of /a packed");
+
+    // a snapshot copies tables, not blocks
+    uint32_t used = used_blocks(fs);
+    CHECK(fs.container_snapshot(admin, "h1") == OFSErrorCodes::SUCCESS, "snapshot taken");
+    CHECK(used_blocks(fs) == used, "snapshot allocates no blocks");
+    CHECK(fs.container_snapshot(admin, "h1") == OFSErrorCodes::ERROR_FILE_EXISTS, "names are unique");
+
+    // the live tree moves on; shared blocks are copied on write
+    std::string live = a;
+    live.replace(10, 4, "LIVE");
+    fs.file_edit(admin, "/a", "LIVE", 4, 10);
+    fs.file_edit(admin, "/a", "TAIL", 4, a.size() - 4);
+    live.replace(a.size() - 4, 4, "TAIL");
+    fs.file_edit(admin, "/s", "S", 1, 0);
+    fs.file_delete(admin, "/d/x");
+    fs.file_create(admin, "/n", "new", 3);
+
+    char* buf;
+    size_t sz;
+    CHECK(fs.file_read(admin, "/a", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == live, "live tree edited");
+    free(buf);
+
+    CHECK(fs.container_clone(admin, "h1", "c1") == OFSErrorCodes::SUCCESS, "clone made");
+    CHECK(fs.container_clone(admin, "nope", "c2") == OFSErrorCodes::ERROR_NOT_FOUND, "clone of unknown snapshot");
+    SnapshotInfo* snaps;
+    int n;
+    CHECK(fs.container_snapshot_list(admin, &snaps, &n) == OFSErrorCodes::SUCCESS && n == 2 &&
+          std::string(snaps[0].name) == "h1" && !snaps[0].writable && snaps[0].files == 3 &&
+          snaps[1].writable && !snaps[1].mounted, "two snapshots listed");
+    free(snaps);
+    CHECK(fs.sync(), "sync");
+    fs.shutdown();
+
+    // the snapshot mounts read-only, as it was
+    FileSystem h;
+    CHECK(h.load_snapshot(cfg, "test.omni", "h1") && h.is_read_only(), "snapshot mounted");
+    h.user_login("admin", "admin123", &admin);
+    CHECK(h.integrity_errors() == 0, "snapshot tables verify");
+    CHECK(h.file_read(admin, "/a", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == a, "snapshot keeps the old content");
+    free(buf);
+    CHECK(h.file_read(admin, "/s", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == "small", "snapshot keeps the inline file");
+    free(buf);
+    CHECK(h.file_read(admin, "/d/x", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == x, "snapshot keeps the deleted file");
+    free(buf);
+    CHECK(h.file_read(admin, "/n", &buf, &sz) == OFSErrorCodes::ERROR_NOT_FOUND, "later file absent");
+    CHECK(h.file_edit(admin, "/a", "no", 2, 0) == OFSErrorCodes::ERROR_INVALID_OPERATION &&
+          h.file_create(admin, "/m", "no", 2) == OFSErrorCodes::ERROR_INVALID_OPERATION,
+          "snapshot refuses changes");
+    CHECK(h.container_snapshot_delete(admin, "h1") == OFSErrorCodes::ERROR_INVALID_OPERATION,
+          "mounted snapshot cannot be deleted");
+    h.shutdown();
+
+    // the clone is writable and keeps its changes to itself
+    {
+        FileSystem c;
+        CHECK(c.load_snapshot(cfg, "test.omni", "c1") && !c.is_read_only(), "clone mounted");
+        c.user_login("admin", "admin123", &admin);
+        CHECK(c.file_edit(admin, "/a", "CLONE", 5, 0) == OFSErrorCodes::SUCCESS &&
+              c.file_create(admin, "/c", "mine", 4) == OFSErrorCodes::SUCCESS, "clone edited");
+        CHECK(c.sync(), "clone sync");
+        c.shutdown();
+    }
+    FileSystem c2;
+    CHECK(c2.load_snapshot(cfg, "test.omni", "c1"), "clone remounted");
+    c2.user_login("admin", "admin123", &admin);
+    CHECK(c2.integrity_errors() == 0, "clone tables verify");
+    CHECK(c2.file_read(admin, "/a", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == "CLONE" + a.substr(5), "clone change persisted");
+    free(buf);
+    c2.shutdown();
+
+    FileSystem m;
+    CHECK(m.load_existing(cfg, "test.omni") && !m.is_read_only(), "container tree remounted");
+    m.user_login("admin", "admin123", &admin);
+    CHECK(m.integrity_errors() == 0, "container tables verify");
+    CHECK(m.file_read(admin, "/a", &buf, &sz) == OFSErrorCodes::SUCCESS &&
+          std::string(buf, sz) == live, "container tree untouched by the clone");
+    free(buf);
+    CHECK(m.file_read(admin, "/c", &buf, &sz) == OFSErrorCodes::ERROR_NOT_FOUND, "clone file absent");
+
+    FileSystem u;
+    CHECK(!u.load_snapshot(cfg, "test.omni", "nope"), "unknown snapshot does not mount");
+
+    // with the snapshots and the files gone, every block is free again
+    CHECK(m.container_snapshot_delete(admin, "h1") == OFSErrorCodes::SUCCESS &&
+          m.container_snapshot_delete(admin, "c1") == OFSErrorCodes::SUCCESS, "snapshots deleted");
+    m.file_delete(admin, "/a");
+    m.file_delete(admin, "/s");
+    m.file_delete(admin, "/n");
+    m.dir_delete(admin, "/d");
+    CHECK(used_blocks(m) == 0, "all blocks freed");
+    CHECK(m.container_snapshot_list(admin, &snaps, &n) == OFSErrorCodes::SUCCESS && n == 0, "none left");
+    free(snaps);
+    return true;
+}
+
+// decode a JSON string literal the way the handler does
+static std::string unescaped(const char* lit) {
+    std::string buf = std::string("{\"s\":") + lit + "}";
+    JsonReader rd(&buf[0], buf.size());
+    JsonSlice k, v;
+    if (!rd.begin_object() || !rd.next_member(k, v)) return "<bad>";
+    int64_t n = json_unescape_inplace(v);
+    return n < 0 ? "<bad>" : std::string(v.p, (size_t)n);
+}
+
+static std::string b64_decoded(const char* text) {
+    std::string buf = text;
+    JsonSlice s;
+    s.p = &buf[0];
+    s.n = (uint32_t)buf.size();
+    s.type = JsonType::STRING;
+    int64_t n = base64_decode_inplace(s);
+    return n < 0 ? "<bad>" : std::string(s.p, (size_t)n);
+}
+
+static JsonSlice number_slice(std::string& text) {
+    JsonSlice s;
+    s.p = &text[0];
+    s.n = (uint32_t)text.size();
+    s.type = JsonType::NUMBER;
+    return s;
+}
+
+bool test_json_protocol() {
+    cout << "\n==== TEST JSON PROTOCOL ====\n";
+
+    std::string line = " { \"op\" : \"file_read\", \"n\":-42,\"big\":18446744073709551615,"
+                       "\"t\":true,\"f\":false,\"z\":null,\"o\":{\"a\":\"}\"},\"arr\":[1,[2]],"
+                       "\"esc\":\"a\\\"b\" } ";
+    JsonReader rd(&line[0], line.size());
+    CHECK(rd.begin_object(), "object opens");
+
+    JsonSlice k, v;
+    std::vector<std::pair<std::string, JsonSlice>> members;
+    while (rd.next_member(k, v)) members.push_back({ std::string(k.p, k.n), v });
+    CHECK(!rd.failed() && members.size() == 9, "nine members");
+    CHECK(members[0].first == "op" && members[0].second.type == JsonType::STRING &&
+          members[0].second.equals("file_read") && !members[0].second.escaped, "string value");
+
+    int64_t i;
+    uint64_t u;
+    CHECK(json_to_i64(members[1].second, i) && i == -42, "negative number");
+    CHECK(!json_to_u64(members[1].second, u), "negative is not a u64");
+    CHECK(json_to_u64(members[2].second, u) && u == UINT64_MAX, "u64 max");
+    CHECK(members[3].second.type == JsonType::BOOL_TRUE && members[4].second.type == JsonType::BOOL_FALSE &&
+          members[5].second.type == JsonType::NUL, "literals");
+    CHECK(members[6].second.type == JsonType::OBJECT && members[6].second.equals("{\"a\":\"}\"}"),
+          "nested object skipped whole, brace inside a string ignored");
+    CHECK(members[7].second.type == JsonType::ARRAY && members[7].second.equals("[1,[2]]"), "nested array");
+    CHECK(members[8].second.escaped && members[8].second.equals("a\\\"b"), "escaped string kept raw");
+    CHECK(!json_to_u64(members[0].second, u), "string is not a number");
+
+    std::string num[] = { "18446744073709551616", "99999999999999999999", "9223372036854775807",
+                          "9223372036854775808", "-9223372036854775808", "-9223372036854775809" };
+    CHECK(!json_to_u64(number_slice(num[0]), u) && !json_to_u64(number_slice(num[1]), u), "u64 overflow rejected");
+    CHECK(json_to_i64(number_slice(num[2]), i) && i == INT64_MAX, "i64 max");
+    CHECK(!json_to_i64(number_slice(num[3]), i), "i64 positive overflow rejected");
+    CHECK(json_to_i64(number_slice(num[4]), i) && i == INT64_MIN, "i64 min");
+    CHECK(!json_to_i64(number_slice(num[5]), i), "i64 negative overflow rejected");
+
+    const char* bad[] = { "", "[1]", "{\"a\" 1}", "{\"a\":}", "{\"a\":\"open}", "{a:1}", "{\"a\":nul}" };
+    for (const char* b : bad) {
+        std::string s = b;
+        JsonReader r(&s[0], s.size());
+        bool any = r.begin_object();
+        while (any && r.next_member(k, v)) {}
+        CHECK(r.failed(), "malformed: '" << b << "'");
+    }
+
+    CHECK(unescaped("\"plain\"") == "plain", "unescape plain");
+    CHECK(unescaped("\"q\\\"b\\\\s\\/n\\nr\\rt\\tb\\bf\\f\"") == "q\"b\\s/n\nr\rt\tb\bf\f", "simple escapes");
+    CHECK(unescaped("\"\\u0041\\u00e9\\u20AC\"") == "A\xC3\xA9\xE2\x82\xAC", "\\u to UTF-8");
+    CHECK(unescaped("\"\\ud83d\\ude00\"") == "\xF0\x9F\x98\x80", "surrogate pair");
+    CHECK(unescaped("\"\\ud83d\"") == "<bad>" && unescaped("\"\\ud83d\\u0041\"") == "<bad>",
+          "lone or mismatched surrogate rejected");
+    CHECK(unescaped("\"\\u12\"") == "<bad>" && unescaped("\"\\uzzzz\"") == "<bad>", "short or bad hex rejected");
+    CHECK(unescaped("\"\\x\"") == "<bad>", "unknown escape rejected");
+
+    CHECK(b64_decoded("") == "", "base64 empty");
+    CHECK(b64_decoded("TQ==") == "M" && b64_decoded("TWE=") == "Ma" && b64_decoded("TWFu") == "Man",
+          "base64 padding");
+    CHECK(b64_decoded("TWFuIGlz") == "Man is", "base64 multiple groups");
+    CHECK(b64_decoded("TW@u") == "<bad>" && b64_decoded("TW Fu") == "<bad>", "base64 bad character rejected");
+
+    // writer round trip: escapes and base64 come back through the reader
+    std::string bin;
+    for (int c = 0; c < 256; c++) bin += (char)c;
+    OutBuffer ob;
+    JsonWriter w(&ob);
+    w.begin_object();
+    w.field("s", "tab\t\"q\"\\\x01");
+    w.field_i64("min", INT64_MIN);
+    w.field_u64("max", UINT64_MAX);
+    w.field_bool("b", false);
+    for (size_t n = 0; n <= 4; n++) w.field_base64(n == 4 ? "b4" : "bx", (const uint8_t*)bin.data(), n == 4 ? 256 : n);
+    w.begin_array("a");
+    w.begin_element(); w.field_u64("x", 1); w.end_object();
+    w.begin_element(); w.field_u64("x", 2); w.end_object();
+    w.end_array();
+    w.end_object();
+    w.end_line();
+
+    std::string out(ob.data(), ob.size());
+    CHECK(out.back() == '\n' && out.find("\"a\":[{\"x\":1},{\"x\":2}]") != std::string::npos &&
+          out.find("\"bx\":\"\",\"bx\":\"AA==\",\"bx\":\"AAE=\",\"bx\":\"AAEC\"") != std::string::npos,
+          "writer output");
+
+    JsonReader rw(&out[0], out.size() - 1);
+    CHECK(rw.begin_object(), "writer output parses");
+    std::map<std::string, JsonSlice> got;
+    while (rw.next_member(k, v)) got[std::string(k.p, k.n)] = v;
+    CHECK(!rw.failed(), "no parse error");
+    int64_t n = json_unescape_inplace(got["s"]);
+    CHECK(n >= 0 && std::string(got["s"].p, (size_t)n) == "tab\t\"q\"\\\x01", "escaped field round trip");
+    CHECK(json_to_i64(got["min"], i) && i == INT64_MIN, "i64 min round trip");
+    CHECK(json_to_u64(got["max"], u) && u == UINT64_MAX, "u64 max round trip");
+    CHECK(got["b"].type == JsonType::BOOL_FALSE, "bool");
+    n = base64_decode_inplace(got["b4"]);
+    CHECK(n == 256 && std::memcmp(got["b4"].p, bin.data(), 256) == 0, "base64 round trip");
+    return true;
+}
+
+// ======================================================
+// SERVER HELPERS
+// ======================================================
+// Serves fs from a child process on a loopback port. The parent only talks
+// to it over sockets and leaves fs alone until stop().
+struct ChildServer {
+    Server server;
+    pid_t pid = -1;
+    uint16_t port = 0;
+
+    bool start(FileSystem& fs) {
+        for (uint16_t p = 18600; p < 18700 && !port; p++)
+            if (server.start(&fs, p, 8)) port = p;
+        if (!port) return false;
+        pid = fork();
+        if (pid == 0) {
+            server.run();
+            _exit(0);
+        }
+        return pid > 0;
+    }
+
+    void stop() {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+        pid = -1;
+    }
+
+    ~ChildServer() { stop(); }
+};
+
+static int connect_local(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    timeval tv = { 5, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+static void send_all(int fd, const std::string& s) {
+    size_t sent = 0;
+    while (sent < s.size()) {
+        ssize_t w = send(fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+        if (w <= 0) return;
+        sent += (size_t)w;
+    }
+}
+
+// up to n bytes; fewer if the server closes or stays quiet for 5 s
+static std::string recv_n(int fd, size_t n) {
+    std::string s(n, '\0');
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = recv(fd, &s[got], n - got, 0);
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    s.resize(got);
+    return s;
+}
+
+static std::string recv_line(int fd) {
+    std::string s;
+    char c;
+    while (recv(fd, &c, 1, 0) == 1 && c != '\n') s += c;
+    return s;
+}
+
+// nothing arrives within ms
+static bool quiet(int fd, int ms) {
+    pollfd p = { fd, POLLIN, 0 };
+    return poll(&p, 1, ms) == 0;
+}
+
+// the server hung up without sending anything
+static bool closed_silently(int fd) {
+    char c;
+    return recv(fd, &c, 1, 0) == 0;
+}
+
+static std::string bin_preface(const char* key) {
+    std::string p(BIN_MAGIC, sizeof(BIN_MAGIC));
+    std::string k(64, '\0');
+    std::memcpy(&k[0], key, strlen(key));
+    return p + k;
+}
+
+static std::string bin_frame(BinOp op, uint32_t tag, const std::string& path,
+                             const std::string& payload, uint8_t flags = 0) {
+    BinRequestHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.length = (uint32_t)(sizeof(h) - 4 + path.size() + payload.size());
+    h.opcode = (uint8_t)op;
+    h.flags = flags;
+    h.path_len = (uint16_t)path.size();
+    h.tag = tag;
+    h.payload_len = (uint32_t)payload.size();
+    return std::string((const char*)&h, sizeof(h)) + path + payload;
+}
+
+static bool recv_reply(int fd, BinResponseHeader& h, std::string& body) {
+    std::string hdr = recv_n(fd, sizeof(h));
+    if (hdr.size() != sizeof(h)) return false;
+    std::memcpy(&h, hdr.data(), sizeof(h));
+    body = recv_n(fd, h.length - (sizeof(h) - 4));
+    return body.size() == h.length - (sizeof(h) - 4);
+}
+
+static FSConfig server_config() {
+    FSConfig cfg = make_config();
+    cfg.io_backend = IO_PREAD;      // no ring shared across the fork
+    strcpy(cfg.private_key, "s3cret");
+    return cfg;
+}
+
+bool test_binary_framing() {
+    cout << "\n==== TEST BINARY FRAMING ====\n";
+
+    char buf[64] = { 0 };
+    uint32_t len = sizeof(BinRequestHeader) - 4;
+    std::memcpy(buf, &len, 4);
+    CHECK(bin_frame_length(buf, 0) == 0 && bin_frame_length(buf, 3) == 0, "length prefix incomplete");
+    CHECK(bin_frame_length(buf, 4) == 0 && bin_frame_length(buf, 43) == 0, "frame incomplete");
+    CHECK(bin_frame_length(buf, 44) == 44 && bin_frame_length(buf, 64) == 44,
+          "complete frame, following bytes left alone");
+    len = sizeof(BinRequestHeader) - 5;
+    std::memcpy(buf, &len, 4);
+    CHECK(bin_frame_length(buf, 64) == -1, "too short for a header");
+    len = BIN_MAX_FRAME;
+    std::memcpy(buf, &len, 4);
+    CHECK(bin_frame_length(buf, 64) == 0, "largest frame waits for its bytes");
+    len = BIN_MAX_FRAME + 1;
+    std::memcpy(buf, &len, 4);
+    CHECK(bin_frame_length(buf, 4) == -1, "oversize rejected before it is buffered");
+
+    FSConfig cfg = server_config();
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni"), "mount");
+    ChildServer srv;
+    CHECK(srv.start(fs), "server running");
+
+    int fd = connect_local(srv.port);
+    send_all(fd, bin_preface("wrong"));
+    CHECK(closed_silently(fd), "wrong key: dropped without a reply");
+    close(fd);
+
+    // preface and frame trickle in; nothing runs until the frame is whole
+    std::string preface = bin_preface("s3cret");
+    std::string login = bin_frame(BinOp::USER_LOGIN, 0xABCD1234, "admin", "admin123");
+    fd = connect_local(srv.port);
+    send_all(fd, preface.substr(0, 5));
+    CHECK(quiet(fd, 100), "partial preface");
+    send_all(fd, preface.substr(5) + login.substr(0, 2));
+    CHECK(quiet(fd, 100), "partial length prefix");
+    send_all(fd, login.substr(2, 30));
+    CHECK(quiet(fd, 100), "partial header");
+    send_all(fd, login.substr(32));
+    BinResponseHeader rh;
+    std::string body;
+    CHECK(recv_reply(fd, rh, body) && rh.status == 0 && rh.tag == 0xABCD1234 &&
+          rh.opcode == (uint8_t)BinOp::USER_LOGIN && rh.count == 1 && body.size() == sizeof(SessionInfo),
+          "reassembled frame answered");
+
+    // header claims more path and payload than the frame holds
+    std::string lying = bin_frame(BinOp::USER_LOGIN, 9, "admin", "admin123");
+    ((BinRequestHeader*)&lying[0])->payload_len = 1000;
+    send_all(fd, lying);
+    CHECK(recv_reply(fd, rh, body) && rh.tag == 9 &&
+          rh.status == (int32_t)OFSErrorCodes::ERROR_INVALID_OPERATION && body.empty(),
+          "overlong path/payload refused");
+
+    // strings longer than the handler's buffers are refused, not cut short
+    send_all(fd, bin_frame(BinOp::FILE_READ, 10, "/" + std::string(511, 'p'), ""));
+    CHECK(recv_reply(fd, rh, body) && rh.tag == 10 && rh.status == (int32_t)OFSErrorCodes::ERROR_INVALID_PATH,
+          "path too long for the buffer");
+    std::string pw(255, 'w');
+    send_all(fd, bin_frame(BinOp::USER_CREATE, 11, "long", pw, 0));
+    CHECK(recv_reply(fd, rh, body) && rh.tag == 11 && rh.status == 0, "255-byte password fits");
+    send_all(fd, bin_frame(BinOp::USER_LOGIN, 12, "long", pw + "x"));
+    CHECK(recv_reply(fd, rh, body) && rh.tag == 12 && rh.status == (int32_t)OFSErrorCodes::ERROR_INVALID_OPERATION,
+          "longer password not cut down to a matching one");
+    send_all(fd, bin_frame(BinOp::USER_LOGIN, 13, "long", pw));
+    CHECK(recv_reply(fd, rh, body) && rh.tag == 13 && rh.status == 0, "exact password logs in");
+    send_all(fd, bin_frame(BinOp::DIR_LIST, 14, "/", std::string(256, 'n')));
+    CHECK(recv_reply(fd, rh, body) && rh.tag == 14 && rh.status == (int32_t)OFSErrorCodes::ERROR_INVALID_OPERATION,
+          "list prefix too long");
+
+    len = BIN_MAX_FRAME + 1;
+    send_all(fd, std::string((const char*)&len, 4) + std::string(40, '\0'));
+    CHECK(closed_silently(fd), "oversize frame closes the connection");
+    close(fd);
+
+    // the largest frame fits the receive buffer behind the preface
+    fd = connect_local(srv.port);
+    std::string big(BIN_MAX_FRAME - (sizeof(BinRequestHeader) - 4) - 4, 'b');
+    send_all(fd, preface + bin_frame(BinOp::FILE_CREATE, 15, "/big", big));
+    CHECK(recv_reply(fd, rh, body) && rh.tag == 15 && rh.length == sizeof(rh) - 4, "largest frame answered");
+    close(fd);
+
+    fd = connect_local(srv.port);
+    len = 8;
+    send_all(fd, preface + std::string((const char*)&len, 4) + std::string(8, '\0'));
+    CHECK(closed_silently(fd), "undersize frame closes the connection");
+    close(fd);
+
+    // no magic: the bytes are a JSON line without the key, dropped, and the
+    // connection keeps serving JSON
+    fd = connect_local(srv.port);
+    send_all(fd, "OFSBINXX" + std::string(64, 'x') + "\n" +
+                 "{\"key\":\"s3cret\",\"op\":\"get_stats\",\"tag\":7}\n");
+    std::string line = recv_line(fd);
+    CHECK(line.compare(0, 9, "{\"tag\":7,") == 0, "bad magic falls back to JSON");
+    close(fd);
+
+    srv.stop();
+    return true;
+}
+
+static bool starts_with(const std::string& s, const std::string& p) {
+    return s.compare(0, p.size(), p) == 0;
+}
+
+bool test_pipelining() {
+    cout << "\n==== TEST PIPELINING ====\n";
+
+    FSConfig cfg = server_config();
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni"), "mount");
+    ChildServer srv;
+    CHECK(srv.start(fs), "server running");
+
+    // the whole batch goes out in one write; replies come back in request order
+    const std::string key = "{\"key\":\"s3cret\",";
+    std::string batch = key + "\"op\":\"user_login\",\"username\":\"admin\",\"password\":\"admin123\",\"tag\":\"login\"}\n";
+    for (int i = 0; i < 100; i++)
+        batch += key + "\"op\":\"file_create\",\"path\":\"/f" + std::to_string(i) + "\",\"data\":\"body " +
+                 std::to_string(i) + "\",\"tag\":" + std::to_string(i) + "}\n";
+    batch += "{\"op\":\"get_stats\",\"tag\":\"nokey\"}\n";
+    batch += key + "\"tag\":\"a\\\"b\",\"op\":42}\n";
+    for (int i = 99; i >= 0; i--)
+        batch += key + "\"op\":\"file_read\",\"path\":\"/f" + std::to_string(i) + "\",\"tag\":" +
+                 std::to_string(1000 + i) + "}\n";
+
+    int fd = connect_local(srv.port);
+    send_all(fd, batch);
+    CHECK(starts_with(recv_line(fd), "{\"tag\":\"login\",\"op\":\"user_login\",\"status\":\"ok\""),
+          "login answered first");
+    bool ordered = true;
+    for (int i = 0; i < 100 && ordered; i++) {
+        std::string l = recv_line(fd);
+        ordered = starts_with(l, "{\"tag\":" + std::to_string(i) + ",") && l.find("\"status\":\"ok\"") != std::string::npos;
+    }
+    CHECK(ordered, "creates answered in order");
+    std::string l = recv_line(fd);
+    CHECK(starts_with(l, "{\"tag\":\"a\\\"b\",") && l.find("\"status\":\"error\"") != std::string::npos,
+          "keyless request skipped, tag echoed verbatim on an error");
+    for (int i = 99; i >= 0 && ordered; i--) {
+        l = recv_line(fd);
+        ordered = starts_with(l, "{\"tag\":" + std::to_string(1000 + i) + ",") &&
+                  l.find("\"data\":\"body " + std::to_string(i) + "\"") != std::string::npos;
+    }
+    CHECK(ordered, "reads answered in order, each with its own file");
+
+    // two pipelining connections interleave in the executor but each sees
+    // only its own replies, in its own order
+    int bfd = connect_local(srv.port);
+    std::string bin = bin_preface("s3cret") + bin_frame(BinOp::USER_LOGIN, 1, "admin", "admin123");
+    for (int i = 0; i < 50; i++)
+        bin += bin_frame(BinOp::FILE_READ, 100 + i, "/f" + std::to_string(i), "");
+    std::string json;
+    for (int i = 0; i < 50; i++)
+        json += key + "\"op\":\"file_read\",\"path\":\"/f" + std::to_string(i) + "\",\"tag\":\"j" +
+                std::to_string(i) + "\"}\n";
+    send_all(bfd, bin.substr(0, bin.size() / 2));
+    send_all(fd, json);
+    send_all(bfd, bin.substr(bin.size() / 2));
+
+    BinResponseHeader rh;
+    std::string body;
+    CHECK(recv_reply(bfd, rh, body) && rh.tag == 1 && rh.status == 0, "binary login");
+    for (int i = 0; i < 50 && ordered; i++)
+        ordered = recv_reply(bfd, rh, body) && rh.tag == (uint32_t)(100 + i) && rh.status == 0 &&
+                  rh.count == body.size() && body == "body " + std::to_string(i);
+    CHECK(ordered, "binary replies in order with their tags");
+    for (int i = 0; i < 50 && ordered; i++) {
+        l = recv_line(fd);
+        ordered = starts_with(l, "{\"tag\":\"j" + std::to_string(i) + "\",") &&
+                  l.find("\"data\":\"body " + std::to_string(i) + "\"") != std::string::npos;
+    }
+    CHECK(ordered, "JSON replies on the other connection in order");
+    CHECK(quiet(fd, 100) && quiet(bfd, 100), "no stray replies");
+    close(fd);
+    close(bfd);
+
+    srv.stop();
+    return true;
+}
+
+// runs one binary request through the handler; raw_snapshot as handle_binary sets it
+static BinResponseHeader handle_frame(RequestHandler& rh, void* session, const std::string& frame,
+                                      std::string& body, void** raw_snapshot) {
+    OutBuffer out;
+    rh.handle_binary(frame.data(), frame.size(), session, out, raw_snapshot);
+    BinResponseHeader h;
+    std::memcpy(&h, out.data(), sizeof(h));
+    body.assign(out.data() + sizeof(h), out.size() - sizeof(h));
+    return h;
+}
+
+// makes a container look like one from before content encoding: zeroed
+// table, plaintext blocks, so raw reads may stream
+static void clear_encoding_table(const char* path) {
+    uint8_t zero[256] = { 0 };
+    FILE* f = fopen(path, "r+b");
+    fseek(f, (long)offsetof(OMNIHeader, encoding_table), SEEK_SET);
+    fwrite(zero, 1, sizeof(zero), f);
+    fclose(f);
+}
+
+static std::string noise_bytes(size_t n, uint32_t seed) {
+    std::string s(n, ' ');
+    for (char& c : s) { seed = seed * 1103515245u + 12345u; c = (char)(seed >> 24); }
+    return s;
+}
+
+static bool on_disk(const char* path, const std::string& needle) {
+    std::ifstream in(path, std::ios::binary);
+    std::string disk((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return disk.find(needle) != std::string::npos;
+}
+
+// the bytes a raw stream would send, read from the container file
+static std::string stream_extents(FileSystem& fs, void* snap, uint32_t* extents) {
+    int fd = open(fs.get_path().c_str(), O_RDONLY);
+    std::string s;
+    uint64_t off, len;
+    *extents = 0;
+    while (fs.snapshot_next_extent(snap, &off, &len) == OFSErrorCodes::SUCCESS && len) {
+        size_t at = s.size();
+        s.resize(at + len);
+        if (pread(fd, &s[at], len, (off_t)off) != (ssize_t)len) break;
+        (*extents)++;
+    }
+    close(fd);
+    return s;
+}
+
+bool test_raw_reads() {
+    cout << "\n==== TEST RAW READS ====\n";
+
+    FSConfig cfg = make_config();
+    cfg.compression = 1;
+    cfg.io_backend = IO_PREAD;      // the server runs in a forked child below
+    std::string small(150, 's');
+    std::string text;
+    for (int i = 0; text.size() < 50000; i++) text += "line " + std::to_string(i) + " of text\n";
+    std::string noise = noise_bytes(50000, 777);
+    std::string other = noise_bytes(3 * 4092, 778);
+    std::string tailed = noise_bytes(2 * 4092 + 700, 779);
+
+    {
+        FileSystem fs;
+        CHECK(fs.format_new(cfg, "test.omni"), "format with compression");
+        clear_encoding_table("test.omni");
+        CHECK(fs.load_existing(cfg, "test.omni") && !fs.content_encoded(), "plaintext container");
+        void* admin = nullptr;
+        fs.user_login("admin", "admin123", &admin);
+        RequestHandler handler;
+        handler.init(&fs);
+
+        // inline content is not in the data region, so a raw request for it
+        // comes back buffered
+        fs.file_create(admin, "/small", small.c_str(), small.size());
+        std::string body;
+        void* snap = nullptr;
+        BinResponseHeader h = handle_frame(handler, admin, bin_frame(BinOp::FILE_READ, 5, "/small", "", BIN_FLAG_RAW),
+                                           body, &snap);
+        CHECK(h.status == 0 && h.tag == 5 && !snap && !(h.flags & BIN_FLAG_RAW) &&
+              h.count == small.size() && body == small && h.length == sizeof(h) - 4 + small.size(),
+              "inline file falls back to a buffered reply");
+
+        // compressed blocks hold lz4 output, not file bytes
+        fs.file_create(admin, "/text", text.c_str(), text.size());
+        FileMetadata md;
+        CHECK(fs.get_metadata(admin, "/text", &md) == OFSErrorCodes::SUCCESS && md.blocks_used < text.size() / 4092,
+              "text stored compressed");
+        h = handle_frame(handler, admin, bin_frame(BinOp::FILE_READ, 6, "/text", "", BIN_FLAG_RAW), body, &snap);
+        CHECK(h.status == 0 && !snap && !(h.flags & BIN_FLAG_RAW) && h.count == text.size() && body == text,
+              "compressed file falls back to a buffered reply");
+
+        // a plain chain is streamed; only its own blocks are written first
+        fs.file_create(admin, "/noise", noise.c_str(), noise.size());
+        fs.file_create(admin, "/other", other.c_str(), other.size());
+        CHECK(!on_disk("test.omni", noise.substr(0, 64)) && !on_disk("test.omni", other.substr(0, 64)),
+              "new blocks still dirty in the cache");
+        h = handle_frame(handler, admin, bin_frame(BinOp::FILE_READ, 7, "/noise", "", BIN_FLAG_RAW), body, &snap);
+        CHECK(h.status == 0 && h.tag == 7 && snap && (h.flags & BIN_FLAG_RAW) && h.count == noise.size() &&
+              h.length == sizeof(h) - 4 + noise.size() && body.empty(),
+              "raw header: flag, and count and length cover the streamed body");
+        CHECK(!on_disk("test.omni", other.substr(0, 64)), "other files' blocks left dirty");
+        uint32_t extents;
+        CHECK(stream_extents(fs, snap, &extents) == noise && extents == (noise.size() + 4091) / 4092,
+              "extents read back the content, a block each");
+        fs.snapshot_close(snap);
+
+        // a packed tail is the last extent, inside a fragment block
+        fs.file_create(admin, "/tailed", tailed.c_str(), tailed.size());
+        CHECK(fs.pack_tails() == 2, "tails of /noise and /tailed packed");
+        h = handle_frame(handler, admin, bin_frame(BinOp::FILE_READ, 8, "/tailed", "", BIN_FLAG_RAW), body, &snap);
+        CHECK(h.status == 0 && snap && (h.flags & BIN_FLAG_RAW) && h.count == tailed.size(), "tailed file streamed");
+        CHECK(stream_extents(fs, snap, &extents) == tailed && extents == 3, "full blocks then the packed tail");
+        fs.snapshot_close(snap);
+
+        // through the server: sendfile bodies and buffered replies keep
+        // their order on one connection
+        ChildServer srv;
+        CHECK(srv.start(fs), "server running");
+        int fd = connect_local(srv.port);
+        send_all(fd, bin_preface("") + bin_frame(BinOp::USER_LOGIN, 1, "admin", "admin123") +
+                     bin_frame(BinOp::FILE_READ, 2, "/noise", "", BIN_FLAG_RAW) +
+                     bin_frame(BinOp::FILE_READ, 3, "/small", "", BIN_FLAG_RAW) +
+                     bin_frame(BinOp::FILE_READ, 4, "/tailed", "", BIN_FLAG_RAW) +
+                     bin_frame(BinOp::FILE_READ, 5, "/other", "") +
+                     bin_frame(BinOp::FILE_READ, 6, "/text", "", BIN_FLAG_RAW));
+        CHECK(recv_reply(fd, h, body) && h.tag == 1 && h.status == 0, "login");
+        struct { uint32_t tag; bool raw; const std::string* want; } expect[] = {
+            { 2, true, &noise }, { 3, false, &small }, { 4, true, &tailed }, { 5, false, &other }, { 6, false, &text }
+        };
+        bool ok = true;
+        for (auto& e : expect)
+            ok = ok && recv_reply(fd, h, body) && h.tag == e.tag && h.status == 0 &&
+                 ((h.flags & BIN_FLAG_RAW) != 0) == e.raw && h.count == e.want->size() && body == *e.want;
+        CHECK(ok, "streamed and buffered bodies arrive in order");
+        close(fd);
+
+        // a logout queued behind a raw read leaves the stream's snapshot alone
+        fd = connect_local(srv.port);
+        send_all(fd, bin_preface("") + bin_frame(BinOp::USER_LOGIN, 1, "admin", "admin123") +
+                     bin_frame(BinOp::FILE_READ, 2, "/noise", "", BIN_FLAG_RAW) +
+                     bin_frame(BinOp::USER_LOGOUT, 3, "", ""));
+        CHECK(recv_reply(fd, h, body) && h.tag == 1 && h.status == 0, "login");
+        CHECK(recv_reply(fd, h, body) && h.tag == 2 && h.status == 0 && (h.flags & BIN_FLAG_RAW) && body == noise,
+              "full body streamed past the logout");
+        CHECK(recv_reply(fd, h, body) && h.tag == 3 && h.status == 0, "logout");
+        close(fd);
+        srv.stop();
+    }
+
+    // a client that stops reading is cut off and its snapshot closed
+    {
+        FSConfig big = cfg;
+        big.total_size = 64 * 1024 * 1024;
+        big.compression = 0;
+        big.stream_stall_timeout = 1;
+        std::string large = noise_bytes(16 * 1024 * 1024, 780);
+        FileSystem fs;
+        CHECK(fs.format_new(big, "test.omni"), "format");
+        clear_encoding_table("test.omni");
+        CHECK(fs.load_existing(big, "test.omni"), "mount");
+        void* admin = nullptr;
+        fs.user_login("admin", "admin123", &admin);
+        fs.file_create(admin, "/large", large.c_str(), large.size());
+        ChildServer srv;
+        CHECK(srv.start(fs), "server running");
+        int fd = connect_local(srv.port);
+        send_all(fd, bin_preface("") + bin_frame(BinOp::USER_LOGIN, 1, "admin", "admin123") +
+                     bin_frame(BinOp::FILE_READ, 2, "/large", "", BIN_FLAG_RAW));
+        sleep(4);
+        // what the socket buffers took before the stall, then the hang-up
+        size_t got = 0;
+        char buf[65536];
+        ssize_t r;
+        while ((r = recv(fd, buf, sizeof(buf), 0)) > 0) got += (size_t)r;
+        CHECK(r == 0 && got < large.size(), "stalled download closed");
+        close(fd);
+
+        fd = connect_local(srv.port);
+        send_all(fd, bin_preface("") + bin_frame(BinOp::USER_LOGIN, 1, "admin", "admin123") +
+                     bin_frame(BinOp::FILE_READ, 2, "/large", "", BIN_FLAG_RAW));
+        BinResponseHeader h;
+        std::string body;
+        CHECK(recv_reply(fd, h, body) && recv_reply(fd, h, body) && h.tag == 2 && (h.flags & BIN_FLAG_RAW) &&
+              body == large, "a reading client gets the whole body");
+        close(fd);
+        srv.stop();
+    }
+
+    // an encoded container never streams
+    FileSystem fs;
+    CHECK(fs.format_new(cfg, "test.omni") && fs.load_existing(cfg, "test.omni") && fs.content_encoded(),
+          "encoded container");
+    void* admin = nullptr;
+    fs.user_login("admin", "admin123", &admin);
+    RequestHandler handler;
+    handler.init(&fs);
+    fs.file_create(admin, "/noise", noise.c_str(), noise.size());
+    std::string body;
+    void* snap = nullptr;
+    BinResponseHeader h = handle_frame(handler, admin, bin_frame(BinOp::FILE_READ, 9, "/noise", "", BIN_FLAG_RAW),
+                                       body, &snap);
+    CHECK(h.status == 0 && !snap && !(h.flags & BIN_FLAG_RAW) && h.count == noise.size() && body == noise,
+          "encoded content falls back to a buffered reply");
+    return true;
+}
+
 int main() {
     cout << "\n================== FULL TEST SUITE ==================\n";
 
@@ -559,6 +2585,30 @@ int main() {
     if (!test_directories()) return 1;
     if (!test_files()) return 1;
     if (!test_metadata_stats()) return 1;
+    if (!test_snapshots()) return 1;
+    if (!test_hash_table()) return 1;
+    if (!test_node_pool()) return 1;
+    if (!test_ordered_listing()) return 1;
+    if (!test_session_expiry()) return 1;
+    if (!test_passwords()) return 1;
+    if (!test_substitution()) return 1;
+    if (!test_encoded_content()) return 1;
+    if (!test_checksums()) return 1;
+    if (!test_inline_files()) return 1;
+    if (!test_tail_packing()) return 1;
+    if (!test_compression()) return 1;
+    if (!test_dedup()) return 1;
+    if (!test_block_cache()) return 1;
+    if (!test_readahead()) return 1;
+    if (!test_io_backends()) return 1;
+    if (!test_cache_in_flight()) return 1;
+    if (!test_direct_io()) return 1;
+    if (!test_delta_vault()) return 1;
+    if (!test_container_snapshots()) return 1;
+    if (!test_json_protocol()) return 1;
+    if (!test_binary_framing()) return 1;
+    if (!test_pipelining()) return 1;
+    if (!test_raw_reads()) return 1;
 
     cout << "\n🎉 ALL PHASE-2 TESTS PASSED SUCCESSFULLY! 🎉\n";
     return 0;
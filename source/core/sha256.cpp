@@ -0,0 +1,156 @@
+#include "sha256.h"
+#include <cstring>
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void compress(uint32_t st[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = st[0], b = st[1], c = st[2], d = st[3];
+    uint32_t e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+void Sha256::reset() {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state, init, sizeof(state));
+    length = 0;
+    buf_len = 0;
+}
+
+void Sha256::update(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    length += len;
+    if (buf_len) {
+        size_t take = 64 - buf_len < len ? 64 - buf_len : len;
+        memcpy(buf + buf_len, p, take);
+        buf_len += take;
+        p += take;
+        len -= take;
+        if (buf_len < 64) return;
+        compress(state, buf);
+        buf_len = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64) compress(state, p);
+    memcpy(buf, p, len);
+    buf_len = len;
+}
+
+void Sha256::finish(uint8_t out[32]) {
+    uint64_t bits = length * 8;
+    uint8_t pad = 0x80;
+    update(&pad, 1);
+    uint8_t zero = 0;
+    while (buf_len != 56) update(&zero, 1);
+    uint8_t len_be[8];
+    for (int i = 0; i < 8; i++) len_be[i] = (uint8_t)(bits >> (56 - i * 8));
+    update(len_be, 8);
+    for (int i = 0; i < 8; i++) {
+        out[i * 4] = (uint8_t)(state[i] >> 24);
+        out[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        out[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        out[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
+
+void Sha256::hash(const void* data, size_t len, uint8_t out[32]) {
+    Sha256 h;
+    h.update(data, len);
+    h.finish(out);
+}
+
+// Inner and outer states after the padded key block, so PBKDF2 rounds
+// only hash the message.
+struct HmacKey {
+    Sha256 inner;
+    Sha256 outer;
+
+    HmacKey(const uint8_t* key, size_t key_len) {
+        uint8_t k[64] = { 0 };
+        if (key_len > 64) Sha256::hash(key, key_len, k);
+        else memcpy(k, key, key_len);
+
+        uint8_t pad[64];
+        for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x36;
+        inner.update(pad, 64);
+        for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x5c;
+        outer.update(pad, 64);
+    }
+
+    void mac(const void* msg, size_t len, uint8_t out[32]) const {
+        Sha256 h = inner;
+        h.update(msg, len);
+        uint8_t ih[32];
+        h.finish(ih);
+        h = outer;
+        h.update(ih, 32);
+        h.finish(out);
+    }
+};
+
+void hmac_sha256(const uint8_t* key, size_t key_len,
+                 const void* msg, size_t msg_len, uint8_t out[32]) {
+    HmacKey k(key, key_len);
+    k.mac(msg, msg_len, out);
+}
+
+void pbkdf2_sha256(const void* password, size_t password_len,
+                   const uint8_t* salt, size_t salt_len,
+                   uint32_t iterations, uint8_t* out, size_t out_len) {
+    HmacKey k((const uint8_t*)password, password_len);
+    if (iterations == 0) iterations = 1;
+
+    for (uint32_t block = 1; out_len > 0; block++) {
+        // U1 = HMAC(P, S || INT(block))
+        Sha256 h = k.inner;
+        h.update(salt, salt_len);
+        uint8_t be[4] = { (uint8_t)(block >> 24), (uint8_t)(block >> 16),
+                          (uint8_t)(block >> 8), (uint8_t)block };
+        h.update(be, 4);
+        uint8_t ih[32], u[32];
+        h.finish(ih);
+        h = k.outer;
+        h.update(ih, 32);
+        h.finish(u);
+
+        uint8_t t[32];
+        memcpy(t, u, 32);
+        for (uint32_t i = 1; i < iterations; i++) {
+            k.mac(u, 32, u);
+            for (int j = 0; j < 32; j++) t[j] ^= u[j];
+        }
+
+        size_t take = out_len < 32 ? out_len : 32;
+        memcpy(out, t, take);
+        out += take;
+        out_len -= take;
+    }
+}
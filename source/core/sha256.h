@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// ===============================
+// SHA-256 (FIPS 180-4), HMAC and PBKDF2
+// ===============================
+struct Sha256 {
+    uint32_t state[8];
+    uint64_t length;        // bytes hashed so far
+    uint8_t buf[64];
+    size_t buf_len;
+
+    Sha256() { reset(); }
+    void reset();
+    void update(const void* data, size_t len);
+    void finish(uint8_t out[32]);
+
+    static void hash(const void* data, size_t len, uint8_t out[32]);
+};
+
+void hmac_sha256(const uint8_t* key, size_t key_len,
+                 const void* msg, size_t msg_len, uint8_t out[32]);
+
+// PBKDF2-HMAC-SHA256 (RFC 8018), out_len bytes of derived key
+void pbkdf2_sha256(const void* password, size_t password_len,
+                   const uint8_t* salt, size_t salt_len,
+                   uint32_t iterations, uint8_t* out, size_t out_len);
@@ -1,7 +1,8 @@
 #pragma once
 #include <vector>
+#include "NodePool.h"
 
-template <typename K, typename V>
+template <typename K, typename V, typename Alloc = PoolAllocator>
 class AVLTree {
     struct Node {
         K k;
@@ -12,6 +13,8 @@ class AVLTree {
         Node(const K& key, const V& val): k(key), v(val), h(1), l(nullptr), r(nullptr) {}
     };
     Node* root;
+    static Node* make_node(const K& k, const V& v) { return new (Alloc::allocate(sizeof(Node))) Node(k, v); }
+    static void free_node(Node* n) { n->~Node(); Alloc::deallocate(n, sizeof(Node)); }
     int height(Node* n) const { return n ? n->h : 0; }
     int bal(Node* n) const { return n ? height(n->l) - height(n->r) : 0; }
     void upd(Node* n) { if (n) { int hl = height(n->l); int hr = height(n->r); n->h = (hl > hr ? hl : hr) + 1; } }
@@ -47,7 +50,7 @@ class AVLTree {
         return n;
     }
     Node* insert_node(Node* n, const K& k, const V& v) {
-        if (!n) return new Node(k, v);
+        if (!n) return make_node(k, v);
         if (k < n->k) n->l = insert_node(n->l, k, v);
         else if (n->k < k) n->r = insert_node(n->r, k, v);
         else { n->v = v; return n; }
@@ -67,11 +70,11 @@ class AVLTree {
             if (!n->l || !n->r) {
                 Node* t = n->l ? n->l : n->r;
                 if (!t) {
-                    delete n;
+                    free_node(n);
                     return nullptr;
                 } else {
                     Node tmp = *t;
-                    delete t;
+                    free_node(t);
                     n->k = tmp.k;
                     n->v = tmp.v;
                     n->l = tmp.l;
@@ -98,7 +101,7 @@ class AVLTree {
         if (!n) return;
         destroy(n->l);
         destroy(n->r);
-        delete n;
+        free_node(n);
     }
     bool find_node(Node* n, const K& k, V& out) const {
         Node* cur = n;
@@ -0,0 +1,451 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include "NodePool.h"
+
+// ===============================
+// B+-tree with linked leaves
+// ===============================
+// Keys and values live only in the leaves, stored as flat sorted arrays of
+// up to FANOUT entries, so a lookup costs one binary search per level over
+// contiguous keys. Leaves are chained left to right and a Cursor walks them
+// for ordered and range scans. Inner node keys are separators:
+// child[i] < keys[i] <= child[i+1]. Every node except the root stays at
+// least half full. K needs operator<. K and V need default constructors.
+template <typename K, typename V, unsigned int FANOUT = 64, typename Alloc = PoolAllocator>
+class BPlusTree {
+    static_assert(FANOUT >= 4, "FANOUT too small");
+    static const unsigned int MIN_KEYS = FANOUT / 2;
+
+    struct Node {
+        bool leaf;
+        unsigned int n;
+    };
+    struct Leaf : Node {
+        K keys[FANOUT];
+        V vals[FANOUT];
+        Leaf* next;
+        Leaf* prev;
+    };
+    struct Inner : Node {
+        K keys[FANOUT];
+        Node* child[FANOUT + 1];
+    };
+
+    Node* root;
+    unsigned long long count;
+
+    static Leaf* make_leaf() {
+        Leaf* l = new (Alloc::allocate(sizeof(Leaf))) Leaf();
+        l->leaf = true;
+        l->n = 0;
+        l->next = nullptr;
+        l->prev = nullptr;
+        return l;
+    }
+    static Inner* make_inner() {
+        Inner* in = new (Alloc::allocate(sizeof(Inner))) Inner();
+        in->leaf = false;
+        in->n = 0;
+        return in;
+    }
+    static void free_node(Node* nd) {
+        if (nd->leaf) { ((Leaf*)nd)->~Leaf(); Alloc::deallocate(nd, sizeof(Leaf)); }
+        else { ((Inner*)nd)->~Inner(); Alloc::deallocate(nd, sizeof(Inner)); }
+    }
+    void destroy(Node* nd) {
+        if (!nd) return;
+        if (!nd->leaf) {
+            Inner* in = (Inner*)nd;
+            for (unsigned int i = 0; i <= in->n; i++) destroy(in->child[i]);
+        }
+        free_node(nd);
+    }
+
+    // first position with keys[pos] >= k
+    static unsigned int lower(const K* keys, unsigned int n, const K& k) {
+        unsigned int lo = 0, hi = n;
+        while (lo < hi) {
+            unsigned int mid = (lo + hi) / 2;
+            if (keys[mid] < k) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    }
+    // first position with keys[pos] > k, i.e. the child to descend into
+    static unsigned int upper(const K* keys, unsigned int n, const K& k) {
+        unsigned int lo = 0, hi = n;
+        while (lo < hi) {
+            unsigned int mid = (lo + hi) / 2;
+            if (k < keys[mid]) hi = mid; else lo = mid + 1;
+        }
+        return lo;
+    }
+
+    Leaf* find_leaf(const K& k) const {
+        Node* nd = root;
+        while (nd && !nd->leaf) {
+            Inner* in = (Inner*)nd;
+            nd = in->child[upper(in->keys, in->n, k)];
+        }
+        return (Leaf*)nd;
+    }
+
+    // Inserts into the subtree. On split, returns the new right sibling and
+    // its separator in `sep`; `added` reports a new key (not an update).
+    Node* insert_rec(Node* nd, const K& k, const V& v, K& sep, bool& added) {
+        if (nd->leaf) {
+            Leaf* l = (Leaf*)nd;
+            unsigned int pos = lower(l->keys, l->n, k);
+            if (pos < l->n && !(k < l->keys[pos])) {
+                l->vals[pos] = v;
+                return nullptr;
+            }
+            added = true;
+            Leaf* right = nullptr;
+            if (l->n == FANOUT) {
+                right = make_leaf();
+                unsigned int mid = FANOUT / 2;
+                for (unsigned int i = mid; i < FANOUT; i++) {
+                    right->keys[i - mid] = std::move(l->keys[i]);
+                    right->vals[i - mid] = std::move(l->vals[i]);
+                }
+                right->n = FANOUT - mid;
+                l->n = mid;
+                right->next = l->next;
+                if (right->next) right->next->prev = right;
+                right->prev = l;
+                l->next = right;
+                if (pos > mid) { l = right; pos -= mid; }
+            }
+            for (unsigned int i = l->n; i > pos; i--) {
+                l->keys[i] = std::move(l->keys[i - 1]);
+                l->vals[i] = std::move(l->vals[i - 1]);
+            }
+            l->keys[pos] = k;
+            l->vals[pos] = v;
+            l->n++;
+            if (right) sep = right->keys[0];
+            return right;
+        }
+
+        Inner* in = (Inner*)nd;
+        unsigned int ci = upper(in->keys, in->n, k);
+        K child_sep;
+        Node* split = insert_rec(in->child[ci], k, v, child_sep, added);
+        if (!split) return nullptr;
+
+        if (in->n < FANOUT) {
+            for (unsigned int i = in->n; i > ci; i--) {
+                in->keys[i] = std::move(in->keys[i - 1]);
+                in->child[i + 1] = in->child[i];
+            }
+            in->keys[ci] = child_sep;
+            in->child[ci + 1] = split;
+            in->n++;
+            return nullptr;
+        }
+
+        // full: merge into scratch arrays, then split around the middle key
+        K tk[FANOUT + 1];
+        Node* tc[FANOUT + 2];
+        for (unsigned int i = 0, j = 0; i <= FANOUT; i++) {
+            if (i == ci) tk[i] = child_sep;
+            else tk[i] = std::move(in->keys[j++]);
+        }
+        for (unsigned int i = 0, j = 0; i <= FANOUT + 1; i++) {
+            if (i == ci + 1) tc[i] = split;
+            else tc[i] = in->child[j++];
+        }
+        unsigned int mid = (FANOUT + 1) / 2;
+        Inner* right = make_inner();
+        in->n = mid;
+        for (unsigned int i = 0; i < mid; i++) { in->keys[i] = std::move(tk[i]); in->child[i] = tc[i]; }
+        in->child[mid] = tc[mid];
+        sep = std::move(tk[mid]);
+        right->n = FANOUT - mid;
+        for (unsigned int i = 0; i < right->n; i++) {
+            right->keys[i] = std::move(tk[mid + 1 + i]);
+            right->child[i] = tc[mid + 1 + i];
+        }
+        right->child[right->n] = tc[FANOUT + 1];
+        return right;
+    }
+
+    // Refills in->child[ci] after it dropped below MIN_KEYS, by borrowing
+    // from a sibling or merging with one.
+    void fix_child(Inner* in, unsigned int ci) {
+        Node* c = in->child[ci];
+        Node* ls = ci > 0 ? in->child[ci - 1] : nullptr;
+        Node* rs = ci < in->n ? in->child[ci + 1] : nullptr;
+
+        if (c->leaf) {
+            Leaf* l = (Leaf*)c;
+            Leaf* left = (Leaf*)ls;
+            Leaf* right = (Leaf*)rs;
+            if (left && left->n > MIN_KEYS) {
+                for (unsigned int i = l->n; i > 0; i--) {
+                    l->keys[i] = std::move(l->keys[i - 1]);
+                    l->vals[i] = std::move(l->vals[i - 1]);
+                }
+                left->n--;
+                l->keys[0] = std::move(left->keys[left->n]);
+                l->vals[0] = std::move(left->vals[left->n]);
+                l->n++;
+                in->keys[ci - 1] = l->keys[0];
+                return;
+            }
+            if (right && right->n > MIN_KEYS) {
+                l->keys[l->n] = std::move(right->keys[0]);
+                l->vals[l->n] = std::move(right->vals[0]);
+                l->n++;
+                for (unsigned int i = 1; i < right->n; i++) {
+                    right->keys[i - 1] = std::move(right->keys[i]);
+                    right->vals[i - 1] = std::move(right->vals[i]);
+                }
+                right->n--;
+                in->keys[ci] = right->keys[0];
+                return;
+            }
+            // merge the pair into its left node
+            unsigned int si = left ? ci - 1 : ci;
+            Leaf* a = left ? left : l;
+            Leaf* b = left ? l : right;
+            for (unsigned int i = 0; i < b->n; i++) {
+                a->keys[a->n + i] = std::move(b->keys[i]);
+                a->vals[a->n + i] = std::move(b->vals[i]);
+            }
+            a->n += b->n;
+            a->next = b->next;
+            if (a->next) a->next->prev = a;
+            free_node(b);
+            remove_slot(in, si);
+            return;
+        }
+
+        Inner* c_in = (Inner*)c;
+        Inner* left = (Inner*)ls;
+        Inner* right = (Inner*)rs;
+        if (left && left->n > MIN_KEYS) {
+            c_in->child[c_in->n + 1] = c_in->child[c_in->n];
+            for (unsigned int i = c_in->n; i > 0; i--) {
+                c_in->keys[i] = std::move(c_in->keys[i - 1]);
+                c_in->child[i] = c_in->child[i - 1];
+            }
+            c_in->keys[0] = std::move(in->keys[ci - 1]);
+            c_in->child[0] = left->child[left->n];
+            c_in->n++;
+            in->keys[ci - 1] = std::move(left->keys[left->n - 1]);
+            left->n--;
+            return;
+        }
+        if (right && right->n > MIN_KEYS) {
+            c_in->keys[c_in->n] = std::move(in->keys[ci]);
+            c_in->child[c_in->n + 1] = right->child[0];
+            c_in->n++;
+            in->keys[ci] = std::move(right->keys[0]);
+            for (unsigned int i = 1; i < right->n; i++) {
+                right->keys[i - 1] = std::move(right->keys[i]);
+                right->child[i - 1] = right->child[i];
+            }
+            right->child[right->n - 1] = right->child[right->n];
+            right->n--;
+            return;
+        }
+        unsigned int si = left ? ci - 1 : ci;
+        Inner* a = left ? left : c_in;
+        Inner* b = left ? c_in : right;
+        a->keys[a->n] = std::move(in->keys[si]);
+        for (unsigned int i = 0; i < b->n; i++) {
+            a->keys[a->n + 1 + i] = std::move(b->keys[i]);
+            a->child[a->n + 1 + i] = b->child[i];
+        }
+        a->child[a->n + 1 + b->n] = b->child[b->n];
+        a->n += 1 + b->n;
+        free_node(b);
+        remove_slot(in, si);
+    }
+
+    // drops separator si and child si+1 (already merged away)
+    static void remove_slot(Inner* in, unsigned int si) {
+        for (unsigned int i = si; i + 1 < in->n; i++) {
+            in->keys[i] = std::move(in->keys[i + 1]);
+            in->child[i + 1] = in->child[i + 2];
+        }
+        in->n--;
+    }
+
+    bool erase_rec(Node* nd, const K& k) {
+        if (nd->leaf) {
+            Leaf* l = (Leaf*)nd;
+            unsigned int pos = lower(l->keys, l->n, k);
+            if (pos >= l->n || k < l->keys[pos]) return false;
+            for (unsigned int i = pos + 1; i < l->n; i++) {
+                l->keys[i - 1] = std::move(l->keys[i]);
+                l->vals[i - 1] = std::move(l->vals[i]);
+            }
+            l->n--;
+            l->keys[l->n] = K();
+            l->vals[l->n] = V();
+            return true;
+        }
+        Inner* in = (Inner*)nd;
+        unsigned int ci = upper(in->keys, in->n, k);
+        if (!erase_rec(in->child[ci], k)) return false;
+        if (in->child[ci]->n < MIN_KEYS) fix_child(in, ci);
+        return true;
+    }
+
+public:
+    // Position in the leaf chain; invalid once past the last entry.
+    // Any insert or erase invalidates open cursors.
+    class Cursor {
+        friend class BPlusTree;
+        const Leaf* leaf;
+        unsigned int pos;
+        Cursor(const Leaf* l, unsigned int p): leaf(l), pos(p) { skip(); }
+        void skip() { while (leaf && pos >= leaf->n) { leaf = leaf->next; pos = 0; } }
+    public:
+        Cursor(): leaf(nullptr), pos(0) {}
+        bool valid() const { return leaf != nullptr; }
+        const K& key() const { return leaf->keys[pos]; }
+        const V& value() const { return leaf->vals[pos]; }
+        void next() { pos++; skip(); }
+    };
+
+    BPlusTree(): root(nullptr), count(0) {}
+    ~BPlusTree() { destroy(root); }
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+    BPlusTree(BPlusTree&& o): root(o.root), count(o.count) { o.root = nullptr; o.count = 0; }
+    BPlusTree& operator=(BPlusTree&& o) {
+        if (this != &o) {
+            destroy(root);
+            root = o.root;
+            count = o.count;
+            o.root = nullptr;
+            o.count = 0;
+        }
+        return *this;
+    }
+
+    unsigned long long size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void clear() {
+        destroy(root);
+        root = nullptr;
+        count = 0;
+    }
+
+    // Inserts or updates. Returns true when the key was new.
+    bool insert(const K& k, const V& v) {
+        if (!root) root = make_leaf();
+        K sep;
+        bool added = false;
+        Node* split = insert_rec(root, k, v, sep, added);
+        if (split) {
+            Inner* r = make_inner();
+            r->n = 1;
+            r->keys[0] = sep;
+            r->child[0] = root;
+            r->child[1] = split;
+            root = r;
+        }
+        if (added) count++;
+        return added;
+    }
+
+    bool erase(const K& k) {
+        if (!root || !erase_rec(root, k)) return false;
+        count--;
+        if (!root->leaf && root->n == 0) {
+            Node* only = ((Inner*)root)->child[0];
+            free_node(root);
+            root = only;
+        } else if (root->leaf && root->n == 0) {
+            free_node(root);
+            root = nullptr;
+        }
+        return true;
+    }
+
+    V* find(const K& k) {
+        Leaf* l = find_leaf(k);
+        if (!l) return nullptr;
+        unsigned int pos = lower(l->keys, l->n, k);
+        if (pos >= l->n || k < l->keys[pos]) return nullptr;
+        return &l->vals[pos];
+    }
+    const V* find(const K& k) const { return const_cast<BPlusTree*>(this)->find(k); }
+
+    bool get(const K& k, V& out) const {
+        const V* v = find(k);
+        if (!v) return false;
+        out = *v;
+        return true;
+    }
+    bool contains(const K& k) const { return find(k) != nullptr; }
+
+    // first entry with key >= k
+    Cursor lower_bound(const K& k) const {
+        Leaf* l = find_leaf(k);
+        if (!l) return Cursor();
+        return Cursor(l, lower(l->keys, l->n, k));
+    }
+    Cursor begin() const {
+        Node* nd = root;
+        while (nd && !nd->leaf) nd = ((Inner*)nd)->child[0];
+        return Cursor((Leaf*)nd, 0);
+    }
+
+    // Replaces the contents with strictly ascending entries. Leaves are
+    // filled evenly bottom-up, so every node ends up at least half full.
+    void bulk_load(const std::vector<std::pair<K, V>>& sorted) {
+        clear();
+        if (sorted.empty()) return;
+
+        std::vector<Node*> level;
+        std::vector<K> firsts;      // smallest key under each node of `level`
+        size_t total = sorted.size();
+        size_t nodes = (total + FANOUT - 1) / FANOUT;
+        Leaf* prev = nullptr;
+        for (size_t i = 0, at = 0; i < nodes; i++) {
+            size_t take = total / nodes + (i < total % nodes ? 1 : 0);
+            Leaf* l = make_leaf();
+            for (size_t j = 0; j < take; j++) {
+                l->keys[j] = sorted[at + j].first;
+                l->vals[j] = sorted[at + j].second;
+            }
+            l->n = (unsigned int)take;
+            l->prev = prev;
+            if (prev) prev->next = l;
+            prev = l;
+            level.push_back(l);
+            firsts.push_back(sorted[at].first);
+            at += take;
+        }
+
+        while (level.size() > 1) {
+            std::vector<Node*> up;
+            std::vector<K> up_firsts;
+            size_t kids = level.size();
+            size_t parents = (kids + FANOUT) / (FANOUT + 1);
+            for (size_t i = 0, at = 0; i < parents; i++) {
+                size_t take = kids / parents + (i < kids % parents ? 1 : 0);
+                Inner* in = make_inner();
+                for (size_t j = 0; j < take; j++) {
+                    in->child[j] = level[at + j];
+                    if (j > 0) in->keys[j - 1] = firsts[at + j];
+                }
+                in->n = (unsigned int)(take - 1);
+                up.push_back(in);
+                up_firsts.push_back(firsts[at]);
+                at += take;
+            }
+            level.swap(up);
+            firsts.swap(up_firsts);
+        }
+        root = level[0];
+        count = total;
+    }
+};
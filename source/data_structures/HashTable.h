@@ -1,10 +1,12 @@
 #pragma once
 #include <vector>
-#include "SinglyLinkedList.h"
+#include <string>
+#include <utility>
 
-template <typename K>
+// Transparent: compares K against any key type Q with operator<.
 struct DefaultKeyEq {
-    bool operator()(const K& a, const K& b) const { return !(a < b) && !(b < a); }
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const { return !(a < b) && !(b < a); }
 };
 
 template <typename K>
@@ -17,71 +19,171 @@ struct DefaultHasher {
     }
 };
 
+inline unsigned long long hash_bytes(const unsigned char* p, unsigned long long n) {
+    unsigned long long h = 5381;
+    for (unsigned long long i = 0; i < n; i++) h = ((h << 5) + h) + p[i];
+    return h;
+}
+
 template <>
 struct DefaultHasher<std::vector<unsigned char>> {
     unsigned long long operator()(const std::vector<unsigned char>& v) const {
-        unsigned long long h = 5381;
-        for (unsigned long long i = 0; i < v.size(); i++) h = ((h << 5) + h) + v[i];
-        return h;
+        return hash_bytes(v.data(), v.size());
+    }
+};
+
+// std::string keys can be looked up with a const char* without building a string.
+template <>
+struct DefaultHasher<std::string> {
+    unsigned long long operator()(const std::string& v) const {
+        return hash_bytes((const unsigned char*)v.data(), v.size());
+    }
+    unsigned long long operator()(const char* s) const {
+        unsigned long long n = 0;
+        while (s[n]) n++;
+        return hash_bytes((const unsigned char*)s, n);
     }
 };
 
-template <typename K, typename V, typename Hasher = DefaultHasher<K>, typename KeyEq = DefaultKeyEq<K>>
+// Open addressing with Robin Hood probing. ctrl[i] is 0 for an empty slot,
+// otherwise 1 + the slot's distance from its home bucket. Inserts take the
+// slot of any richer entry, and erase shifts the following run back, so
+// lookups stop as soon as they are further from home than the slot they see
+// and no tombstones are needed. Capacity is a power of two and doubles past
+// a 7/8 load factor.
+template <typename K, typename V, typename Hasher = DefaultHasher<K>, typename KeyEq = DefaultKeyEq>
 class HashTable {
-    struct Pair { K k; V v; Pair(const K& kk, const V& vv): k(kk), v(vv) {} };
-    std::vector<SinglyLinkedList<Pair>> buckets;
+    struct Slot { K k; V v; };
+    std::vector<unsigned char> ctrl;
+    std::vector<Slot> slots;
     unsigned long long n;
+    unsigned long long mask;
     Hasher hasher;
     KeyEq eq;
-    unsigned long long idx(const K& k) const { return hasher(k) % buckets.size(); }
-public:
-    HashTable(unsigned long long cap = 128): buckets(cap), n(0) {}
-    bool put(const K& k, const V& v) {
-        unsigned long long i = idx(k);
-        bool updated = false;
-        std::vector<Pair> temp;
-        buckets[i].for_each([&](Pair p) { temp.push_back(p); });
-        buckets[i].clear();
-        for (unsigned long long j = 0; j < temp.size(); j++) {
-            if (eq(temp[j].k, k)) {
-                buckets[i].push_back(Pair(k, v));
-                updated = true;
-            } else {
-                buckets[i].push_back(temp[j]);
-            }
+
+    static unsigned long long mix(unsigned long long h) {
+        // spread weak hashes (e.g. small integers) over the low bits
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    template <typename Q>
+    long long locate(const Q& k) const {
+        unsigned long long i = mix(hasher(k)) & mask;
+        for (unsigned int d = 1; ; d++, i = (i + 1) & mask) {
+            if (ctrl[i] < d) return -1;
+            if (ctrl[i] == d && eq(slots[i].k, k)) return (long long)i;
         }
-        if (!updated) {
-            buckets[i].push_back(Pair(k, v));
-            n++;
+    }
+
+    void place(K k, V v) {
+        unsigned long long i = mix(hasher(k)) & mask;
+        unsigned int d = 1;
+        while (true) {
+            if (ctrl[i] == 0) {
+                ctrl[i] = (unsigned char)d;
+                slots[i].k = std::move(k);
+                slots[i].v = std::move(v);
+                return;
+            }
+            if (ctrl[i] < d) {
+                std::swap(slots[i].k, k);
+                std::swap(slots[i].v, v);
+                unsigned int t = ctrl[i];
+                ctrl[i] = (unsigned char)d;
+                d = t;
+            }
+            i = (i + 1) & mask;
+            d++;
+            if (d == 255) { grow(); place(std::move(k), std::move(v)); return; }
         }
+    }
+
+    void rehash(unsigned long long cap) {
+        std::vector<unsigned char> old_ctrl(cap, 0);
+        std::vector<Slot> old_slots(cap);
+        old_ctrl.swap(ctrl);
+        old_slots.swap(slots);
+        mask = cap - 1;
+        for (unsigned long long i = 0; i < old_ctrl.size(); i++)
+            if (old_ctrl[i]) place(std::move(old_slots[i].k), std::move(old_slots[i].v));
+    }
+
+    void grow() { rehash(ctrl.size() * 2); }
+
+public:
+    HashTable(unsigned long long cap = 128): n(0) {
+        unsigned long long c = 8;
+        while (c < cap) c <<= 1;
+        ctrl.assign(c, 0);
+        slots.resize(c);
+        mask = c - 1;
+    }
+
+    // Pointer to the value for k, or nullptr. Valid until the next insert.
+    template <typename Q>
+    V* find(const Q& k) {
+        long long i = locate(k);
+        return i < 0 ? nullptr : &slots[i].v;
+    }
+    template <typename Q>
+    const V* find(const Q& k) const {
+        long long i = locate(k);
+        return i < 0 ? nullptr : &slots[i].v;
+    }
+
+    bool put(const K& k, const V& v) {
+        V* cur = find(k);
+        if (cur) { *cur = v; return true; }
+        if ((n + 1) * 8 > ctrl.size() * 7) grow();
+        place(k, v);
+        n++;
         return true;
     }
-    bool get(const K& k, V& out) const {
-        unsigned long long i = idx(k);
-        bool found = false;
-        buckets[i].for_each([&](Pair p) { if (!found && eq(p.k, k)) { out = p.v; found = true; } });
-        return found;
-    }
-    bool contains(const K& k) const {
-        V v;
-        return get(k, v);
-    }
-    bool erase(const K& k) {
-        unsigned long long i = idx(k);
-        std::vector<Pair> temp;
-        bool removed = false;
-        buckets[i].for_each([&](Pair p) { if (!eq(p.k, k)) temp.push_back(p); else removed = true; });
-        buckets[i].clear();
-        for (unsigned long long j = 0; j < temp.size(); j++) buckets[i].push_back(temp[j]);
-        if (removed) n--;
-        return removed;
+    template <typename Q>
+    bool get(const Q& k, V& out) const {
+        const V* v = find(k);
+        if (!v) return false;
+        out = *v;
+        return true;
+    }
+    template <typename Q>
+    bool contains(const Q& k) const { return locate(k) >= 0; }
+    template <typename Q>
+    bool erase(const Q& k) {
+        long long f = locate(k);
+        if (f < 0) return false;
+        unsigned long long i = (unsigned long long)f;
+        unsigned long long j = (i + 1) & mask;
+        while (ctrl[j] > 1) {
+            slots[i] = std::move(slots[j]);
+            ctrl[i] = (unsigned char)(ctrl[j] - 1);
+            i = j;
+            j = (j + 1) & mask;
+        }
+        ctrl[i] = 0;
+        slots[i] = Slot();
+        n--;
+        return true;
     }
     unsigned long long size() const { return n; }
+    void clear() {
+        ctrl.assign(ctrl.size(), 0);
+        for (unsigned long long i = 0; i < slots.size(); i++) slots[i] = Slot();
+        n = 0;
+    }
+    template <typename F>
+    void for_each(F f) const {
+        for (unsigned long long i = 0; i < ctrl.size(); i++)
+            if (ctrl[i]) f(slots[i].k, slots[i].v);
+    }
     std::vector<K> keys() const {
         std::vector<K> ks;
-        for (unsigned long long i = 0; i < buckets.size(); i++) {
-            buckets[i].for_each([&](Pair p) { ks.push_back(p.k); });
-        }
+        ks.reserve(n);
+        for (unsigned long long i = 0; i < ctrl.size(); i++)
+            if (ctrl[i]) ks.push_back(slots[i].k);
         return ks;
     }
 };
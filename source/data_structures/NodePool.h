@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// ===============================
+// Thread-local node pool
+// ===============================
+// Container nodes come from 64 KB slabs, one size class (16-byte granules
+// up to 512 bytes) per slab, so nodes of one container type sit next to
+// each other. Allocation pops the class free list or bumps a pointer; free
+// pushes onto the free list. Slabs are only returned by release_all(), once
+// no node of this thread is live. A node must be freed on the thread that
+// allocated it. The pool has no destructor, so containers destroyed after
+// thread-local teardown (e.g. globals) still free safely.
+class NodePool {
+    static const size_t SLAB_BYTES = 64 * 1024;
+    static const size_t GRANULE = 16;
+    static const size_t CLASSES = 32;
+
+    struct FreeNode { FreeNode* next; };
+    struct Slab { Slab* next; };
+    struct SizeClass { FreeNode* free; char* bump; char* end; };
+
+    SizeClass classes[CLASSES];
+    Slab* slabs;
+    size_t live;
+
+    static size_t class_of(size_t size) { return (size + GRANULE - 1) / GRANULE - 1; }
+
+    bool refill(SizeClass& c) {
+        Slab* s = (Slab*)std::malloc(SLAB_BYTES);
+        if (!s) return false;
+        s->next = slabs;
+        slabs = s;
+        c.bump = (char*)s + GRANULE;
+        c.end = (char*)s + SLAB_BYTES;
+        return true;
+    }
+
+public:
+    static NodePool& local() {
+        static thread_local NodePool pool;
+        return pool;
+    }
+
+    void* allocate(size_t size) {
+        if (size == 0) size = 1;
+        if (size > GRANULE * CLASSES) return ::operator new(size);
+        size_t k = class_of(size);
+        SizeClass& c = classes[k];
+        live++;
+        if (c.free) {
+            FreeNode* f = c.free;
+            c.free = f->next;
+            return f;
+        }
+        size_t bytes = (k + 1) * GRANULE;
+        if ((size_t)(c.end - c.bump) < bytes && !refill(c)) {
+            live--;
+            throw std::bad_alloc();
+        }
+        void* p = c.bump;
+        c.bump += bytes;
+        return p;
+    }
+
+    void deallocate(void* p, size_t size) {
+        if (!p) return;
+        if (size == 0) size = 1;
+        if (size > GRANULE * CLASSES) { ::operator delete(p); return; }
+        SizeClass& c = classes[class_of(size)];
+        FreeNode* f = (FreeNode*)p;
+        f->next = c.free;
+        c.free = f;
+        live--;
+    }
+
+    // Frees every slab at once. Refused while any node is still live.
+    bool release_all() {
+        if (live != 0) return false;
+        while (slabs) {
+            Slab* nx = slabs->next;
+            std::free(slabs);
+            slabs = nx;
+        }
+        for (size_t i = 0; i < CLASSES; i++) classes[i] = SizeClass{ nullptr, nullptr, nullptr };
+        return true;
+    }
+
+    size_t live_nodes() const { return live; }
+};
+
+// ===============================
+// Allocator policies for container nodes
+// ===============================
+struct PoolAllocator {
+    static void* allocate(size_t size) { return NodePool::local().allocate(size); }
+    static void deallocate(void* p, size_t size) { NodePool::local().deallocate(p, size); }
+};
+
+struct HeapAllocator {
+    static void* allocate(size_t size) { return ::operator new(size); }
+    static void deallocate(void* p, size_t) { ::operator delete(p); }
+};
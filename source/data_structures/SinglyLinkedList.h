@@ -1,7 +1,8 @@
 #pragma once
 #include <vector>
+#include "NodePool.h"
 
-template <typename T>
+template <typename T, typename Alloc = PoolAllocator>
 class SinglyLinkedList {
     struct Node {
         T value;
@@ -11,6 +12,8 @@ class SinglyLinkedList {
     Node* head;
     Node* tail;
     unsigned long long n;
+    static Node* make_node(const T& v) { return new (Alloc::allocate(sizeof(Node))) Node(v); }
+    static void free_node(Node* node) { node->~Node(); Alloc::deallocate(node, sizeof(Node)); }
 public:
     SinglyLinkedList(): head(nullptr), tail(nullptr), n(0) {}
     ~SinglyLinkedList() { clear(); }
@@ -20,7 +23,7 @@ public:
         Node* cur = head;
         while (cur) {
             Node* nx = cur->next;
-            delete cur;
+            free_node(cur);
             cur = nx;
         }
         head = nullptr;
@@ -28,14 +31,14 @@ public:
         n = 0;
     }
     void push_front(const T& v) {
-        Node* node = new Node(v);
+        Node* node = make_node(v);
         node->next = head;
         head = node;
         if (!tail) tail = node;
         n++;
     }
     void push_back(const T& v) {
-        Node* node = new Node(v);
+        Node* node = make_node(v);
         if (!tail) {
             head = node;
             tail = node;
@@ -51,7 +54,7 @@ public:
         out = node->value;
         head = node->next;
         if (!head) tail = nullptr;
-        delete node;
+        free_node(node);
         n--;
         return true;
     }
@@ -2,9 +2,9 @@
 #include <vector>
 #include "SinglyLinkedList.h"
 
-template <typename T>
+template <typename T, typename Alloc = PoolAllocator>
 class Stack {
-    SinglyLinkedList<T> list;
+    SinglyLinkedList<T, Alloc> list;
 public:
     Stack() {}
     bool empty() const { return list.size() == 0; }
@@ -88,11 +88,16 @@ struct OMNIHeader {
     uint32_t user_table_offset; // Byte offset to user table (4 bytes)
     uint32_t max_users;         // Maximum number of users (4 bytes)
     
-    // Reserved for Phase 2: Delta Vault 
-    uint32_t file_state_storage_offset;  // Offset to file_state_storage area (4 bytes)
+    // Phase 2: Delta Vault
+    uint32_t file_state_storage_offset;  // Offset to the VaultRecord table (4 bytes)
     uint32_t change_log_offset;       // Offset to change log (4 bytes)
     
-    uint8_t reserved[328];      // Reserved for future use (328 bytes)
+    uint32_t kdf_iterations;    // PBKDF2 cost for new password hashes (4 bytes)
+    uint8_t encoding_table[256]; // Content byte substitution, original -> stored (256 bytes)
+    uint32_t feature_flags;     // OMNI_FEATURE_* bits (4 bytes)
+    uint32_t vault_slots;       // Delta Vault records at file_state_storage_offset (4 bytes)
+    uint32_t snapshot_slots;    // Container snapshots and clones (4 bytes)
+    uint8_t reserved[56];       // Reserved for future use (56 bytes)
 
     // Default constructor
     OMNIHeader() = default;
@@ -114,7 +119,7 @@ struct OMNIHeader {
  */
 struct UserInfo {
     char username[32];          // Username (null-terminated)
-    char password_hash[64];     // Password hash (SHA-256)
+    char password_hash[64];     // Salted PBKDF2-HMAC-SHA256 record
     UserRole role;              // User role (4 bytes)
     uint64_t created_time;      // Account creation timestamp (Unix epoch)
     uint64_t last_login;        // Last login timestamp (Unix epoch)
@@ -195,6 +200,29 @@ struct FileMetadata {
     }
 };
 
+/**
+ * Earlier version of a file kept by the Delta Vault
+ * Returned by file_list_versions function
+ */
+struct FileVersion {
+    uint32_t version;           // Per-file number, 1 = the first version kept
+    uint64_t size;              // Size of the file in that version
+    uint64_t modified_time;     // Last modification of that version (Unix epoch)
+    uint64_t replaced_time;     // When the next change replaced it (Unix epoch)
+};
+
+/**
+ * Named container snapshot or writable clone
+ * Returned by container_snapshot_list function
+ */
+struct SnapshotInfo {
+    char name[32];              // Snapshot name (null-terminated)
+    uint64_t created_time;      // Creation timestamp (Unix epoch)
+    uint32_t files;             // Files in the snapshot when it was taken
+    uint8_t writable;           // 1 = clone, mounted read-write
+    uint8_t mounted;            // 1 = the tree this instance works on
+};
+
 /**
  * Session Information
  * Returned by get_session_info function
@@ -2,6 +2,63 @@
 #include <cstdint>
 #include "odf_types.hpp"
 
+// Block checksum verification. Content is loaded into memory at mount, so a
+// block only needs checking once per mount, before its first use.
+enum VerifyMode : uint32_t {
+    VERIFY_OFF = 0,
+    VERIFY_ALWAYS = 1,      // every block before it is first read
+    VERIFY_SAMPLED = 2,     // a sample of first reads
+    VERIFY_SCRUB = 3        // never on read; scrub_step walks the data region
+};
+
+// How the container file is accessed (FSConfig::io_backend).
+enum IoBackend : uint32_t {
+    IO_AUTO = 0,            // io_uring when the kernel allows a ring, else pread
+    IO_PREAD = 1,           // pread/pwrite only
+    IO_URING = 2            // same as IO_AUTO, for configs that want to say so
+};
+
+// OMNIHeader::feature_flags
+enum : uint32_t {
+    OMNI_FEATURE_CHECKSUMS = 1u << 0,   // CRC32C per block and per metadata entry
+    OMNI_FEATURE_INLINE    = 1u << 1,   // small file content kept in inline slots
+    OMNI_FEATURE_TAILS     = 1u << 2,   // final partial blocks packed into shared blocks
+    OMNI_FEATURE_COMPRESS  = 1u << 3,   // STORAGE_COMPRESSED files
+    OMNI_FEATURE_DEDUP     = 1u << 4,   // chains may share blocks; per-block fingerprints
+    OMNI_FEATURE_ALIGNED   = 1u << 5,   // data region starts on a DATA_ALIGN boundary
+    OMNI_FEATURE_VAULT     = 1u << 6,   // Delta Vault table of earlier file versions
+    OMNI_FEATURE_SNAPSHOTS = 1u << 7    // container snapshot slots (needs OMNI_FEATURE_DEDUP)
+};
+
+// Alignment of the data region and of in-memory block buffers, so blocks
+// can be read with O_DIRECT on devices with sectors up to this size.
+static const uint32_t DATA_ALIGN = 4096;
+
+// MetadataEntry::storage
+enum : uint8_t {
+    STORAGE_CHAIN  = 0,     // content in the block chain at start_index
+    STORAGE_INLINE = 1,     // content in the entry's inline slot
+    STORAGE_TAIL   = 2,     // full blocks in the chain, the remainder at
+                            // (tail_block, tail_offset), total_size % payload bytes
+    STORAGE_COMPRESSED = 3  // extent table and extents in the chain, see below
+};
+
+// A STORAGE_COMPRESSED chain holds a uint32 extent count, one uint32 stored
+// length per extent, then the extents back to back. Each covers
+// COMPRESS_EXTENT bytes of the file (the last one the rest) and is LZ4
+// compressed, or kept as is when COMPRESS_RAW is set in its length.
+// The low bits of a length are the bytes stored; the bits above
+// COMPRESS_SLACK_SHIFT count unused bytes after them, room for the extent
+// to be packed again in place when the file is edited.
+static const uint32_t COMPRESS_EXTENT = 64 * 1024;
+static const uint32_t COMPRESS_RAW = 0x80000000u;
+static const uint32_t COMPRESS_LEN_MASK = 0x1FFFFu;
+static const uint32_t COMPRESS_SLACK_SHIFT = 17;
+static const uint32_t COMPRESS_MAX_SLACK = 0x3FFFu;
+
+// bytes of content an inline slot holds; one slot per metadata entry
+static const uint32_t INLINE_CAPACITY = 192;
+
 struct FSConfig {
     uint64_t total_size;
     uint64_t header_size;
@@ -16,6 +73,19 @@ struct FSConfig {
     uint32_t server_port;
     uint32_t max_connections;
     uint32_t queue_timeout;          // <-- REQUIRED
+    uint32_t session_idle_timeout;   // seconds without a request, 0 = never
+    uint32_t session_max_lifetime;   // seconds since login, 0 = never
+    uint32_t stream_stall_timeout;   // seconds a raw download may send nothing, 0 = never
+    uint32_t kdf_iterations;         // password hashing cost, 0 = default
+    uint32_t verify_mode;            // VerifyMode: when block checksums are checked
+    uint32_t verify_sample;          // VERIFY_SAMPLED checks 1 in this many block reads
+    uint32_t compression;            // compress new files that span more than a block
+    uint32_t dedup;                  // share identical blocks between new files
+    uint64_t cache_size;             // bytes of data blocks kept in memory, 0 = all
+    uint32_t io_backend;             // IoBackend
+    uint32_t direct_io;              // data blocks bypass the kernel page cache
+    uint32_t vault_slots;            // earlier file versions kept, 0 = none (format only)
+    uint32_t snapshot_slots;         // container snapshots and clones, 0 = none (format only)
 
     char student_id[32];
     char submission_date[16];
@@ -37,6 +107,19 @@ struct FSConfig {
         server_port = 0;
         max_connections = 0;
         queue_timeout = 0;
+        session_idle_timeout = 1800;
+        session_max_lifetime = 86400;
+        stream_stall_timeout = 60;
+        kdf_iterations = 0;
+        verify_mode = 1;            // VERIFY_ALWAYS
+        verify_sample = 16;
+        compression = 0;
+        dedup = 0;
+        cache_size = 0;
+        io_backend = IO_AUTO;
+        direct_io = 0;
+        vault_slots = 0;
+        snapshot_slots = 0;
 
         memset(student_id, 0, sizeof(student_id));
         memset(submission_date, 0, sizeof(submission_date));
@@ -58,7 +141,12 @@ struct MetadataEntry {
     uint32_t permissions;
     uint64_t created_time;
     uint64_t modified_time;
-    uint8_t reserved[18];
+    uint8_t storage;        // STORAGE_*
+    uint32_t tail_block;    // STORAGE_TAIL: fragment block and byte offset in its payload
+    uint16_t tail_offset;
+    uint32_t versions;      // earlier versions handed to the Delta Vault so far
+    uint8_t reserved[3];
+    uint32_t crc;           // CRC32C of the entry with this field zeroed, then its inline bytes
     MetadataEntry() {
         valid_flag = 0;
         type_flag = 0;
@@ -70,11 +158,55 @@ struct MetadataEntry {
         permissions = 0;
         created_time = 0;
         modified_time = 0;
-        for (int i = 0; i < 18; i++) reserved[i] = 0;
+        storage = STORAGE_CHAIN;
+        tail_block = 0;
+        tail_offset = 0;
+        versions = 0;
+        for (int i = 0; i < 3; i++) reserved[i] = 0;
+        crc = 0;
     }
 };
 #pragma pack(pop)
 
+// One earlier version of a file in the Delta Vault. It holds only what the
+// change that replaced it overwrote: the version's bytes [delta_off,
+// delta_off + delta_len), block aligned, in a chain of their own. Applying
+// the records of a file from the newest down to version v to the current
+// content (resize to size, then copy the delta in) gives version v.
+#pragma pack(push,1)
+struct VaultRecord {
+    uint32_t inode;         // 0 = free slot (inode 0 is the root directory)
+    uint32_t version;
+    uint64_t seq;           // vault-wide order, the lowest is dropped first
+    uint64_t modified_time;
+    uint64_t replaced_time;
+    uint64_t size;
+    uint64_t delta_off;
+    uint64_t delta_len;
+    uint32_t delta_start;   // 0xFFFFFFFF when delta_len is 0
+    uint32_t crc;           // CRC32C of the record with this field zeroed
+};
+#pragma pack(pop)
+
+// A container snapshot slot: this record, then a copy of the metadata table
+// and the inline slots as they were when the snapshot was taken. The data
+// blocks stay where they are; the snapshot holds a reference on the head of
+// every chain, so writers copy instead of overwriting them, and on its
+// packed tails. A clone is a slot that is mounted writable.
+// tail references are counted in a byte, one per tree
+static const uint32_t MAX_SNAPSHOT_SLOTS = 64;
+
+#pragma pack(push,1)
+struct SnapshotRecord {
+    char name[32];          // NUL-terminated, empty = free slot
+    uint64_t created_time;
+    uint32_t files;
+    uint8_t writable;       // clone; a snapshot is mounted read-only
+    uint8_t reserved[15];
+    uint32_t crc;           // CRC32C of the record with this field zeroed
+};
+#pragma pack(pop)
+
 struct MountLayout {
     uint64_t user_table_offset;
     uint64_t user_table_size;
@@ -0,0 +1,28 @@
+#include "binary_protocol.h"
+#include <cstring>
+
+int64_t bin_frame_length(const char* p, size_t avail) {
+    if (avail < 4) return 0;
+    uint32_t len;
+    std::memcpy(&len, p, 4);
+    if (len < sizeof(BinRequestHeader) - 4 || len > BIN_MAX_FRAME) return -1;
+    if (avail < (size_t)len + 4) return 0;
+    return (int64_t)len + 4;
+}
+
+size_t bin_begin_reply(OutBuffer& out, const BinRequestHeader& req, OFSErrorCodes status) {
+    size_t start = out.size();
+    BinResponseHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.opcode = req.opcode;
+    h.tag = req.tag;
+    h.status = (int32_t)status;
+    out.put(&h, sizeof(h));
+    return start;
+}
+
+void bin_end_reply(OutBuffer& out, size_t start, uint32_t count) {
+    BinResponseHeader* h = (BinResponseHeader*)out.at(start);
+    h->length = (uint32_t)(out.size() - start - 4);
+    h->count = count;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#include "../include/odf_types.hpp"
+#include "out_buffer.h"
+
+// ===============================
+// Binary wire protocol
+// ===============================
+// A client opts in by sending the preface (8-byte magic followed by the
+// 64-byte zero-padded private key) right after connecting; anything else on
+// the port is treated as JSON. A preface with the wrong key is dropped
+// silently, like a JSON request with the wrong key. After the preface every
+// request and reply is a length-prefixed little-endian frame. Results are
+// the odf_types structs in their in-memory layout (FileEntry, FileMetadata,
+// FSStats, ...), and file bodies travel as raw bytes.
+
+static const char BIN_MAGIC[8] = { 'O', 'F', 'S', 'B', 'I', 'N', '0', '1' };
+static const size_t BIN_PREFACE_LEN = 8 + 64;
+static const uint32_t BIN_MAX_FRAME = 64u * 1024u * 1024u;
+
+// request/response flags
+static const uint8_t BIN_FLAG_RAW = 0x01;   // FILE_READ: body streamed from the container;
+                                            // a reply without it carries the body in the frame
+
+enum class BinOp : uint8_t {
+    USER_LOGIN = 1,         // path = username, payload = password
+    USER_LOGOUT,
+    USER_CREATE,            // path = username, payload = password, aux = UserRole
+    USER_DELETE,            // path = username
+    USER_LIST,              // -> UserInfo[count]
+    SESSION_INFO,           // -> SessionInfo
+    FILE_CREATE,            // payload = content
+    FILE_READ,              // -> raw bytes (BIN_FLAG_RAW: streamed with sendfile)
+    FILE_EDIT,              // payload = content, offset = write position
+    FILE_DELETE,
+    FILE_TRUNCATE,
+    DIR_CREATE,
+    DIR_LIST,               // payload = prefix '\0' cursor (name '/' inode of the last
+                            // entry, see FileSystem::page_cursor), aux = limit -> FileEntry[count]
+    DIR_DELETE,
+    GET_METADATA,           // -> FileMetadata
+    SET_PERMISSIONS,        // aux = permissions
+    GET_STATS,              // -> FSStats
+    FILE_VERSIONS,          // -> FileVersion[count]
+    FILE_READ_VERSION,      // aux = version -> raw bytes
+    CONTAINER_SNAPSHOT,     // path = name
+    CONTAINER_CLONE,        // path = snapshot, payload = name of the clone
+    CONTAINER_SNAPSHOT_DELETE, // path = name
+    CONTAINER_SNAPSHOT_LIST // -> SnapshotInfo[count]
+};
+
+#pragma pack(push, 1)
+struct BinRequestHeader {
+    uint32_t length;        // bytes after this field (header rest + path + payload)
+    uint8_t  opcode;        // BinOp
+    uint8_t  flags;
+    uint16_t path_len;
+    uint32_t tag;           // client tag, echoed in the reply
+    uint8_t  token[16];     // session token (raw bytes), all zero = connection's session
+    uint64_t offset;
+    uint32_t aux;
+    uint32_t payload_len;
+};
+
+struct BinResponseHeader {
+    uint32_t length;        // bytes after this field
+    uint8_t  opcode;        // echoed
+    uint8_t  flags;
+    uint16_t reserved;
+    uint32_t tag;           // echoed from the request
+    int32_t  status;        // OFSErrorCodes
+    uint32_t count;         // struct count, or payload bytes for FILE_READ
+};
+#pragma pack(pop)
+
+static_assert(sizeof(BinRequestHeader) == 44, "BinRequestHeader must stay 44 bytes");
+static_assert(sizeof(BinResponseHeader) == 20, "BinResponseHeader must stay 20 bytes");
+
+// Frame length if a complete frame is buffered, 0 if more bytes are needed,
+// -1 if the length prefix is invalid.
+int64_t bin_frame_length(const char* p, size_t avail);
+
+// Reply helpers: the header is reserved first and patched once the body
+// size is known, so bodies are written straight into the connection buffer.
+size_t bin_begin_reply(OutBuffer& out, const BinRequestHeader& req, OFSErrorCodes status);
+void bin_end_reply(OutBuffer& out, size_t start, uint32_t count);
@@ -0,0 +1,418 @@
+#include "json_protocol.h"
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+
+// ==========================================================
+// Slice helpers
+// ==========================================================
+bool JsonSlice::equals(const char* lit) const {
+    size_t l = std::strlen(lit);
+    return l == n && std::memcmp(p, lit, l) == 0;
+}
+
+bool json_to_u64(const JsonSlice& s, uint64_t& out) {
+    if (s.type != JsonType::NUMBER || s.n == 0) return false;
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < s.n; i++) {
+        char c = s.p[i];
+        if (c < '0' || c > '9') return false;
+        uint64_t d = (uint64_t)(c - '0');
+        if (v > (UINT64_MAX - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    out = v;
+    return true;
+}
+
+bool json_to_i64(const JsonSlice& s, int64_t& out) {
+    if (s.type != JsonType::NUMBER || s.n == 0) return false;
+    JsonSlice t = s;
+    bool neg = false;
+    if (t.p[0] == '-') { neg = true; t.p++; t.n--; }
+    uint64_t v = 0;
+    if (!json_to_u64(t, v)) return false;
+    if (v > (neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX)) return false;
+    out = neg ? (int64_t)(0 - v) : (int64_t)v;
+    return true;
+}
+
+// ==========================================================
+// Tokenizer
+// ==========================================================
+void JsonReader::skip_ws() {
+    while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n'))
+        cur++;
+}
+
+bool JsonReader::scan_string(JsonSlice& out) {
+    // cur is on the opening quote
+    char* start = ++cur;
+    bool esc = false;
+    while (cur < end) {
+        char c = *cur;
+        if (c == '"') {
+            out.p = start;
+            out.n = (uint32_t)(cur - start);
+            out.type = JsonType::STRING;
+            out.escaped = esc;
+            cur++;
+            return true;
+        }
+        if (c == '\\') {
+            esc = true;
+            cur += 2;
+            continue;
+        }
+        cur++;
+    }
+    return false;
+}
+
+bool JsonReader::skip_nested(char open, char close) {
+    int depth = 0;
+    while (cur < end) {
+        char c = *cur;
+        if (c == '"') {
+            JsonSlice dummy;
+            if (!scan_string(dummy)) return false;
+            continue;
+        }
+        if (c == open) depth++;
+        else if (c == close && --depth == 0) { cur++; return true; }
+        cur++;
+    }
+    return false;
+}
+
+bool JsonReader::scan_value(JsonSlice& out) {
+    skip_ws();
+    if (cur >= end) return false;
+
+    char c = *cur;
+    char* start = cur;
+    out.escaped = false;
+
+    if (c == '"') return scan_string(out);
+
+    if (c == '{' || c == '[') {
+        if (!skip_nested(c, c == '{' ? '}' : ']')) return false;
+        out.p = start;
+        out.n = (uint32_t)(cur - start);
+        out.type = (c == '{') ? JsonType::OBJECT : JsonType::ARRAY;
+        return true;
+    }
+
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        cur++;
+        while (cur < end && ((*cur >= '0' && *cur <= '9') || *cur == '.' ||
+                             *cur == 'e' || *cur == 'E' || *cur == '+' || *cur == '-'))
+            cur++;
+        out.p = start;
+        out.n = (uint32_t)(cur - start);
+        out.type = JsonType::NUMBER;
+        return true;
+    }
+
+    struct Lit { const char* s; uint32_t n; JsonType t; };
+    static const Lit lits[] = {
+        { "true", 4, JsonType::BOOL_TRUE },
+        { "false", 5, JsonType::BOOL_FALSE },
+        { "null", 4, JsonType::NUL },
+    };
+    for (const Lit& l : lits) {
+        if ((size_t)(end - cur) >= l.n && std::memcmp(cur, l.s, l.n) == 0) {
+            cur += l.n;
+            out.p = start;
+            out.n = l.n;
+            out.type = l.t;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JsonReader::begin_object() {
+    skip_ws();
+    if (cur >= end || *cur != '{') { ok = false; return false; }
+    cur++;
+    return true;
+}
+
+bool JsonReader::next_member(JsonSlice& key, JsonSlice& value) {
+    if (!ok) return false;
+
+    skip_ws();
+    if (cur < end && *cur == ',') { cur++; skip_ws(); }
+    if (cur < end && *cur == '}') { cur++; return false; }
+
+    if (cur >= end || *cur != '"' || !scan_string(key)) { ok = false; return false; }
+
+    skip_ws();
+    if (cur >= end || *cur != ':') { ok = false; return false; }
+    cur++;
+
+    if (!scan_value(value)) { ok = false; return false; }
+    return true;
+}
+
+// ==========================================================
+// In-place decoders
+// ==========================================================
+static int hex_val(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_u4(const char* p, const char* end, uint32_t& out) {
+    if (end - p < 4) return false;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = hex_val(p[i]);
+        if (h < 0) return false;
+        v = (v << 4) | (uint32_t)h;
+    }
+    out = v;
+    return true;
+}
+
+int64_t json_unescape_inplace(JsonSlice& s) {
+    if (!s.escaped) return s.n;
+
+    const char* r = s.p;
+    const char* end = s.p + s.n;
+    char* w = s.p;
+
+    while (r < end) {
+        if (*r != '\\') { *w++ = *r++; continue; }
+        if (++r >= end) return -1;
+
+        char c = *r++;
+        switch (c) {
+            case '"':  *w++ = '"';  break;
+            case '\\': *w++ = '\\'; break;
+            case '/':  *w++ = '/';  break;
+            case 'b':  *w++ = '\b'; break;
+            case 'f':  *w++ = '\f'; break;
+            case 'n':  *w++ = '\n'; break;
+            case 'r':  *w++ = '\r'; break;
+            case 't':  *w++ = '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!read_u4(r, end, cp)) return -1;
+                r += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t lo;
+                    if (end - r < 6 || r[0] != '\\' || r[1] != 'u' ||
+                        !read_u4(r + 2, end, lo) || lo < 0xDC00 || lo > 0xDFFF)
+                        return -1;
+                    r += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                // UTF-8 output is never longer than the \uXXXX input
+                if (cp < 0x80) {
+                    *w++ = (char)cp;
+                } else if (cp < 0x800) {
+                    *w++ = (char)(0xC0 | (cp >> 6));
+                    *w++ = (char)(0x80 | (cp & 0x3F));
+                } else if (cp < 0x10000) {
+                    *w++ = (char)(0xE0 | (cp >> 12));
+                    *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    *w++ = (char)(0x80 | (cp & 0x3F));
+                } else {
+                    *w++ = (char)(0xF0 | (cp >> 18));
+                    *w++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+                    *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    *w++ = (char)(0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default:
+                return -1;
+        }
+    }
+
+    s.n = (uint32_t)(w - s.p);
+    s.escaped = false;
+    return s.n;
+}
+
+static const char B64_CHARS[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int8_t b64_val(unsigned char c) {
+    static int8_t table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (int i = 0; i < 256; i++) table[i] = -1;
+        for (int i = 0; i < 64; i++) table[(unsigned char)B64_CHARS[i]] = (int8_t)i;
+        ready = true;
+    }
+    return table[c];
+}
+
+int64_t base64_decode_inplace(JsonSlice& s) {
+    const unsigned char* r = (const unsigned char*)s.p;
+    const unsigned char* end = r + s.n;
+    unsigned char* w = (unsigned char*)s.p;
+
+    uint32_t acc = 0;
+    int bits = 0;
+    while (r < end) {
+        unsigned char c = *r++;
+        if (c == '=') break;
+        int8_t v = b64_val(c);
+        if (v < 0) return -1;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            *w++ = (unsigned char)(acc >> bits);
+        }
+    }
+
+    s.n = (uint32_t)(w - (unsigned char*)s.p);
+    return s.n;
+}
+
+// ==========================================================
+// Writer
+// ==========================================================
+void JsonWriter::key(const char* k) {
+    if (need_comma) out->put(',');
+    out->put('"');
+    out->put(k, std::strlen(k));
+    out->put("\":", 2);
+    need_comma = true;
+}
+
+void JsonWriter::escaped(const char* s, size_t n) {
+    static const char HEX[] = "0123456789abcdef";
+
+    // worst case every byte becomes \u00XX
+    size_t worst = n * 6 + 2;
+    char* start = out->reserve(worst);
+    char* w = start;
+    *w++ = '"';
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            *w++ = '\\';
+            *w++ = (char)c;
+        } else if (c == '\n') {
+            *w++ = '\\'; *w++ = 'n';
+        } else if (c == '\r') {
+            *w++ = '\\'; *w++ = 'r';
+        } else if (c == '\t') {
+            *w++ = '\\'; *w++ = 't';
+        } else if (c < 0x20) {
+            *w++ = '\\'; *w++ = 'u'; *w++ = '0'; *w++ = '0';
+            *w++ = HEX[c >> 4];
+            *w++ = HEX[c & 15];
+        } else {
+            *w++ = (char)c;
+        }
+    }
+    *w++ = '"';
+    out->unreserve(worst - (size_t)(w - start));
+}
+
+void JsonWriter::begin_object() {
+    out->put('{');
+    need_comma = false;
+}
+
+void JsonWriter::end_object() {
+    out->put('}');
+    need_comma = true;
+}
+
+void JsonWriter::begin_array(const char* k) {
+    key(k);
+    out->put('[');
+    need_comma = false;
+}
+
+void JsonWriter::end_array() {
+    out->put(']');
+    need_comma = true;
+}
+
+void JsonWriter::begin_element() {
+    if (need_comma) out->put(',');
+    out->put('{');
+    need_comma = false;
+}
+
+void JsonWriter::field(const char* k, const char* s) {
+    field(k, s, std::strlen(s));
+}
+
+void JsonWriter::field(const char* k, const char* s, size_t n) {
+    key(k);
+    escaped(s, n);
+}
+
+void JsonWriter::field_u64(const char* k, uint64_t v) {
+    key(k);
+    char tmp[24];
+    int i = 24;
+    do { tmp[--i] = (char)('0' + v % 10); v /= 10; } while (v);
+    out->put(tmp + i, 24 - i);
+}
+
+void JsonWriter::field_i64(const char* k, int64_t v) {
+    if (v >= 0) { field_u64(k, (uint64_t)v); return; }
+    key(k);
+    out->put('-');
+    uint64_t u = (uint64_t)(-(v + 1)) + 1;
+    char tmp[24];
+    int i = 24;
+    do { tmp[--i] = (char)('0' + u % 10); u /= 10; } while (u);
+    out->put(tmp + i, 24 - i);
+}
+
+void JsonWriter::field_raw(const char* k, const char* json, size_t n) {
+    key(k);
+    out->put(json, n);
+}
+
+void JsonWriter::field_bool(const char* k, bool v) {
+    key(k);
+    if (v) out->put("true", 4);
+    else out->put("false", 5);
+}
+
+void JsonWriter::field_double(const char* k, double v) {
+    key(k);
+    char tmp[32];
+    int n = std::snprintf(tmp, sizeof(tmp), "%.2f", v);
+    out->put(tmp, (size_t)n);
+}
+
+void JsonWriter::field_base64(const char* k, const uint8_t* p, size_t n) {
+    key(k);
+    size_t out_len = ((n + 2) / 3) * 4;
+    char* w = out->reserve(out_len + 2);
+    *w++ = '"';
+
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        uint32_t v = ((uint32_t)p[i] << 16) | ((uint32_t)p[i + 1] << 8) | p[i + 2];
+        *w++ = B64_CHARS[(v >> 18) & 63];
+        *w++ = B64_CHARS[(v >> 12) & 63];
+        *w++ = B64_CHARS[(v >> 6) & 63];
+        *w++ = B64_CHARS[v & 63];
+    }
+    if (i < n) {
+        uint32_t v = (uint32_t)p[i] << 16;
+        if (i + 1 < n) v |= (uint32_t)p[i + 1] << 8;
+        *w++ = B64_CHARS[(v >> 18) & 63];
+        *w++ = B64_CHARS[(v >> 12) & 63];
+        *w++ = (i + 1 < n) ? B64_CHARS[(v >> 6) & 63] : '=';
+        *w++ = '=';
+    }
+    *w++ = '"';
+}
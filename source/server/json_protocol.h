@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#include "out_buffer.h"
+
+// ===============================
+// Zero-copy JSON request parsing
+// ===============================
+// Requests are flat JSON objects, one per line. The reader never allocates:
+// keys and values come back as slices into the connection buffer, and
+// escaped strings / base64 payloads are decoded in place (the decoded form
+// is never longer than the encoded one).
+
+enum class JsonType : uint8_t {
+    NONE = 0,
+    STRING,
+    NUMBER,
+    BOOL_TRUE,
+    BOOL_FALSE,
+    NUL,
+    OBJECT,
+    ARRAY
+};
+
+struct JsonSlice {
+    char* p;
+    uint32_t n;
+    JsonType type;
+    bool escaped;       // string contains backslash escapes
+
+    JsonSlice() : p(nullptr), n(0), type(JsonType::NONE), escaped(false) {}
+
+    bool empty() const { return n == 0; }
+    bool equals(const char* lit) const;
+};
+
+class JsonReader {
+private:
+    char* cur;
+    char* end;
+    bool ok;
+
+    void skip_ws();
+    bool scan_string(JsonSlice& out);
+    bool scan_value(JsonSlice& out);
+    bool skip_nested(char open, char close);
+
+public:
+    JsonReader(char* buf, size_t len) : cur(buf), end(buf + len), ok(true) {}
+
+    bool begin_object();
+
+    // Next member of the current object. Returns false at '}' or on error
+    // (check failed() to tell them apart).
+    bool next_member(JsonSlice& key, JsonSlice& value);
+
+    bool failed() const { return !ok; }
+};
+
+// value helpers; false for anything but digits (after a leading - for
+// i64) and for values out of range
+bool json_to_u64(const JsonSlice& s, uint64_t& out);
+bool json_to_i64(const JsonSlice& s, int64_t& out);
+
+// In-place decoders; return the decoded length, or -1 on malformed input.
+// After the call s.p[0 .. result) holds the decoded bytes.
+int64_t json_unescape_inplace(JsonSlice& s);
+int64_t base64_decode_inplace(JsonSlice& s);
+
+// ===============================
+// Response writer
+// ===============================
+// Appends to a caller-owned OutBuffer that is reused across responses, so
+// a steady-state connection does not allocate per response.
+class JsonWriter {
+private:
+    OutBuffer* out;
+    bool need_comma;
+
+    void key(const char* k);
+    void escaped(const char* s, size_t n);
+
+public:
+    explicit JsonWriter(OutBuffer* buf) : out(buf), need_comma(false) {}
+
+    void begin_object();
+    void end_object();
+    void begin_array(const char* k);
+    void end_array();
+    void begin_element();       // object inside an array
+    void end_line() { out->put('\n'); need_comma = false; }
+
+    void field(const char* k, const char* s);
+    void field(const char* k, const char* s, size_t n);
+    void field_u64(const char* k, uint64_t v);
+    void field_i64(const char* k, int64_t v);
+    void field_bool(const char* k, bool v);
+    void field_double(const char* k, double v);
+    void field_base64(const char* k, const uint8_t* p, size_t n);
+    void field_raw(const char* k, const char* json, size_t n);  // already-encoded value
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Growable byte buffer that keeps its capacity across reset(), so a
+// connection's reply buffer stops allocating once it has warmed up.
+class OutBuffer {
+private:
+    std::vector<char> buf;
+    size_t len;
+
+public:
+    OutBuffer() : len(0) {}
+
+    char* reserve(size_t n) {
+        if (len + n > buf.size()) {
+            size_t cap = buf.size() ? buf.size() : 4096;
+            while (cap < len + n) cap *= 2;
+            buf.resize(cap);
+        }
+        char* p = buf.data() + len;
+        len += n;
+        return p;
+    }
+
+    void put(const void* p, size_t n) { std::memcpy(reserve(n), p, n); }
+    void put(char c) { *reserve(1) = c; }
+
+    // give back the unused tail of the last reserve()
+    void unreserve(size_t n) { len -= n; }
+
+    char* at(size_t off) { return buf.data() + off; }
+    const char* data() const { return buf.data(); }
+    size_t size() const { return len; }
+    void reset() { len = 0; }
+};
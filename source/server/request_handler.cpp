@@ -0,0 +1,604 @@
+#include "request_handler.h"
+#include "../api/ofs_api.h"
+#include <cstdlib>
+#include <cstddef>
+
+// ==========================================================
+// Helpers
+// ==========================================================
+
+// Decode a string slice in place and NUL-terminate it. The terminator lands
+// on the closing quote (or inside the old escaped text), so nothing outside
+// the request is touched. Missing fields become "".
+static const char* cstr(JsonSlice& s) {
+    static char empty[1] = { 0 };
+    if (s.type != JsonType::STRING) return empty;
+    if (json_unescape_inplace(s) < 0) return empty;
+    s.p[s.n] = '\0';
+    return s.p;
+}
+
+// Decode the payload field according to "encoding".
+static bool payload(JsonRequest& rq, const char*& data, size_t& size) {
+    data = "";
+    size = 0;
+    if (rq.data.type != JsonType::STRING) return true;
+
+    int64_t n = rq.encoding.equals("base64") ? base64_decode_inplace(rq.data)
+                                             : json_unescape_inplace(rq.data);
+    if (n < 0) return false;
+    data = rq.data.p;
+    size = (size_t)n;
+    return true;
+}
+
+bool RequestHandler::key_matches(const char* key, size_t len) const {
+    const FSConfig& cfg = fs->get_config();
+    size_t stored = strnlen(cfg.private_key, sizeof(cfg.private_key));
+    if (stored == 0) return true;   // no key configured
+    return key && len == stored && std::memcmp(key, cfg.private_key, stored) == 0;
+}
+
+void RequestHandler::write_status(JsonWriter& out, OFSErrorCodes code) {
+    out.field("status", code == OFSErrorCodes::SUCCESS ? "ok" : "error");
+    out.field_i64("code", (int64_t)code);
+    out.field("message", get_error_message((int)code));
+}
+
+void RequestHandler::write_entry(JsonWriter& out, const FileEntry& fe) {
+    out.field("name", fe.name);
+    out.field("type", fe.type == (uint8_t)EntryType::DIRECTORY ? "directory" : "file");
+    out.field_u64("size", fe.size);
+    out.field_u64("permissions", fe.permissions);
+    out.field_u64("created_time", fe.created_time);
+    out.field_u64("modified_time", fe.modified_time);
+    out.field("owner", fe.owner, strnlen(fe.owner, sizeof(fe.owner)));
+    out.field_u64("inode", fe.inode);
+}
+
+// ==========================================================
+// Dispatch
+// ==========================================================
+bool RequestHandler::handle_json(char* line, size_t len, void*& conn_session, JsonWriter& out) {
+    JsonReader rd(line, len);
+    JsonRequest rq;
+    JsonSlice k, v;
+
+    if (rd.begin_object()) {
+        while (rd.next_member(k, v)) {
+            if      (k.equals("op"))          rq.op = v;
+            else if (k.equals("key"))         rq.key = v;
+            else if (k.equals("path"))        rq.path = v;
+            else if (k.equals("data"))        rq.data = v;
+            else if (k.equals("encoding"))    rq.encoding = v;
+            else if (k.equals("username"))    rq.username = v;
+            else if (k.equals("password"))    rq.password = v;
+            else if (k.equals("role"))        rq.role = v;
+            else if (k.equals("offset"))      rq.offset = v;
+            else if (k.equals("permissions")) rq.permissions = v;
+            else if (k.equals("prefix"))      rq.prefix = v;
+            else if (k.equals("cursor"))      rq.cursor = v;
+            else if (k.equals("limit"))       rq.limit = v;
+            else if (k.equals("version"))     rq.version = v;
+            else if (k.equals("name"))        rq.name = v;
+            else if (k.equals("snapshot"))    rq.snapshot = v;
+            else if (k.equals("tag"))         rq.tag = v;
+            else if (k.equals("session"))     rq.session = v;
+        }
+    }
+
+    if (rq.key.escaped || !key_matches(rq.key.p, rq.key.n)) return false;
+
+    out.begin_object();
+
+    if (rq.tag.type == JsonType::STRING)
+        out.field_raw("tag", rq.tag.p - 1, rq.tag.n + 2);   // keep the quotes
+    else if (rq.tag.type == JsonType::NUMBER)
+        out.field_raw("tag", rq.tag.p, rq.tag.n);
+
+    if (rd.failed() || rq.op.type != JsonType::STRING) {
+        write_status(out, OFSErrorCodes::ERROR_INVALID_OPERATION);
+        out.end_object();
+        out.end_line();
+        return true;
+    }
+
+    void* token_session = nullptr;
+    bool by_token = rq.session.type == JsonType::STRING;
+    if (by_token) fs->session_lookup(cstr(rq.session), &token_session);
+    void*& session = by_token ? token_session : conn_session;
+
+    const JsonSlice& op = rq.op;
+    bool b64 = rq.encoding.equals("base64");
+    OFSErrorCodes rc = OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
+
+    out.field("op", op.p, op.n);
+
+    if (op.equals("user_login")) {
+        void* s = nullptr;
+        rc = fs->user_login(cstr(rq.username), cstr(rq.password), &s);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            session = s;
+            SessionInfo info;
+            fs->get_session_info(s, &info);
+            out.field("session", info.session_id);
+        }
+    }
+    else if (op.equals("user_logout")) {
+        rc = fs->user_logout(session);
+        if (rc == OFSErrorCodes::SUCCESS) session = nullptr;
+        write_status(out, rc);
+    }
+    else if (op.equals("user_create")) {
+        UserRole role = rq.role.equals("admin") ? UserRole::ADMIN : UserRole::NORMAL;
+        rc = fs->user_create(session, cstr(rq.username), cstr(rq.password), role);
+        write_status(out, rc);
+    }
+    else if (op.equals("user_delete")) {
+        rc = fs->user_delete(session, cstr(rq.username));
+        write_status(out, rc);
+    }
+    else if (op.equals("user_list")) {
+        UserInfo* users = nullptr;
+        int count = 0;
+        rc = fs->user_list(session, &users, &count);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.begin_array("users");
+            for (int i = 0; i < count; i++) {
+                if (!users[i].is_active) continue;
+                out.begin_element();
+                out.field("username", users[i].username,
+                          strnlen(users[i].username, sizeof(users[i].username)));
+                out.field("role", users[i].role == UserRole::ADMIN ? "admin" : "normal");
+                out.field_u64("created_time", users[i].created_time);
+                out.field_u64("last_login", users[i].last_login);
+                out.end_object();
+            }
+            out.end_array();
+        }
+    }
+    else if (op.equals("get_session_info")) {
+        SessionInfo info;
+        rc = fs->get_session_info(session, &info);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.field("session", info.session_id);
+            out.field("username", info.user.username,
+                      strnlen(info.user.username, sizeof(info.user.username)));
+            out.field_u64("login_time", info.login_time);
+            out.field_u64("last_activity", info.last_activity);
+            out.field_u64("operations_count", info.operations_count);
+        }
+    }
+    else if (op.equals("file_create") || op.equals("file_edit")) {
+        const char* data;
+        size_t size;
+        const char* path = cstr(rq.path);
+        if (!payload(rq, data, size)) {
+            rc = OFSErrorCodes::ERROR_INVALID_OPERATION;
+        } else if (op.equals("file_create")) {
+            rc = fs->file_create(session, path, data, size);
+        } else {
+            uint64_t off = 0;
+            json_to_u64(rq.offset, off);
+            rc = fs->file_edit(session, path, data, size, (unsigned int)off);
+        }
+        write_status(out, rc);
+    }
+    else if (op.equals("file_read")) {
+        char* buf = nullptr;
+        size_t size = 0;
+        rc = fs->file_read(session, cstr(rq.path), &buf, &size);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.field_u64("size", size);
+            if (b64) out.field_base64("data", (const uint8_t*)buf, size);
+            else out.field("data", buf, size);
+        }
+        free(buf);
+    }
+    else if (op.equals("file_list_versions")) {
+        FileVersion* versions = nullptr;
+        int count = 0;
+        rc = fs->file_list_versions(session, cstr(rq.path), &versions, &count);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.begin_array("versions");
+            for (int i = 0; i < count; i++) {
+                out.begin_element();
+                out.field_u64("version", versions[i].version);
+                out.field_u64("size", versions[i].size);
+                out.field_u64("modified_time", versions[i].modified_time);
+                out.field_u64("replaced_time", versions[i].replaced_time);
+                out.end_object();
+            }
+            out.end_array();
+            free(versions);
+        }
+    }
+    else if (op.equals("file_read_version")) {
+        char* buf = nullptr;
+        size_t size = 0;
+        uint64_t version = 0;
+        json_to_u64(rq.version, version);
+        rc = fs->file_read_version(session, cstr(rq.path), (uint32_t)version, &buf, &size);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.field_u64("size", size);
+            if (b64) out.field_base64("data", (const uint8_t*)buf, size);
+            else out.field("data", buf, size);
+        }
+        free(buf);
+    }
+    else if (op.equals("file_delete")) {
+        rc = fs->file_delete(session, cstr(rq.path));
+        write_status(out, rc);
+    }
+    else if (op.equals("file_truncate")) {
+        rc = fs->file_truncate(session, cstr(rq.path));
+        write_status(out, rc);
+    }
+    else if (op.equals("dir_create")) {
+        rc = fs->dir_create(session, cstr(rq.path));
+        write_status(out, rc);
+    }
+    else if (op.equals("dir_delete")) {
+        rc = fs->dir_delete(session, cstr(rq.path));
+        write_status(out, rc);
+    }
+    else if (op.equals("dir_list")) {
+        FileEntry* entries = nullptr;
+        int count = 0;
+        uint64_t limit = 0;
+        json_to_u64(rq.limit, limit);
+        const char* path = cstr(rq.path);
+        const char* prefix = cstr(rq.prefix);
+        rc = fs->dir_list_page(session, path, prefix, cstr(rq.cursor), (uint32_t)limit,
+                               &entries, &count);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.begin_array("entries");
+            for (int i = 0; i < count; i++) {
+                out.begin_element();
+                write_entry(out, entries[i]);
+                out.end_object();
+            }
+            out.end_array();
+            // a full page may have more behind it
+            if (limit && (uint64_t)count == limit)
+                out.field("cursor", FileSystem::page_cursor(entries[count - 1]).c_str());
+            free(entries);
+        }
+    }
+    else if (op.equals("get_metadata")) {
+        FileMetadata md;
+        rc = fs->get_metadata(session, cstr(rq.path), &md);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.field("path", md.path);
+            write_entry(out, md.entry);
+            out.field_u64("blocks_used", md.blocks_used);
+            out.field_u64("actual_size", md.actual_size);
+        }
+    }
+    else if (op.equals("set_permissions")) {
+        uint64_t perms = 0;
+        json_to_u64(rq.permissions, perms);
+        rc = fs->set_permissions(session, cstr(rq.path), (uint32_t)perms);
+        write_status(out, rc);
+    }
+    else if (op.equals("get_stats")) {
+        FSStats st;
+        rc = fs->get_stats(session, &st);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.field_u64("total_size", st.total_size);
+            out.field_u64("used_space", st.used_space);
+            out.field_u64("free_space", st.free_space);
+            out.field_u64("total_files", st.total_files);
+            out.field_u64("total_directories", st.total_directories);
+            out.field_u64("total_users", st.total_users);
+            out.field_u64("active_sessions", st.active_sessions);
+            out.field_double("fragmentation", st.fragmentation);
+        }
+    }
+    else if (op.equals("container_snapshot")) {
+        rc = fs->container_snapshot(session, cstr(rq.name));
+        write_status(out, rc);
+    }
+    else if (op.equals("container_clone")) {
+        rc = fs->container_clone(session, cstr(rq.snapshot), cstr(rq.name));
+        write_status(out, rc);
+    }
+    else if (op.equals("container_snapshot_delete")) {
+        rc = fs->container_snapshot_delete(session, cstr(rq.name));
+        write_status(out, rc);
+    }
+    else if (op.equals("container_snapshot_list")) {
+        SnapshotInfo* snaps = nullptr;
+        int count = 0;
+        rc = fs->container_snapshot_list(session, &snaps, &count);
+        write_status(out, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.begin_array("snapshots");
+            for (int i = 0; i < count; i++) {
+                out.begin_element();
+                out.field("name", snaps[i].name, strnlen(snaps[i].name, sizeof(snaps[i].name)));
+                out.field_u64("created_time", snaps[i].created_time);
+                out.field_u64("files", snaps[i].files);
+                out.field_bool("writable", snaps[i].writable != 0);
+                out.field_bool("mounted", snaps[i].mounted != 0);
+                out.end_object();
+            }
+            out.end_array();
+            free(snaps);
+        }
+    }
+    else {
+        write_status(out, rc);
+    }
+
+    out.end_object();
+    out.end_line();
+    return true;
+}
+
+// ==========================================================
+// Binary dispatch
+// ==========================================================
+
+// copy a length-delimited string field into a NUL-terminated stack buffer;
+// null when it does not fit, rather than passing on a cut-down string
+static const char* bin_str(const char* p, size_t n, char* buf, size_t cap) {
+    if (n >= cap) return nullptr;
+    std::memcpy(buf, p, n);
+    buf[n] = '\0';
+    return buf;
+}
+
+void RequestHandler::handle_binary(const char* frame, size_t len, void*& conn_session, OutBuffer& out,
+                                   void** raw_snapshot) {
+    BinRequestHeader h;
+    std::memcpy(&h, frame, sizeof(h));
+    *raw_snapshot = nullptr;
+
+    static const uint8_t no_token[16] = { 0 };
+    void* token_session = nullptr;
+    bool by_token = std::memcmp(h.token, no_token, sizeof(no_token)) != 0;
+    if (by_token) fs->session_lookup(h.token, &token_session);
+    void*& session = by_token ? token_session : conn_session;
+
+    BinOp op = (BinOp)h.opcode;
+    if (sizeof(h) + (size_t)h.path_len + h.payload_len > len) {
+        size_t r = bin_begin_reply(out, h, OFSErrorCodes::ERROR_INVALID_OPERATION);
+        bin_end_reply(out, r, 0);
+        return;
+    }
+
+    char path[512];
+    if (!bin_str(frame + sizeof(h), h.path_len, path, sizeof(path))) {
+        size_t r = bin_begin_reply(out, h, OFSErrorCodes::ERROR_INVALID_PATH);
+        bin_end_reply(out, r, 0);
+        return;
+    }
+    const char* payload = frame + sizeof(h) + h.path_len;
+
+    OFSErrorCodes rc = OFSErrorCodes::ERROR_NOT_IMPLEMENTED;
+    uint32_t count = 0;
+    size_t r = 0;
+
+    switch (op) {
+    case BinOp::USER_LOGIN: {
+        char pw[256];
+        void* s = nullptr;
+        const char* password = bin_str(payload, h.payload_len, pw, sizeof(pw));
+        rc = password ? fs->user_login(path, password, &s) : OFSErrorCodes::ERROR_INVALID_OPERATION;
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            session = s;
+            SessionInfo info;
+            fs->get_session_info(s, &info);
+            out.put(&info, sizeof(info));
+            count = 1;
+        }
+        break;
+    }
+    case BinOp::USER_LOGOUT:
+        rc = fs->user_logout(session);
+        if (rc == OFSErrorCodes::SUCCESS) session = nullptr;
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::USER_CREATE: {
+        char pw[256];
+        const char* password = bin_str(payload, h.payload_len, pw, sizeof(pw));
+        rc = password ? fs->user_create(session, path, password, (UserRole)h.aux)
+                      : OFSErrorCodes::ERROR_INVALID_OPERATION;
+        r = bin_begin_reply(out, h, rc);
+        break;
+    }
+    case BinOp::USER_DELETE:
+        rc = fs->user_delete(session, path);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::USER_LIST: {
+        UserInfo* users = nullptr;
+        int n = 0;
+        rc = fs->user_list(session, &users, &n);
+        r = bin_begin_reply(out, h, rc);
+        for (int i = 0; rc == OFSErrorCodes::SUCCESS && i < n; i++) {
+            if (!users[i].is_active) continue;
+            size_t at = out.size();
+            out.put(&users[i], sizeof(UserInfo));
+            std::memset(out.at(at) + offsetof(UserInfo, password_hash), 0,
+                        sizeof(users[i].password_hash));
+            count++;
+        }
+        break;
+    }
+    case BinOp::SESSION_INFO: {
+        SessionInfo info;
+        rc = fs->get_session_info(session, &info);
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) { out.put(&info, sizeof(info)); count = 1; }
+        break;
+    }
+    case BinOp::FILE_CREATE:
+        rc = fs->file_create(session, path, payload, h.payload_len);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::FILE_EDIT:
+        rc = fs->file_edit(session, path, payload, h.payload_len, (unsigned int)h.offset);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::FILE_READ: {
+        // read straight into the reply buffer through a snapshot
+        void* snap = nullptr;
+        uint64_t size = 0;
+        bool streamable = false;
+        rc = fs->snapshot_open(session, path, &snap, &size, &streamable);
+        r = bin_begin_reply(out, h, rc);
+        // raw mode: the pinned snapshot keeps its blocks from being
+        // overwritten while the server streams them from disk, once its own
+        // dirty blocks are written. Content not stored as plain bytes
+        // (inline, compressed, encoded), or blocks that cannot be written,
+        // take the buffered path and the reply comes back without the RAW flag.
+        // The server owns the snapshot from here, so a logout or session
+        // expiry queued behind the read cannot free it mid-stream
+        if (rc == OFSErrorCodes::SUCCESS && (h.flags & BIN_FLAG_RAW) && streamable &&
+            fs->snapshot_flush(snap) == OFSErrorCodes::SUCCESS) {
+            ((BinResponseHeader*)out.at(r))->flags = BIN_FLAG_RAW;
+            bin_end_reply(out, r, (uint32_t)size);
+            ((BinResponseHeader*)out.at(r))->length += (uint32_t)size;
+            fs->snapshot_detach(snap);
+            *raw_snapshot = snap;
+            return;
+        }
+        if (rc == OFSErrorCodes::SUCCESS) {
+            size_t got = 0;
+            char* dst = out.reserve(size);
+            rc = fs->snapshot_read(snap, 0, dst, size, &got);
+            fs->snapshot_close(snap);
+            if (rc != OFSErrorCodes::SUCCESS) {
+                out.unreserve(size);
+                ((BinResponseHeader*)out.at(r))->status = (int32_t)rc;
+            } else {
+                count = (uint32_t)got;
+            }
+        }
+        break;
+    }
+    case BinOp::FILE_VERSIONS: {
+        FileVersion* versions = nullptr;
+        int n = 0;
+        rc = fs->file_list_versions(session, path, &versions, &n);
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.put(versions, (size_t)n * sizeof(FileVersion));
+            count = (uint32_t)n;
+            free(versions);
+        }
+        break;
+    }
+    case BinOp::FILE_READ_VERSION: {
+        char* buf = nullptr;
+        size_t size = 0;
+        rc = fs->file_read_version(session, path, h.aux, &buf, &size);
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.put(buf, size);
+            count = (uint32_t)size;
+        }
+        free(buf);
+        break;
+    }
+    case BinOp::CONTAINER_SNAPSHOT:
+        rc = fs->container_snapshot(session, path);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::CONTAINER_CLONE: {
+        char name[64];
+        const char* clone = bin_str(payload, h.payload_len, name, sizeof(name));
+        rc = clone ? fs->container_clone(session, path, clone) : OFSErrorCodes::ERROR_INVALID_OPERATION;
+        r = bin_begin_reply(out, h, rc);
+        break;
+    }
+    case BinOp::CONTAINER_SNAPSHOT_DELETE:
+        rc = fs->container_snapshot_delete(session, path);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::CONTAINER_SNAPSHOT_LIST: {
+        SnapshotInfo* snaps = nullptr;
+        int n = 0;
+        rc = fs->container_snapshot_list(session, &snaps, &n);
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.put(snaps, (size_t)n * sizeof(SnapshotInfo));
+            count = (uint32_t)n;
+            free(snaps);
+        }
+        break;
+    }
+    case BinOp::FILE_DELETE:
+        rc = fs->file_delete(session, path);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::FILE_TRUNCATE:
+        rc = fs->file_truncate(session, path);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::DIR_CREATE:
+        rc = fs->dir_create(session, path);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::DIR_DELETE:
+        rc = fs->dir_delete(session, path);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::DIR_LIST: {
+        // payload = prefix '\0' cursor, aux = page size
+        char prefix[256], cursor[256];
+        size_t plen = strnlen(payload, h.payload_len);
+        bool fits = bin_str(payload, plen, prefix, sizeof(prefix)) != nullptr;
+        if (plen < h.payload_len)
+            fits = fits && bin_str(payload + plen + 1, h.payload_len - plen - 1, cursor, sizeof(cursor));
+        else
+            cursor[0] = '\0';
+        FileEntry* entries = nullptr;
+        int n = 0;
+        rc = fits ? fs->dir_list_page(session, path, prefix, cursor, h.aux, &entries, &n)
+                  : OFSErrorCodes::ERROR_INVALID_OPERATION;
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) {
+            out.put(entries, (size_t)n * sizeof(FileEntry));
+            count = (uint32_t)n;
+            free(entries);
+        }
+        break;
+    }
+    case BinOp::GET_METADATA: {
+        FileMetadata md;
+        rc = fs->get_metadata(session, path, &md);
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) { out.put(&md, sizeof(md)); count = 1; }
+        break;
+    }
+    case BinOp::SET_PERMISSIONS:
+        rc = fs->set_permissions(session, path, h.aux);
+        r = bin_begin_reply(out, h, rc);
+        break;
+    case BinOp::GET_STATS: {
+        FSStats st;
+        rc = fs->get_stats(session, &st);
+        r = bin_begin_reply(out, h, rc);
+        if (rc == OFSErrorCodes::SUCCESS) { out.put(&st, sizeof(st)); count = 1; }
+        break;
+    }
+    default:
+        r = bin_begin_reply(out, h, rc);
+        break;
+    }
+
+    bin_end_reply(out, r, count);
+}
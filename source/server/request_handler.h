@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#include "../core/FileSystem.h"
+#include "json_protocol.h"
+#include "binary_protocol.h"
+
+// ===============================
+// Parsed JSON request (slices into the connection buffer)
+// ===============================
+struct JsonRequest {
+    JsonSlice op;
+    JsonSlice key;          // private key (stealth policy)
+    JsonSlice path;
+    JsonSlice data;
+    JsonSlice encoding;     // "base64" or absent for plain JSON strings
+    JsonSlice username;
+    JsonSlice password;
+    JsonSlice role;
+    JsonSlice offset;
+    JsonSlice permissions;
+    JsonSlice prefix;       // dir_list: name prefix filter
+    JsonSlice cursor;       // dir_list: resume after this name
+    JsonSlice limit;        // dir_list: page size
+    JsonSlice version;      // file_read_version
+    JsonSlice name;         // container snapshot or clone to create / delete
+    JsonSlice snapshot;     // container_clone: the snapshot to copy
+    JsonSlice tag;          // client tag echoed in the reply (pipelining)
+    JsonSlice session;      // session token; overrides the connection's session
+};
+
+// ===============================
+// Executes one request against the FileSystem
+// ===============================
+class RequestHandler {
+private:
+    FileSystem* fs;
+
+    void write_status(JsonWriter& out, OFSErrorCodes code);
+    void write_entry(JsonWriter& out, const FileEntry& fe);
+
+public:
+    RequestHandler() { fs = nullptr; }
+
+    void init(FileSystem* f) { fs = f; }
+
+    // Parses `line` in place and writes a full response line to `out`.
+    // `session` is the connection's logged-in session, updated by
+    // user_login / user_logout. A request carrying its own "session" token
+    // runs under that session instead and leaves the connection's alone.
+    // Returns false when the request must be dropped without any reply
+    // (bad private key).
+    bool handle_json(char* line, size_t len, void*& session, JsonWriter& out);
+
+    // Executes one binary frame (length prefix included) and appends the
+    // reply frame to `out`. A non-zero header token selects the session the
+    // same way as the JSON "session" field. For a raw FILE_READ only the reply header is
+    // written; *raw_snapshot is set, detached from the session, and the caller
+    // streams the body and closes it.
+    void handle_binary(const char* frame, size_t len, void*& session, OutBuffer& out,
+                       void** raw_snapshot);
+
+    // Checks the private key sent with the binary preface.
+    bool key_matches(const char* key, size_t len) const;
+};
@@ -0,0 +1,368 @@
+#include "server.h"
+
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+
+// receive buffer cap: the largest frame with its length prefix, behind the
+// binary preface
+static const size_t MAX_REQUEST_BYTES = BIN_MAX_FRAME + 4 + BIN_PREFACE_LEN;
+
+// stop reading from a client that is not draining its replies
+static const size_t OUT_HIGH_WATER = 8u * 1024u * 1024u;
+
+// blocks checked per loop iteration when verify_mode = scrub
+static const uint32_t SCRUB_BLOCKS_PER_TICK = 64;
+static const uint32_t WRITE_BEHIND_BLOCKS = 256;
+
+static void set_nonblocking(int fd) {
+    int fl = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+// ==========================================================
+// Constructor / destructor
+// ==========================================================
+Server::Server() {
+    fs = nullptr;
+    listen_fd = -1;
+    omni_fd = -1;
+    max_connections = 0;
+    stall_timeout = 0;
+    running = false;
+}
+
+Server::~Server() {
+    for (auto* c : conns) {
+        close(c->fd);
+        delete c;
+    }
+    conns.clear();
+    if (listen_fd >= 0) close(listen_fd);
+    if (omni_fd >= 0) close(omni_fd);
+}
+
+// ==========================================================
+// START
+// ==========================================================
+bool Server::start(FileSystem* f, uint16_t port, uint32_t max_conns) {
+    fs = f;
+    handler.init(f);
+    max_connections = max_conns ? max_conns : 20;
+    stall_timeout = f->get_config().stream_stall_timeout;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) return false;
+
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0) return false;
+    if (listen(listen_fd, 64) < 0) return false;
+
+    set_nonblocking(listen_fd);
+
+    omni_fd = open(f->get_path().c_str(), O_RDONLY);
+    running = true;
+    return true;
+}
+
+// ==========================================================
+// MAIN LOOP
+// ==========================================================
+void Server::run() {
+    std::vector<pollfd> pfds;
+
+    while (running) {
+        pfds.clear();
+        pfds.push_back({ listen_fd, POLLIN, 0 });
+        size_t conns_polled = conns.size();
+        for (auto* c : conns) {
+            short ev = 0;
+            if (c->unsent() < OUT_HIGH_WATER) ev |= POLLIN;
+            if (c->has_output()) ev |= POLLOUT;
+            pfds.push_back({ c->fd, ev, 0 });
+        }
+        // container I/O completions wake the loop like a socket would
+        int io_fd = fs->io_event_fd();
+        if (io_fd >= 0) pfds.push_back({ io_fd, POLLIN, 0 });
+
+        int n = poll(pfds.data(), pfds.size(), 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN) accept_clients();
+
+        // conns may have grown in accept_clients; only walk the polled ones
+        for (size_t i = 1; i <= conns_polled; i++) {
+            Connection* c = conns[i - 1];
+            short re = pfds[i].revents;
+            if (re & (POLLERR | POLLNVAL)) { c->closed = true; continue; }
+            if ((re & (POLLIN | POLLHUP)) && !read_from(c)) { c->closed = true; continue; }
+            if (re & POLLOUT) flush_output(c);
+        }
+
+        for (auto* c : conns)
+            if (!c->closed) frame_requests(c);
+
+        execute_pending();
+
+        // one send per connection for the whole batch of replies
+        for (auto* c : conns)
+            if (!c->closed && c->has_output()) flush_output(c);
+
+        drop_stalled();
+        drop_closed();
+
+        // idle and lifetime limits; the poll timeout guarantees a tick a second
+        fs->expire_sessions();
+        fs->scrub_step(SCRUB_BLOCKS_PER_TICK);
+        fs->pack_tails();
+        fs->io_step(WRITE_BEHIND_BLOCKS);
+    }
+}
+
+// ==========================================================
+// ACCEPT
+// ==========================================================
+void Server::accept_clients() {
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) return;
+
+        if (conns.size() >= max_connections) {
+            close(fd);
+            continue;
+        }
+
+        set_nonblocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        conns.push_back(new Connection(fd));
+    }
+}
+
+// ==========================================================
+// READ + FRAME
+// ==========================================================
+bool Server::read_from(Connection* c) {
+    // reclaim the already-consumed prefix before reading more
+    bool reclaimed = c->in_start > 0;
+    if (reclaimed) {
+        std::memmove(c->in.data(), c->in.data() + c->in_start, c->in_len - c->in_start);
+        c->in_len -= c->in_start;
+        c->in_start = 0;
+    }
+
+    while (true) {
+        if (c->in_len == c->in.size()) {
+            // full at the cap: with requests ahead of it, read the rest once
+            // they are consumed; a single request this large never completes
+            if (c->in.size() >= MAX_REQUEST_BYTES) return reclaimed;
+            c->in.resize(std::min(c->in.size() * 2, MAX_REQUEST_BYTES));
+        }
+
+        ssize_t r = recv(c->fd, c->in.data() + c->in_len, c->in.size() - c->in_len, 0);
+        if (r > 0) {
+            c->in_len += (size_t)r;
+            continue;
+        }
+        if (r == 0) return false;
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+}
+
+// Decide JSON vs binary from the first bytes. JSON requests start with '{'
+// (or whitespace), so the binary magic cannot be mistaken for one.
+bool Server::detect_protocol(Connection* c) {
+    size_t avail = c->in_len - c->in_start;
+    if (avail == 0) return false;
+
+    const char* p = c->in.data() + c->in_start;
+    if (p[0] != BIN_MAGIC[0]) {
+        c->proto = WireProtocol::JSON;
+        return true;
+    }
+    if (avail < BIN_PREFACE_LEN) return false;
+    if (std::memcmp(p, BIN_MAGIC, sizeof(BIN_MAGIC)) != 0) {
+        c->proto = WireProtocol::JSON;
+        return true;
+    }
+
+    const char* key = p + sizeof(BIN_MAGIC);
+    if (!handler.key_matches(key, strnlen(key, 64))) {
+        c->closed = true;
+        return false;
+    }
+    c->in_start += BIN_PREFACE_LEN;
+    c->proto = WireProtocol::BINARY;
+    return true;
+}
+
+// Queue every complete request in the buffer, in order. The queue is fully
+// drained before the next recv, so the offsets stay valid until executed.
+uint32_t Server::frame_requests(Connection* c) {
+    if (c->unsent() >= OUT_HIGH_WATER) return 0;
+    if (c->proto == WireProtocol::UNKNOWN && !detect_protocol(c)) return 0;
+
+    char* base = c->in.data();
+    uint32_t queued = 0;
+
+    while (c->in_start < c->in_len) {
+        size_t avail = c->in_len - c->in_start;
+        PendingRequest p;
+        p.conn = c;
+        p.begin = c->in_start;
+
+        if (c->proto == WireProtocol::BINARY) {
+            int64_t n = bin_frame_length(base + c->in_start, avail);
+            if (n < 0) { c->closed = true; break; }
+            if (n == 0) break;
+            p.len = (size_t)n;
+            c->in_start += p.len;
+        } else {
+            char* nl = (char*)std::memchr(base + c->in_start, '\n', avail);
+            if (!nl) break;
+            p.len = (size_t)(nl - (base + c->in_start));
+            c->in_start = (size_t)(nl - base) + 1;
+        }
+
+        fifo.enqueue(p);
+        queued++;
+    }
+    return queued;
+}
+
+// ==========================================================
+// FIFO EXECUTION
+// ==========================================================
+void Server::execute_pending() {
+    PendingRequest p;
+    while (fifo.dequeue(p)) {
+        Connection* c = p.conn;
+        if (c->closed) continue;
+
+        // a request with the wrong key gets no reply at all
+        char* req = c->in.data() + p.begin;
+        if (c->proto == WireProtocol::BINARY) {
+            void* snap = nullptr;
+            handler.handle_binary(req, p.len, c->session, c->out, &snap);
+            if (snap) {
+                RawStream rs;
+                rs.snapshot = snap;
+                rs.out_pos = c->out.size();
+                rs.ext_off = 0;
+                rs.ext_left = 0;
+                if (c->streams.empty()) c->last_sent = (uint64_t)time(nullptr);
+                c->streams.push_back(rs);
+            }
+        } else {
+            handler.handle_json(req, p.len, c->session, c->writer);
+        }
+    }
+}
+
+// ==========================================================
+// WRITE
+// ==========================================================
+// Returns true while part of the reply is still unsent.
+bool Server::flush_output(Connection* c) {
+    while (true) {
+        // buffered bytes up to the next raw stream (or the end)
+        size_t limit = c->streams.empty() ? c->out.size() : c->streams.front().out_pos;
+        while (c->out_sent < limit) {
+            ssize_t w = send(c->fd, c->out.data() + c->out_sent,
+                             limit - c->out_sent, MSG_NOSIGNAL);
+            if (w > 0) {
+                c->out_sent += (size_t)w;
+                c->last_sent = (uint64_t)time(nullptr);
+                continue;
+            }
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return true;
+            c->closed = true;
+            return false;
+        }
+
+        if (c->streams.empty()) break;
+        if (!pump_stream(c, c->streams.front())) return !c->closed;
+
+        fs->snapshot_close(c->streams.front().snapshot);
+        c->streams.pop_front();
+    }
+
+    c->out.reset();
+    c->out_sent = 0;
+    return false;
+}
+
+// Stream a snapshot block by block from the container file. The socket and
+// the page cache are the only buffers; nothing is copied in user space.
+// Returns true once the whole body is sent.
+bool Server::pump_stream(Connection* c, RawStream& rs) {
+    while (true) {
+        if (rs.ext_left == 0) {
+            if (fs->snapshot_next_extent(rs.snapshot, &rs.ext_off, &rs.ext_left)
+                    != OFSErrorCodes::SUCCESS) {
+                c->closed = true;
+                return false;
+            }
+            if (rs.ext_left == 0) return true;
+        }
+
+        off_t off = (off_t)rs.ext_off;
+        ssize_t w = sendfile(c->fd, omni_fd, &off, rs.ext_left);
+        if (w > 0) {
+            rs.ext_off += (uint64_t)w;
+            rs.ext_left -= (uint64_t)w;
+            c->last_sent = (uint64_t)time(nullptr);
+            continue;
+        }
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return false;
+        c->closed = true;
+        return false;
+    }
+}
+
+// ==========================================================
+// CLEANUP
+// ==========================================================
+// A raw download keeps its snapshot, and so the blocks of every version
+// retired since, until it is sent. A client that stops reading is cut off.
+void Server::drop_stalled() {
+    if (!stall_timeout) return;
+    uint64_t now = (uint64_t)time(nullptr);
+    for (auto* c : conns)
+        if (!c->streams.empty() && now - c->last_sent >= stall_timeout)
+            c->closed = true;
+}
+
+void Server::drop_closed() {
+    for (size_t i = 0; i < conns.size(); ) {
+        Connection* c = conns[i];
+        if (!c->closed) { i++; continue; }
+
+        for (auto& rs : c->streams) fs->snapshot_close(rs.snapshot);
+        if (c->session) fs->user_logout(c->session);
+        close(c->fd);
+        delete c;
+        conns.erase(conns.begin() + i);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <deque>
+
+#include "../core/FileSystem.h"
+#include "../data_structures/Queue.h"
+#include "json_protocol.h"
+#include "binary_protocol.h"
+#include "request_handler.h"
+
+enum class WireProtocol : uint8_t {
+    UNKNOWN = 0,    // nothing received yet
+    JSON,
+    BINARY
+};
+
+// File body streamed from the container with sendfile once the reply
+// buffer has been sent up to out_pos.
+struct RawStream {
+    void* snapshot;
+    size_t out_pos;
+    uint64_t ext_off;       // current extent in the container file
+    uint64_t ext_left;
+};
+
+// ===============================
+// One client connection
+// ===============================
+struct Connection {
+    int fd;
+    WireProtocol proto;
+
+    std::vector<char> in;   // receive buffer, requests are parsed in place
+    size_t in_start;        // first byte not yet framed
+    size_t in_len;          // bytes received
+
+    OutBuffer out;          // reusable response buffer
+    JsonWriter writer;
+    size_t out_sent;
+    std::deque<RawStream> streams;  // raw downloads, in reply order
+    uint64_t last_sent;     // when bytes last left while streams were queued
+
+    void* session;          // session opened by user_login on this connection
+    bool closed;
+
+    explicit Connection(int f)
+        : fd(f), proto(WireProtocol::UNKNOWN), in_start(0), in_len(0),
+          writer(&out), out_sent(0), last_sent(0),
+          session(nullptr), closed(false) {
+        in.resize(16 * 1024);
+    }
+
+    size_t unsent() const { return out.size() - out_sent; }
+    bool has_output() const { return unsent() > 0 || !streams.empty(); }
+};
+
+struct PendingRequest {
+    Connection* conn;
+    size_t begin;           // offset of the request line / frame in conn->in
+    size_t len;
+};
+
+// ===============================
+// TCP server + FIFO executor
+// ===============================
+// Single-threaded: poll() gathers complete requests from every client into
+// one FIFO queue, then the queue is drained one operation at a time.
+// Clients may pipeline: every complete request in a connection's buffer is
+// queued in arrival order, and replies echo the client's tag so they can be
+// matched without waiting for each round trip.
+class Server {
+private:
+    FileSystem* fs;
+    RequestHandler handler;
+
+    int listen_fd;
+    int omni_fd;            // read-only container handle for sendfile
+    uint32_t max_connections;
+    uint32_t stall_timeout;     // FSConfig::stream_stall_timeout
+    bool running;
+
+    std::vector<Connection*> conns;
+    Queue<PendingRequest> fifo;
+
+    void accept_clients();
+    bool read_from(Connection* c);
+    bool detect_protocol(Connection* c);
+    uint32_t frame_requests(Connection* c);
+    void execute_pending();
+    bool flush_output(Connection* c);
+    bool pump_stream(Connection* c, RawStream& rs);
+    void drop_stalled();
+    void drop_closed();
+
+public:
+    Server();
+    ~Server();
+
+    bool start(FileSystem* f, uint16_t port, uint32_t max_conns);
+    void run();
+    void stop() { running = false; }
+};
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <csignal>
+#include <sys/stat.h>
+
+#include "../core/FileSystem.cpp"   // pulls in all core .cpp files
+#include "../api/ofs_api.cpp"
+#include "json_protocol.cpp"
+#include "binary_protocol.cpp"
+#include "request_handler.cpp"
+#include "server.cpp"
+
+static Server* g_server = nullptr;
+
+static void on_signal(int) {
+    if (g_server) g_server->stop();
+}
+
+// usage: server <container.omni> <config.uconf> [snapshot]
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "usage: " << argv[0] << " <container.omni> <config.uconf> [snapshot]\n";
+        return 1;
+    }
+    const char* omni = argv[1];
+    const char* conf = argv[2];
+    const char* snapshot = argc > 3 ? argv[3] : nullptr;
+
+    struct stat st;
+    if (stat(omni, &st) != 0) {
+        int rc = fs_format(omni, conf);
+        if (rc != 0) {
+            std::cout << "format failed: " << get_error_message(rc) << "\n";
+            return 1;
+        }
+    }
+
+    void* inst = nullptr;
+    int rc = fs_init_snapshot(&inst, omni, conf, snapshot);
+    if (rc != 0) {
+        std::cout << "init failed: " << get_error_message(rc) << "\n";
+        return 1;
+    }
+    FileSystem* fs = (FileSystem*)inst;
+
+    Server server;
+    const FSConfig& cfg = fs->get_config();
+    if (!server.start(fs, (uint16_t)cfg.server_port, cfg.max_connections)) {
+        std::cout << "cannot listen on port " << cfg.server_port << "\n";
+        fs_shutdown(inst);
+        return 1;
+    }
+
+    g_server = &server;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::cout << "OFS server listening on port " << cfg.server_port << "\n";
+    server.run();
+
+    fs_shutdown(inst);
+    return 0;
+}